@@ -8,11 +8,15 @@
  *  assigned two sets of color values (colors, alt_colors) and any number of
  *  properties ('property' is an array of values for the mesh vertices, for
  *  example morphogen concentrations).
+ *
+ *  Polygons are stored as a single index array with per-polygon offsets, and
+ *  properties as one contiguous float column per property, to keep large
+ *  meshes in a few allocations.
  */
 
 #include <vector>
 #include <algorithm>
-#include <functional>
+#include <stdexcept>
 #include <stdint.h>
 
 namespace mesh {
@@ -51,11 +55,149 @@ struct vertex {
 
 
 typedef std::vector<uint32_t>       polygon;
-typedef std::vector<polygon>        polygon_array;
 typedef std::vector<vertex>         vertex_array;
 typedef std::vector<vertex_color>   color_array;
 typedef std::vector<double>         property;
 typedef std::vector<property>       property_array;
+typedef std::vector<float>          property_column;
+
+
+// Read-only view to a contiguous range of elements stored elsewhere.
+template <typename T>
+class array_view {
+public:
+    array_view( const T* data=nullptr, size_t n=0 ) : m_data(data), m_size(n) {}
+
+    size_t size() const                     { return m_size; }
+    bool empty() const                      { return m_size == 0; }
+    const T& operator[]( size_t i ) const   { return m_data[i]; }
+    const T* begin() const                  { return m_data; }
+    const T* end() const                    { return m_data + m_size; }
+
+    const T& at( size_t i ) const
+    {
+        if (i >= m_size) throw std::out_of_range("array_view::at");
+        return m_data[i];
+    }
+
+private:
+    const T* m_data;
+    size_t m_size;
+};
+
+
+// Polygons stored in compressed row form: the vertex indices of all polygons
+// back to back, and the offset of the first index of each polygon. Polygon i
+// is indices[offsets[i]] ... indices[offsets[i+1]-1]. Indexing and iteration
+// give array_view's to the polygons.
+class polygon_list {
+public:
+    polygon_list() : offsets(1, 0) {}
+
+    class const_iterator {
+    public:
+        const_iterator( const uint32_t* off, const uint32_t* ind ) :
+            m_off(off), m_ind(ind) {}
+        const array_view<uint32_t>& operator*() const
+        {
+            m_cur = array_view<uint32_t>( m_ind+m_off[0], m_off[1]-m_off[0] );
+            return m_cur;
+        }
+        const array_view<uint32_t>* operator->() const  { return &(**this); }
+        const_iterator& operator++()                    { m_off++; return *this; }
+        bool operator==( const const_iterator& o ) const { return m_off == o.m_off; }
+        bool operator!=( const const_iterator& o ) const { return m_off != o.m_off; }
+    private:
+        const uint32_t* m_off;
+        const uint32_t* m_ind;
+        mutable array_view<uint32_t> m_cur;
+    };
+
+    size_t size() const                     { return offsets.size()-1; }
+    bool empty() const                      { return size() == 0; }
+    const_iterator begin() const            { return const_iterator( offsets.data(),
+                                                                     indices.data() ); }
+    const_iterator end() const              { return const_iterator( offsets.data()+size(),
+                                                                     indices.data() ); }
+
+    array_view<uint32_t> operator[]( size_t i ) const
+    {
+        return array_view<uint32_t>( indices.data()+offsets[i],
+                                     offsets[i+1]-offsets[i] );
+    }
+
+    array_view<uint32_t> at( size_t i ) const
+    {
+        if (i >= size()) throw std::out_of_range("polygon_list::at");
+        return (*this)[i];
+    }
+
+    void reserve( size_t np, size_t ni )
+    {
+        offsets.reserve( np+1 );
+        indices.reserve( ni );
+    }
+
+    void clear()
+    {
+        offsets.assign( 1, 0 );
+        indices.clear();
+    }
+
+    void push_back( const uint32_t* p, size_t n )
+    {
+        indices.insert( indices.end(), p, p+n );
+        offsets.push_back( indices.size() );
+    }
+
+    // Removes the polygons i for which removed[i] is true in one pass; the
+    // remaining polygons keep their order. Returns the number removed.
+    size_t compact( const std::vector<bool>& removed )
+    {
+        size_t np = size(), kept = 0;
+        uint32_t pos = 0;
+        for (size_t i=0; i<np; i++) {
+            uint32_t first = offsets[i], last = offsets[i+1];
+            if ( i < removed.size() && removed[i] ) continue;
+            if ( pos != first )
+                std::copy( indices.begin()+first, indices.begin()+last,
+                           indices.begin()+pos );
+            pos += last - first;
+            offsets[++kept] = pos;
+        }
+        offsets.resize( kept+1 );
+        indices.resize( pos );
+        return np - kept;
+    }
+
+    void shrink_to_fit()
+    {
+        offsets.shrink_to_fit();
+        indices.shrink_to_fit();
+    }
+
+    // Returns the number of bytes allocated for the polygons.
+    size_t bytes() const
+    {
+        return (offsets.capacity() + indices.capacity()) * sizeof(uint32_t);
+    }
+
+    // Flat storage.
+    const std::vector<uint32_t>& get_offsets() const    { return offsets; }
+    const std::vector<uint32_t>& get_indices() const    { return indices; }
+
+    bool operator==( const polygon_list& o ) const
+    {
+        return offsets == o.offsets && indices == o.indices;
+    }
+    bool operator!=( const polygon_list& o ) const      { return !(*this == o); }
+
+private:
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> indices;
+};
+
+typedef polygon_list                polygon_array;
 
 }   // END namespace
 
@@ -64,24 +206,13 @@ class Mesh
 {
 public:
     // Construct Mesh; allocates storage for nv vertices and np polygons.
-    Mesh( int nv=0, int np=0 )
+    Mesh( int nv=0, int np=0 ) : property_rows(0), mixed(false)
     {
         vertices.reserve(nv);
-        polygons.reserve(np);
-        properties.reserve(nv);
+        polygons.reserve(np, 3*np);
         colors.reserve(nv);
     }
 
-    ~Mesh()
-    {
-        vertices.clear();
-        polygons.clear();
-        tris.clear();
-        quads.clear();
-        colors.clear();
-        alt_colors.clear();
-    }
-
     // Add a 3D vertex to the mesh.
     void add_vertex( double x, double y, double z )
     {
@@ -97,36 +228,62 @@ public:
 
 
     // Add a polygon (either triangle or quad) to the mesh.
-    void add_polygon( mesh::polygon& p )
+    void add_polygon( const mesh::polygon& p )
     {
-        polygons.push_back( p );
-        if ( p.size() == 3 ) {
-            tris.push_back( p.at(0) );
-            tris.push_back( p.at(1) );
-            tris.push_back( p.at(2) );
+        if ( p.size() != 3 && !mixed ) {
+            // Until now all polygons were triangles; the triangle indices were
+            // the polygon indices.
+            tris = polygons.get_indices();
+            mixed = true;
         }
-        if ( p.size() == 4 ) {
-            quads.push_back( p.at(0) );
-            quads.push_back( p.at(1) );
-            quads.push_back( p.at(2) );
-            quads.push_back( p.at(3) );
+        polygons.push_back( p.data(), p.size() );
+        if ( mixed && p.size() == 3 )
+            tris.insert( tris.end(), p.begin(), p.end() );
+        if ( p.size() == 4 )
+            quads.insert( quads.end(), p.begin(), p.end() );
+    }
+
+    // Assign all polygons at once. Polygon i has sizes[i] vertices; indices
+    // holds the vertex indices of all polygons back to back.
+    void set_polygons( const std::vector<uint32_t>& sizes,
+                       const std::vector<uint32_t>& indices )
+    {
+        polygons.clear();
+        polygons.reserve( sizes.size(), indices.size() );
+        size_t pos = 0;
+        for ( auto n : sizes ) {
+            polygons.push_back( indices.data()+pos, n );
+            pos += n;
         }
+        update_tris_quads_();
     }
 
-    // Removes items from polygon array.
-    // NOTE: Does not remove the corresponding elements in tris/quads!
-    void remove_polygons( std::vector<uint32_t>& ind )
+    // Removes the polygons with the given indices. Runs in linear time;
+    // triangle and quad indices are rebuilt. Indices out of range are
+    // ignored.
+    void remove_polygons( const std::vector<uint32_t>& ind )
     {
-        std::sort( ind.begin(), ind.end(), std::greater<uint32_t>() );
+        std::vector<bool> removed( polygons.size(), false );
         for (auto i : ind)
-            polygons.erase( polygons.begin()+i );
+            if ( i < removed.size() ) removed[i] = true;
+        remove_polygons( removed );
+    }
+
+    // Removes polygon i if removed[i] is true. Returns the number removed.
+    size_t remove_polygons( const std::vector<bool>& removed )
+    {
+        size_t n = polygons.compact( removed );
+        if ( n ) update_tris_quads_();
+        return n;
     }
 
     // Returns polygons: May contain mixed triangle/quad data.
-    const mesh::polygon_array& get_polygons()           { return polygons; }
+    const mesh::polygon_list& get_polygons()            { return polygons; }
 
-    // Get triangle, quad indices.
-    const std::vector<uint32_t>& get_triangle_indices() { return tris; }
+    // Get triangle, quad indices. For triangle meshes the triangle indices
+    // are the polygon indices and not stored separately.
+    const std::vector<uint32_t>& get_triangle_indices() { return mixed ? tris :
+                                                          polygons.get_indices(); }
     const std::vector<uint32_t>& get_quad_indices()     { return quads; }
 
     // Set color for vertex i.
@@ -138,6 +295,9 @@ public:
             colors.push_back( c );
     }
 
+    // Assign all vertex colors at once.
+    void set_vertex_colors( mesh::color_array& c )  { colors.swap(c); }
+
     // Add secondary/alternative set of vertex colors.
     void set_alt_colors( const mesh::color_array& alt ) { alt_colors = alt; }
 
@@ -149,18 +309,93 @@ public:
         return colors;
     }
 
-    // Set a property for mesh vertices.
-    void set_property( mesh::property& prop )       { properties.push_back(prop); }
-    const mesh::property_array& get_properties()    { return properties; }
+    // Assign all vertex properties at once; column j holds property j for
+    // all vertices.
+    void set_property_columns( std::vector<mesh::property_column>& cols )
+    {
+        properties.swap( cols );
+        property_rows = properties.size() ? properties.at(0).size() : 0;
+    }
+
+    // Returns the number of properties, property j for all vertices.
+    size_t get_property_count()                     { return properties.size(); }
+    const mesh::property_column& get_property_column( size_t j )
+    {
+        return properties.at(j);
+    }
+
+    // Set the properties of the next vertex (one value per property).
+    void set_property( mesh::property& prop )
+    {
+        if ( prop.size() > properties.size() )
+            properties.resize( prop.size(), mesh::property_column(property_rows) );
+        for (size_t j=0; j<properties.size(); j++)
+            properties[j].push_back( j < prop.size() ? prop[j] : 0.0 );
+        property_rows++;
+    }
+
+    // Returns all properties without copying; column j holds property j for
+    // all vertices.
+    const std::vector<mesh::property_column>& get_properties()
+    {
+        return properties;
+    }
+
+    // Release unused capacity.
+    void shrink_to_fit()
+    {
+        vertices.shrink_to_fit();
+        polygons.shrink_to_fit();
+        colors.shrink_to_fit();
+        alt_colors.shrink_to_fit();
+        tris.shrink_to_fit();
+        quads.shrink_to_fit();
+        for (auto& c : properties)
+            c.shrink_to_fit();
+    }
+
+    // Returns the number of bytes held by the mesh.
+    size_t bytes() const
+    {
+        size_t n = sizeof(Mesh) + polygons.bytes();
+        n += vertices.capacity() * sizeof(mesh::vertex);
+        n += (colors.capacity() + alt_colors.capacity()) * sizeof(mesh::vertex_color);
+        n += (tris.capacity() + quads.capacity()) * sizeof(uint32_t);
+        n += properties.capacity() * sizeof(mesh::property_column);
+        for (auto& c : properties)
+            n += c.capacity() * sizeof(float);
+        return n;
+    }
 
 
 private:
+    // Rebuild triangle and quad indices from the polygons.
+    void update_tris_quads_()
+    {
+        tris.clear();
+        quads.clear();
+        mixed = false;
+        for ( auto& p : polygons )
+            if ( p.size() != 3 ) { mixed = true; break; }
+        if ( !mixed ) return;
+
+        for ( auto& p : polygons ) {
+            if ( p.size() == 3 ) tris.insert( tris.end(), p.begin(), p.end() );
+            if ( p.size() == 4 ) quads.insert( quads.end(), p.begin(), p.end() );
+        }
+    }
+
     mesh::vertex_array    vertices;
-    mesh::polygon_array   polygons;
+    mesh::polygon_list    polygons;
     mesh::color_array     colors;
     mesh::color_array     alt_colors;
-    mesh::property_array  properties;
 
+    std::vector<mesh::property_column> properties;  // one column per property
+    size_t property_rows;                           // vertices with properties
+
+    // Triangle and quad indices are only stored separately for meshes that
+    // contain other than triangles.
     std::vector<uint32_t> tris;
     std::vector<uint32_t> quads;
+    bool mixed;
 };
@@ -1,16 +1,21 @@
 #include <cmath>
+#include <ctime>
+#include <algorithm>
 #include <iostream>
 #include <exception>
 #include <tuple>
+#include <map>
 #include <QProcess>
 #include <QTimer>
 #include <QReadWriteLock>
 #include <QCoreApplication>
 #include <QDir>
 #include <QDebug>
+#include <QCryptographicHash>
 
 #include "model.h"
 #include "colormap.h"
+#include "stepcache.h"
 
 
 
@@ -26,6 +31,7 @@ Model::Model() : m_exampleParameters(""),
     retval = 0;
     nIter = 0;
     currentIter = 0;
+    startIter = 0;
     stepSize = 1;
 
     parameters = new Parameters();
@@ -56,7 +62,7 @@ void Model::fill_image( Tooth *tooth, float *img )
     int idx = floor( viewMode / 2.0 );
 
     try {
-        auto data = tooth->get_cell_data().at( idx );
+        auto& data = tooth->get_cell_data().at( idx );
 
         for (uint32_t i=0; i<data.size(); i++) {
             std::string type;
@@ -115,6 +121,53 @@ void Model::setParameters(Parameters *par)
 
 
 
+/**
+ * @brief Returns a key identifying the output of a model run.
+ *
+ * SHA-1 of the model name, the binary, the parameter values and the keywords
+ * sorted by name, the number of iterations and the step size. Keywords for
+ * viewing only and the 'iter' keyword superseded by niter are left out, and
+ * so is the parameters ID.
+ *
+ * @param niter     Number of iterations.
+ * @return          Key, 40 hex digits.
+ */
+std::string Model::getRunKey( int niter )
+{
+    std::map<std::string, std::string> entries;
+    char value[64];
+    for (auto& p : parameters->getParameters()) {
+        snprintf(value, sizeof(value), "%.17g", p.value);
+        entries["p:" + p.name] = value;
+    }
+    for (auto& key : *parameters->getKeywords()) {
+        if (key != PARKEY_VIEWTHRESH && key != PARKEY_VIEWMODE && key != PARKEY_ITER) {
+            entries["k:" + key] = parameters->getKey(key);
+        }
+    }
+
+    // A rebuilt binary gives a different key.
+    QDir qdir( QCoreApplication::applicationDirPath() );
+    qdir.cd(RESOURCES);
+    qdir.cd("bin");
+    QFileInfo bin( qdir.filePath(getBinaryName()) );
+    qint64 modified = bin.exists() ? bin.lastModified().toMSecsSinceEpoch() : 0;
+
+    std::string text = m_modelName + "\n" + modelBin + " "
+                       + std::to_string(bin.size()) + " " + std::to_string(modified)
+                       + "\nniter " + std::to_string(niter)
+                       + "\nstep " + std::to_string(stepSize) + "\n";
+    for (auto& e : entries) {
+        text += e.first + "=" + e.second + "\n";
+    }
+
+    QByteArray hash = QCryptographicHash::hash( QByteArray(text.c_str(), text.size()),
+                                                QCryptographicHash::Sha1 );
+    return hash.toHex().toStdString();
+}
+
+
+
 /**
  * @brief Deletes the temporary folder and everything in it.
  *
@@ -140,7 +193,25 @@ float Model::getProgress()
 {
     if (nIter == 0)
         return 100.0;
-    return (100.0*currentIter/nIter);
+    return (100.0*getIteration()/nIter);
+}
+
+
+
+/**
+ * @brief Returns the estimated time to finish assuming a constant rate of
+ *        iterations.
+ * @param time_start    Model start time.
+ * @return              Time in seconds, -1 if no progress yet.
+ */
+int Model::getRemainingTime( int time_start )
+{
+    int iter = getIteration();
+    int elapsed = time(NULL) - time_start;
+    if (iter <= startIter || elapsed <= 0 || nIter <= 0) {
+        return -1;
+    }
+    return std::max( (int)((double)elapsed*(nIter-iter)/(iter-startIter) + 0.5), 0 );
 }
 
 
@@ -166,7 +237,35 @@ int Model::exportData( const QString run_id, const QString export_folder )
         QString file = files.at(i).fileName();
         QString target = export_folder + "/" + file;
         QFile::remove(target);
-        QFile::copy(file, target);
+        QFile::copy(files.at(i).absoluteFilePath(), target);
+    }
+
+    return 0;
+}
+
+
+
+/**
+ * @brief Writes a model run into a step cache file in the run folder.
+ *
+ * The file is named [run ID].tmstep and is thus exported together with the
+ * model output files.
+ *
+ * @param toothLife     Model run.
+ * @return              0 if success, else -1.
+ */
+int Model::writeStepCache( ToothLife& toothLife )
+{
+    QString run_id = QString::number( toothLife.getID() );
+    QString run_path = systemTempPath + "/" + run_id + "/";
+    QDir qdir;
+    if (!qdir.exists(run_path) && !qdir.mkpath(run_path)) {
+        return -1;
+    }
+
+    QString file = run_path + run_id + STEPCACHE_EXT;
+    if (morphomaker::Write_step_cache( file.toStdString(), toothLife, stepSize )) {
+        return -1;
     }
 
     return 0;
@@ -188,9 +287,8 @@ int Model::runResultParsers( const QString export_folder )
     resources.cd(RESOURCES);
     resources.cd("bin");
 
-    QString old_path = QDir::currentPath();
-    QDir::setCurrent( export_folder );
     QProcess process;
+    process.setWorkingDirectory( export_folder );
 
     for (auto& parser : m_resultParsers) {
         QString cmd = "";
@@ -211,8 +309,6 @@ int Model::runResultParsers( const QString export_folder )
         std::cout << "Results parser: " << cmd.toStdString() << std::endl;
     }
 
-    QDir::setCurrent( old_path );
-
     return 0;
 }
 
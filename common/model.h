@@ -113,6 +113,13 @@ public:
     // Returns '0' if last model run was successfull, else '1' for error.
     int getReturnValue()                   { return retval; }
 
+    // Returns true if the last run reached its last step without errors.
+    bool runCompleted()         { return !retval && getIteration()+stepSize > nIter; }
+
+    // Returns a key identifying the output of a run of niter iterations with
+    // the current parameters and step size.
+    std::string getRunKey( int niter );
+
     // Set model step size for reading/storing results every i iterations.
     void setStepSize( int i )               { stepSize = i; }
     int getStepSize()                       { return stepSize; }
@@ -128,12 +135,35 @@ public:
     // Deletes the temporary folder and everything in it.
     void workDirCleanUp();
 
+    // Returns the number of iterations completed; by default the iteration
+    // of the latest step.
+    virtual int getIteration()              { return currentIter; }
+
     // Returns current model progress percentage.
     float getProgress();
 
+    // Returns the estimated time in s to finish, -1 if unknown.
+    int getRemainingTime( int time_start );
+
+    // Saves the model state at the end of the next run into file, for runs
+    // branched from it; not done if the model doesn't support checkpoints.
+    virtual void setSaveState( const QString& file )    { (void)file; }
+
+    // Starts the next run from a state saved by setSaveState() after
+    // iteration iter, with the current parameters; the steps up to iter must
+    // be in the ToothLife of the run already. Empty file for a full run.
+    virtual void setBranchState( const QString& file, int iter )
+                                                        { (void)file; (void)iter; }
+
+    // Sets the folder of the run folders; init_model() sets it for a run.
+    void setTempPath( const QString& path ) { systemTempPath = path; }
+
     // Copies model output files to user-specified data export folder.
     int exportData( const QString, const QString );
 
+    // Writes a model run into a step cache file in the run folder.
+    int writeStepCache( ToothLife& );
+
     // Executes result parsers on model output at the data export folder.
     int runResultParsers( const QString );
 
@@ -215,6 +245,7 @@ protected:
 
     int nIter;                          // Max. number of iterations.
     int currentIter;                    // Current model iteration.
+    int startIter;                      // Iteration the run started from.
     int stepSize;                       // Step size for storing results.
 
     int renderMode;                     // RENDER_MESH or RENDER_PIXEL.
@@ -52,8 +52,18 @@
 // allowing for 10px center marginal + 12px borders on each side of the windows.
 #define SQUARE_WIN_SIZE 495
 
-// Size of tooth history, i.e. number of ToothLife to be held in memory.
-#define MAX_HISTORY_SIZE 10
+// Keyframe interval of delta-encoded model runs: every n-th step is stored as
+// such, the steps in between as differences to it (see ToothLife).
+#define DELTA_KEYFRAME_INTERVAL 16
+
+// Model runs of more than SPILL_MIN_STEPS steps are paged out to the temp.
+// folder, keeping the SPILL_CACHE_STEPS most recently viewed steps in memory.
+#define SPILL_MIN_STEPS 1000
+#define SPILL_CACHE_STEPS 64
+
+// Memory budget of tooth history in bytes (1 GiB), i.e. how much ToothLife
+// data is held in memory. The newest run is kept even if larger.
+#define MAX_HISTORY_BYTES 1073741824
 
 // Default threshold for concentrations in model view.
 #define DEFAULT_VIEW_THRESH 0.5
@@ -65,6 +75,14 @@
 // Name for the file to store parameter scanning info.
 #define SCAN_LIST "job_parameters.txt"
 
+// Name for the file recording the states of the scan jobs (see JobLedger).
+#define SCAN_LEDGER "scan_ledger.txt"
+
+// Store of completed runs in the user cache folder (see ResultStore), and its
+// size limit in bytes (4 GiB); 0 disables the store.
+#define RESULT_STORE_DIR "results"
+#define RESULT_STORE_BYTES 4294967296LL
+
 // Interface window width at start.
 #define MAIN_WINDOW_WIDTH 1024
 
@@ -0,0 +1,32 @@
+#pragma once
+
+/**
+ * @class OutputParser
+ * @brief Interface of the in-process model output parsers.
+ *
+ * An output parser (<OutputParser> in the model interface) is looked up first
+ * among the built-in parsers, then as a plugin library in Resources/bin
+ * exporting PARSER_LOAD_NAME. Only if neither is found it is run as an
+ * executable on the output files.
+ *
+ * In-process parsers transform the Tooth object of a step directly instead of
+ * rewriting the output files. The object is passed along the parsers in the
+ * order listed; if it is still empty after them, the output files are read
+ * as usual. Parsers are shared by all models, which may run concurrently, so
+ * parse() must be reentrant.
+ */
+
+#include <string>
+#include "tooth.h"
+
+
+
+class OutputParser
+{
+public:
+    virtual ~OutputParser() {}
+
+    // Parses output file fname of a step into tooth; the other output files
+    // of the step are in the same folder. Returns 0 if success, else -1.
+    virtual int parse( const std::string& fname, Tooth& tooth ) = 0;
+};
@@ -5,11 +5,17 @@
  */
 
 #include <fstream>
-#include <sstream>
 #include <iostream>
-#include <QString>
-#include <QStringList>
-#include <QDir>
+#include <cstring>
+#include <cctype>
+#include <algorithm>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 #include "tooth.h"
 #include "mesh.h"
@@ -42,127 +48,740 @@ void eat_comments_(std::istream& in) {
 
 
 /**
- * @brief Read vertex properties in PLY files.
+ * @brief PLY data types and their sizes in bytes.
+ */
+enum { PLY_INVALID, PLY_INT8, PLY_UINT8, PLY_INT16, PLY_UINT16, PLY_INT32,
+       PLY_UINT32, PLY_FLOAT32, PLY_FLOAT64 };
+
+const int ply_type_size_[] = { 0, 1, 1, 2, 2, 4, 4, 4, 8 };
+
+
+/**
+ * @brief PLY data storage formats.
+ */
+enum { PLY_ASCII, PLY_BINARY_LE, PLY_BINARY_BE };
+
+
+/**
+ * @brief PLY element property as declared in the file header.
+ */
+struct ply_property_ {
+    std::string name;
+    int type;           // value type, or list index type for list properties
+    int count_type;     // list count type; PLY_INVALID if not a list
+};
+
+
+/**
+ * @brief Converts a PLY type name into a type id.
+ * @param s     Type name, e.g. 'float', 'uchar', 'int32'.
+ * @return      Type id, PLY_INVALID if not recognized.
+ */
+int ply_type_(const std::string& s)
+{
+    if (!s.compare("char") || !s.compare("int8"))       return PLY_INT8;
+    if (!s.compare("uchar") || !s.compare("uint8"))     return PLY_UINT8;
+    if (!s.compare("short") || !s.compare("int16"))     return PLY_INT16;
+    if (!s.compare("ushort") || !s.compare("uint16"))   return PLY_UINT16;
+    if (!s.compare("int") || !s.compare("int32"))       return PLY_INT32;
+    if (!s.compare("uint") || !s.compare("uint32"))     return PLY_UINT32;
+    if (!s.compare("float") || !s.compare("float32"))   return PLY_FLOAT32;
+    if (!s.compare("double") || !s.compare("float64"))  return PLY_FLOAT64;
+    return PLY_INVALID;
+}
+
+
+/**
+ * @brief Returns true if the host stores numbers in little endian byte order.
+ */
+bool host_little_endian_()
+{
+    const uint16_t i = 1;
+    char c;
+    memcpy(&c, &i, 1);
+    return c == 1;
+}
+
+
+/**
+ * @brief Decodes a single binary PLY value.
+ * @param p         Pointer to the first byte of the value.
+ * @param type      Value type.
+ * @param swap      If true, reverses the byte order before decoding.
+ * @return          Value.
+ */
+double ply_value_(const char* p, int type, bool swap)
+{
+    char b[8];
+    int n = ply_type_size_[type];
+    for (int i=0; i<n; i++) {
+        b[i] = swap ? p[n-1-i] : p[i];
+    }
+
+    switch (type) {
+    case PLY_INT8:      { int8_t v;   memcpy(&v, b, 1); return v; }
+    case PLY_UINT8:     { uint8_t v;  memcpy(&v, b, 1); return v; }
+    case PLY_INT16:     { int16_t v;  memcpy(&v, b, 2); return v; }
+    case PLY_UINT16:    { uint16_t v; memcpy(&v, b, 2); return v; }
+    case PLY_INT32:     { int32_t v;  memcpy(&v, b, 4); return v; }
+    case PLY_UINT32:    { uint32_t v; memcpy(&v, b, 4); return v; }
+    case PLY_FLOAT32:   { float v;    memcpy(&v, b, 4); return v; }
+    case PLY_FLOAT64:   { double v;   memcpy(&v, b, 8); return v; }
+    default:            return 0.0;
+    }
+}
+
+
+/**
+ * @brief Read element properties in PLY files.
  * @param in        Input stream.
- * @param n_dim     Number of dimensions detected.
- * @param n_colors  Number of colors detected.
+ * @param props     Properties detected, in the order of declaration.
  */
-void read_ply_vertex_(std::istream& in, int& n_dim, int& n_colors)
+void read_ply_properties_(std::istream& in, std::vector<ply_property_>& props)
 {
     std::string s[3] = {""};
     std::string trash;
-    n_dim = 0;
-    n_colors = 0;
 
     while (true) {
         if (!in.good()) return;
         int pos = in.tellg();
         eat_comments_(in);
-        in >> s[0]; in >> s[1]; in >> s[2];
+        in >> s[0];
+        if (s[0].compare("property")) {
+            in.clear();
+            in.seekg(pos, std::ios_base::beg);
+            break;
+        }
+        in >> s[1]; in >> s[2];
+
+        ply_property_ prop = { s[2], ply_type_(s[1]), PLY_INVALID };
+        if (!s[1].compare("list")) {
+            // property list [count type] [index type] [name]
+            prop.count_type = ply_type_(s[2]);
+            in >> s[1]; in >> s[2];
+            prop.type = ply_type_(s[1]);
+            prop.name = s[2];
+        }
         std::getline(in, trash);
-        if (!s[0].compare("property") && (!s[1].compare("float") || !s[1].compare("double"))) {
-            if (!s[2].compare("x") || !s[2].compare("y") || !s[2].compare("z")) {
+        props.push_back(prop);
+    }
+}
+
+
+/**
+ * @brief Read vertex properties in PLY files.
+ * @param props     Vertex properties.
+ * @param n_dim     Number of dimensions detected.
+ * @param n_colors  Number of colors detected.
+ */
+void count_ply_vertex_(const std::vector<ply_property_>& props, int& n_dim,
+                       int& n_colors)
+{
+    n_dim = 0;
+    n_colors = 0;
+
+    for (auto& p : props) {
+        if (p.type == PLY_FLOAT32 || p.type == PLY_FLOAT64) {
+            if (!p.name.compare("x") || !p.name.compare("y") || !p.name.compare("z")) {
                 n_dim = n_dim+1;
             }
         }
-        else if (!s[0].compare("property") && (!s[1].compare("uchar"))) {
-            if (!s[2].compare("red") || !s[2].compare("green") || !s[2].compare("blue") ||
-                !s[2].compare("alpha")) {
+        else if (p.type == PLY_UINT8) {
+            if (!p.name.compare("red") || !p.name.compare("green") ||
+                !p.name.compare("blue") || !p.name.compare("alpha")) {
                 n_colors = n_colors+1;
             }
         }
-        else {
-            in.seekg(pos, std::ios_base::beg);
-            break;
-        }
     }
 }
 
 
 /**
- * @brief Read concentration properties in PLY files.
- * @param in        Input stream.
- * @param list      List of detected morphogen names.
+ * @brief Returns the least number of bytes the data of n elements can take.
+ *
+ * In binary files a list takes at least its count, in ascii files every
+ * property at least one digit and a separator.
+ *
+ * @param props     Element properties.
+ * @param n         Number of elements.
+ * @param format    PLY_ASCII, PLY_BINARY_LE or PLY_BINARY_BE.
+ * @return          Minimum size in bytes.
  */
-void read_ply_concentrations_(std::istream& in, std::vector<std::string>& list)
+uint64_t ply_min_bytes_(const std::vector<ply_property_>& props, int n,
+                        int format)
 {
-    std::string s[3] = {""};
-    std::string trash;
+    uint64_t row = 0;
+    for (auto& p : props) {
+        if (format == PLY_ASCII)                row += 2;
+        else if (p.count_type != PLY_INVALID)   row += ply_type_size_[p.count_type];
+        else                                    row += ply_type_size_[p.type];
+    }
+    return row * n;
+}
 
-    while (true) {
+
+/**
+ * @brief Reads the binary part of a PLY file into mesh.
+ *
+ * If the vertex element consists of x, y, z floats only and the file byte
+ * order matches the host, the vertex block is read directly into the mesh
+ * vertex array. Otherwise the vertex block is read in one go and decoded.
+ * Faces and concentrations are read with a single read() from the remainder
+ * of the file.
+ *
+ * @param in            Input stream positioned after 'end_header'.
+ * @param format        PLY_BINARY_LE or PLY_BINARY_BE.
+ * @param n_vert        Number of vertices.
+ * @param n_face        Number of faces.
+ * @param vert_props    Vertex element properties.
+ * @param face_props    Face element properties.
+ * @param conc_props    Concentrations element properties.
+ * @param mesh          Mesh object for storing the data.
+ * @return              EXIT_SUCCESS, EXIT_FAILURE.
+ */
+int read_ply_binary_(std::istream& in, int format, int n_vert, int n_face,
+                     const std::vector<ply_property_>& vert_props,
+                     const std::vector<ply_property_>& face_props,
+                     const std::vector<ply_property_>& conc_props,
+                     Mesh& mesh)
+{
+    bool swap = (format == PLY_BINARY_LE) != host_little_endian_();
+
+    // Vertex layout.
+    size_t stride = 0;
+    std::vector<size_t> offsets;
+    for (auto& p : vert_props) {
+        if (p.type == PLY_INVALID || p.count_type != PLY_INVALID) {
+            std::cerr << "Unsupported vertex property '" << p.name
+                      << "'. Aborting." << std::endl;
+            return EXIT_FAILURE;
+        }
+        offsets.push_back(stride);
+        stride += ply_type_size_[p.type];
+    }
+
+    mesh::vertex_array vertices( n_vert );
+    mesh::color_array colors( n_vert, {0.0, 0.0, 0.0, 1.0} );
+
+    bool xyz_only = vert_props.size() == 3 && !swap && sizeof(mesh::vertex) == 12;
+    for (size_t i=0; xyz_only && i<3; i++) {
+        const char* name[] = { "x", "y", "z" };
+        xyz_only = vert_props.at(i).type == PLY_FLOAT32 &&
+                   !vert_props.at(i).name.compare(name[i]);
+    }
+
+    if (xyz_only) {
+        // Bulk path: file layout equals mesh::vertex.
+        in.read( reinterpret_cast<char*>(vertices.data()), n_vert*stride );
+        if (!in.good()) return EXIT_FAILURE;
+    }
+    else {
+        std::vector<char> block( n_vert*stride );
+        in.read( block.data(), block.size() );
+        if (!in.good()) return EXIT_FAILURE;
+
+        for (int i=0; i<n_vert; i++) {
+            const char* row = block.data() + i*stride;
+            for (size_t j=0; j<vert_props.size(); j++) {
+                const ply_property_& p = vert_props.at(j);
+                float v = ply_value_( row+offsets.at(j), p.type, swap );
+                if (p.type == PLY_UINT8) v = v/255.0;
+
+                if      (!p.name.compare("x"))      vertices[i].x = v;
+                else if (!p.name.compare("y"))      vertices[i].y = v;
+                else if (!p.name.compare("z"))      vertices[i].z = v;
+                else if (p.type != PLY_UINT8)       continue;
+                else if (!p.name.compare("red"))    colors[i].r = v;
+                else if (!p.name.compare("green"))  colors[i].g = v;
+                else if (!p.name.compare("blue"))   colors[i].b = v;
+                else if (!p.name.compare("alpha"))  colors[i].a = v;
+            }
+        }
+    }
+
+    mesh.set_vectices( vertices );
+    mesh.set_vertex_colors( colors );
+
+    // Store a copy of current object colors to avoid losing them later when
+    // manipulating vertex colors from the interface.
+    mesh.set_alt_colors( mesh.get_vertex_colors() );
+
+    // Faces and concentrations: read the rest of the file at once.
+    std::streampos pos = in.tellg();
+    in.seekg(0, std::ios::end);
+    size_t size = in.tellg() - pos;
+    in.seekg(pos);
+    std::vector<char> data( size );
+    in.read( data.data(), size );
+    const char* p = data.data();
+    const char* end = p + size;
+
+    std::vector<uint32_t> polygon;
+    for (int i=0; i<n_face; i++) {
+        for (auto& fp : face_props) {
+            if (fp.count_type == PLY_INVALID) {     // Scalar face property, skip.
+                if (p + ply_type_size_[fp.type] > end) return EXIT_FAILURE;
+                p += ply_type_size_[fp.type];
+                continue;
+            }
+            if (p + ply_type_size_[fp.count_type] > end) return EXIT_FAILURE;
+            uint32_t n = ply_value_( p, fp.count_type, swap );
+            p += ply_type_size_[fp.count_type];
+            if (p + n*ply_type_size_[fp.type] > end) return EXIT_FAILURE;
+
+            if (fp.name.compare("vertex_indices") && fp.name.compare("vertex_index")) {
+                p += n*ply_type_size_[fp.type];
+                continue;
+            }
+            polygon.resize(n);
+            for (uint32_t j=0; j<n; j++) {
+                polygon[j] = ply_value_( p, fp.type, swap );
+                p += ply_type_size_[fp.type];
+            }
+            mesh.add_polygon( polygon );
+        }
+    }
+
+    if (conc_props.size() == 0) {
+        return EXIT_SUCCESS;
+    }
+
+    // Concentrations; the last one defines the vertex color as in ASCII files.
+    size_t conc_stride = 0;
+    for (auto& cp : conc_props) {
+        conc_stride += ply_type_size_[cp.type];
+    }
+    if (p + n_vert*conc_stride > end) return EXIT_FAILURE;
+
+    std::vector<mesh::property_column> columns( conc_props.size(),
+                                                mesh::property_column(n_vert) );
+    for (int i=0; i<n_vert; i++) {
+        mesh::vertex_color c = { 0.0, 0.0, 0.0, 1.0 };
+        for (size_t j=0; j<conc_props.size(); j++) {
+            double v = ply_value_( p, conc_props.at(j).type, swap );
+            p += ply_type_size_[conc_props.at(j).type];
+            if (v > 1.0) {       // Presume the values are in scale 0-255.
+                v = v / 255.0;
+            }
+            columns[j][i] = v;
+            c.r = v; c.g = v; c.b = v;
+        }
+        mesh.set_vertex_color( i, c );
+    }
+    mesh.set_property_columns( columns );
+
+    return EXIT_SUCCESS;
+}
+
+
+/**
+ * @brief Read-only view of a whole file.
+ *
+ * The file is memory-mapped where available, otherwise read into memory with
+ * a single read. The data is not null-terminated; use end() for bounds.
+ */
+class mapped_file_
+{
+public:
+    mapped_file_( const std::string& fname ) : m_data(nullptr), m_size(0)
+    {
+#if defined(__linux__) || defined(__APPLE__)
+        int fd = open( fname.c_str(), O_RDONLY );
+        if (fd < 0) return;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* p = mmap( nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+            if (p != MAP_FAILED) {
+                m_data = static_cast<const char*>(p);
+                m_size = st.st_size;
+            }
+        }
+        close(fd);
+#else
+        std::ifstream in( fname, std::ios::in | std::ios::binary );
         if (!in.good()) return;
-        int pos = in.tellg();
-        eat_comments_(in);
-        in >> s[0]; in >> s[1]; in >> s[2];
-        std::getline(in, trash);
-        if (!s[0].compare("property") && (!s[1].compare("float") || !s[1].compare("double"))) {
-            list.push_back(s[2]);
+        in.seekg(0, std::ios::end);
+        m_buffer.resize( in.tellg() );
+        in.seekg(0, std::ios::beg);
+        in.read( m_buffer.data(), m_buffer.size() );
+        m_data = m_buffer.data();
+        m_size = m_buffer.size();
+#endif
+    }
+
+    ~mapped_file_()
+    {
+#if defined(__linux__) || defined(__APPLE__)
+        if (m_data != nullptr) {
+            munmap( const_cast<char*>(m_data), m_size );
         }
-        else {
-            in.seekg(pos, std::ios_base::beg);
-            break;
+#endif
+    }
+
+    bool good() const           { return m_data != nullptr; }
+    const char* begin() const   { return m_data; }
+    const char* end() const     { return m_data + m_size; }
+    size_t size() const         { return m_size; }
+
+private:
+    mapped_file_( const mapped_file_& );
+    mapped_file_& operator=( const mapped_file_& );
+
+    const char* m_data;
+    size_t m_size;
+#if !defined(__linux__) && !defined(__APPLE__)
+    std::vector<char> m_buffer;
+#endif
+};
+
+
+/**
+ * @brief Skips spaces and tabs, stops at newline.
+ */
+inline const char* skip_blanks_( const char* p, const char* end )
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+    return p;
+}
+
+
+/**
+ * @brief Skips to the beginning of the next line.
+ */
+inline const char* next_line_( const char* p, const char* end )
+{
+    while (p < end && *p != '\n') p++;
+    return p < end ? p+1 : end;
+}
+
+
+/**
+ * @brief Skips whitespace, empty lines and comment lines ('#' or 'comment').
+ */
+const char* skip_comments_( const char* p, const char* end )
+{
+    while (p < end) {
+        while (p < end && isspace((unsigned char)*p)) p++;
+        if (p < end && (*p == '#' ||
+                        (end-p >= 7 && !strncmp(p, "comment", 7)))) {
+            p = next_line_(p, end);
+            continue;
         }
+        break;
     }
+    return p;
 }
 
+
+/**
+ * @brief Scans an unsigned integer.
+ * @param p         Current position; updated past the number if successful.
+ * @param end       End of data.
+ * @param v         Result.
+ * @return          False if no number at p.
+ */
+inline bool scan_uint_( const char*& p, const char* end, uint32_t& v )
+{
+    const char* q = skip_blanks_(p, end);
+    if (q >= end || *q < '0' || *q > '9') return false;
+    uint32_t r = 0;
+    while (q < end && *q >= '0' && *q <= '9') {
+        r = r*10 + (*q - '0');
+        q++;
+    }
+    v = r;
+    p = q;
+    return true;
 }
 
 
+/**
+ * @brief Scans a floating point number of form [-+]ddd[.ddd][e[-+]ddd].
+ *
+ * Up to 19 significant digits are taken into account, which is more than
+ * enough for the float precision of the mesh data.
+ *
+ * @param p         Current position; updated past the number if successful.
+ * @param end       End of data.
+ * @param v         Result.
+ * @return          False if no number at p.
+ */
+bool scan_float_( const char*& p, const char* end, float& v )
+{
+    static const double pow10[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10,
+        1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    const char* q = skip_blanks_(p, end);
+    bool neg = false;
+    if (q < end && (*q == '-' || *q == '+')) {
+        neg = (*q == '-');
+        q++;
+    }
+
+    uint64_t mant = 0;
+    int digits = 0, exp10 = 0;
+    bool any = false;
+
+    while (q < end && *q >= '0' && *q <= '9') {
+        if (digits < 19) { mant = mant*10 + (*q - '0'); if (mant) digits++; }
+        else exp10++;
+        any = true;
+        q++;
+    }
+    if (q < end && *q == '.') {
+        q++;
+        while (q < end && *q >= '0' && *q <= '9') {
+            if (digits < 19) { mant = mant*10 + (*q - '0'); if (mant) digits++; exp10--; }
+            any = true;
+            q++;
+        }
+    }
+    if (!any) return false;
+
+    if (q < end && (*q == 'e' || *q == 'E')) {
+        const char* e = q+1;
+        bool eneg = false;
+        if (e < end && (*e == '-' || *e == '+')) {
+            eneg = (*e == '-');
+            e++;
+        }
+        if (e < end && *e >= '0' && *e <= '9') {
+            int x = 0;
+            while (e < end && *e >= '0' && *e <= '9') {
+                if (x < 10000) x = x*10 + (*e - '0');
+                e++;
+            }
+            exp10 += eneg ? -x : x;
+            q = e;
+        }
+    }
+
+    double d = (double)mant;
+    while (exp10 > 22)  { d *= 1e22; exp10 -= 22; }
+    while (exp10 < -22) { d /= 1e22; exp10 += 22; }
+    d = exp10 >= 0 ? d*pow10[exp10] : d/pow10[-exp10];
+
+    v = (float)(neg ? -d : d);
+    p = q;
+    return true;
+}
+
 
 /**
- * @brief Read MxN matrix from binary file.
+ * @brief Skips all whitespace including line breaks.
+ */
+inline const char* skip_space_( const char* p, const char* end )
+{
+    while (p < end && isspace((unsigned char)*p)) p++;
+    return p;
+}
+
+
+/**
+ * @brief Skips n whitespace separated tokens without interpreting them.
+ * @return          Position after the last token, or nullptr if the data ended
+ *                  before n tokens were found.
+ */
+const char* skip_tokens_( const char* p, const char* end, size_t n )
+{
+    for (size_t i=0; i<n; i++) {
+        p = skip_space_(p, end);
+        if (p >= end) return nullptr;
+        while (p < end && !isspace((unsigned char)*p)) p++;
+    }
+    return p;
+}
+
+
+/**
+ * @brief Skips n fixed-width fields written line by line (Fortran format),
+ *        counting the fields of each line by its length; adjacent wide values
+ *        may have no space in between.
+ * @param width     Field width.
+ * @return          Start of the line after the last field, or nullptr if the
+ *                  lines don't hold exactly n fields.
+ */
+const char* skip_fields_( const char* p, const char* end, size_t n, size_t width )
+{
+    size_t count = 0;
+    while (count < n && p < end) {
+        const char* eol = p;
+        while (eol < end && *eol != '\n') eol++;
+        const char* last = eol;
+        while (last > p && isspace((unsigned char)last[-1])) last--;
+        count += (last - p + width - 1) / width;
+        p = eol < end ? eol+1 : end;
+    }
+    return count == n ? p : nullptr;
+}
+
+
+/**
+ * @brief Reads a Humppa .dad section header "[value] [ncels]".
+ * @return          False if the header is missing or the cell count differs.
+ */
+bool scan_dad_header_( const char*& p, const char* end, uint32_t& value,
+                       uint32_t ncels )
+{
+    uint32_t n = 0;
+    p = skip_space_(p, end);
+    if (!scan_uint_(p, end, value)) return false;
+    if (!scan_uint_(p, end, n) || n != ncels) return false;
+    p = next_line_(p, end);
+    return true;
+}
+
+
+/**
+ * @brief Reads the header and the vertex data of an OFF file.
+ * @param p         Start of data; on return the start of the polygon data.
+ * @param end       End of data.
+ * @param fname     File name for error messages.
+ * @param vertices  Vertex coordinates.
+ * @param colors    Vertex colors.
+ * @param nfaces    Number of polygons given in the header.
+ * @return          EXIT_SUCCESS, EXIT_FAILURE.
+ */
+int read_off_vertices_( const char*& p, const char* end, const std::string& fname,
+                        mesh::vertex_array& vertices, mesh::color_array& colors,
+                        uint32_t& nfaces )
+{
+    // Must find 'OFF' or 'COFF' tag on the first non-comment line.
+    p = skip_comments_(p, end);
+    if (!(end-p >= 3 && !strncmp(p, "OFF", 3)) &&
+        !(end-p >= 4 && !strncmp(p, "COFF", 4))) {
+        std::cerr << "Error: Invalid header in " << fname << ". Expecting "
+                  << "to find 'OFF' or 'COFF'." << std::endl;
+        return EXIT_FAILURE;
+    }
+    p = next_line_(p, end);
+
+    // The next line should contain the vertices, faces counts.
+    p = skip_comments_(p, end);
+    uint32_t nvertices=0, nedges=0;
+    if (!scan_uint_(p, end, nvertices) || !scan_uint_(p, end, nfaces)) {
+        std::cerr << "Error: Invalid element counts in " << fname << "."
+                  << std::endl;
+        return EXIT_FAILURE;
+    }
+    scan_uint_(p, end, nedges);
+    p = next_line_(p, end);
+
+    // A vertex line takes at least 6 bytes ("0 0 0\n"), a polygon line at
+    // least 8 ("3 0 1 2\n"; the last one may lack the newline). Larger counts
+    // are corrupt; don't allocate for them.
+    if (6*uint64_t(nvertices) + 8*uint64_t(nfaces) > uint64_t(end-p) + 1) {
+        std::cerr << "Error: Element counts in " << fname << " exceed the file "
+                  << "size." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // Maximum number of variables. For now, either 3 vertices,
+    // or 3 vertices + 4 colors.
+    const int maxVar = 7;
+    float v[maxVar] = {0.0};
+
+    vertices.resize( nvertices );
+    colors.resize( nvertices );
+
+    // Read nvertices lines of vertex data.
+    for (uint32_t i=0; i<nvertices; i++) {
+        p = skip_comments_(p, end);
+        if (p >= end) return EXIT_FAILURE;
+
+        // Read node coordinates and potentially vertex color information.
+        int j = 0;
+        while (j < maxVar && scan_float_(p, end, v[j])) {
+            j++;
+        }
+        if (j < 3) return EXIT_FAILURE;
+        p = next_line_(p, end);
+
+        vertices[i] = { v[0], v[1], v[2] };
+        colors[i] = { 0.0, 0.0, 0.0, 0.0 };
+        if ( j == 7 ) {     // Only acccept RGBA colors, hence must be 7 cols.
+            colors[i] = { v[3], v[4], v[5], v[6] };
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+
+}
+
+
+
+/**
+ * @brief Read MxN matrices from binary file.
+ *
+ * The file consists of one or more matrices stored back to back, each given
+ * as two 4-byte integers M, N followed by M*N 4-byte floats. Each matrix is
+ * read directly into its own cell data vector, which is then moved to tooth.
+ * Trailing data that is not a complete matrix of the same dimensions as the
+ * first is ignored.
  *
  * Note: We assume rather strictly that integers are of size 4 bytes and
  * floats 4 bytes.
  *
- * TODO:
- * - Add support for multiple data files.
- *
  * @param fname     File name.
  * @param tooth     Tooth object to store the data.
  * @return          EXIT_SUCCESS, EXIT_FAILURE.
  */
 int morphomaker::Read_BIN_matrix( const std::string& fname, Tooth& tooth )
 {
-    std::ifstream in(fname);
-    in.unsetf(std::ios::skipws);
+    std::ifstream in( fname, std::ios::in | std::ios::binary );
+    if (!in.good()) {
+        return EXIT_FAILURE;
+    }
 
     // Test if there's something to read.
-    // First 8 bits code the matrix dimensions, followed by the data.
+    // First 8 bytes code the matrix dimensions, followed by the data.
     in.seekg(0, std::ios::end);
-    int size = in.tellg();
+    uint64_t size = in.tellg();
     if (size <= 8) {
         return EXIT_FAILURE;
     }
     in.seekg(0, std::ios::beg);
 
-    // Read matrix dimensions.
-    uint32_t m, n;
-    char bytes[4];
-    in.read(bytes, 4);
-    memcpy(&m, bytes, 4);
-    in.read(bytes, 4);
-    memcpy(&n, bytes, 4);
+    std::vector<std::vector<float>> matrices;
+    uint32_t m0 = 0, n0 = 0;
+    uint64_t pos = 0;
 
-    if ((uint32_t)size < m*n*4 + 8) {       // Incomplete data file.
-        return EXIT_FAILURE;
-    }
+    while (pos < size) {
+        // Read matrix dimensions.
+        uint32_t dim[2];
+        if (size - pos < 8 || !in.read( reinterpret_cast<char*>(dim), 8 )) {
+            break;
+        }
+        uint32_t m = dim[0], n = dim[1];
+        uint64_t bytes = uint64_t(m) * n * sizeof(float);
 
-    // Read the actual data as chars.
-    std::vector<char> vec;
-    vec.reserve( size - 8 );
-    vec.insert( vec.begin(),
-                std::istream_iterator<char>(in),
-                std::istream_iterator<char>() );
+        if (m == 0 || n == 0 || bytes > size - pos - 8 ||
+            (matrices.size() && (m != m0 || n != n0))) {
+            break;
+        }
+        m0 = m;
+        n0 = n;
 
-    // Converting to float vector and uploading.
-    // TODO: Can this be done more efficiently?
-    float* floats = reinterpret_cast<float*>( &vec[0] );
-    std::vector<float> data;
-    data.assign( floats, floats + m*n );
+        // Read the data straight into the final storage.
+        std::vector<float> data( uint64_t(m) * n );
+        if (!in.read( reinterpret_cast<char*>(data.data()), bytes )) {
+            return EXIT_FAILURE;
+        }
+        matrices.push_back( std::move(data) );
+        pos += 8 + bytes;
+    }
+    if (matrices.empty()) {     // Incomplete data file.
+        return EXIT_FAILURE;
+    }
 
-    tooth.set_domain_dim( m, n );
-    tooth.add_cell_data( data );
+    tooth.set_domain_dim( m0, n0 );
+    for (auto& data : matrices) {
+        tooth.add_cell_data( std::move(data) );
+    }
 
     return EXIT_SUCCESS;
 }
@@ -170,14 +789,16 @@ int morphomaker::Read_BIN_matrix( const std::string& fname, Tooth& tooth )
 
 
 /**
- * @brief Read object data in OFF file format.
+ * @brief Read object data in PLY file format.
+ * - Supports ascii, binary_little_endian and binary_big_endian formats.
  * - Detects the number of dimensions, colors (RGB or RGBA supported).
  * - Polygon data optional.
  * - Morphogen concentrations optional.
- * - Comments accepted anywhere.
+ * - Comments accepted anywhere in the header (and in ascii data).
  *
  * Limitations:
  * - Elements must be followed by correct properties.
+ * - Elements are expected in order vertex, face, concentrations.
  * - No support for fancy elements/properties.
  * - Not much fault tolerance in general.
  *
@@ -187,7 +808,7 @@ int morphomaker::Read_BIN_matrix( const std::string& fname, Tooth& tooth )
  */
 int morphomaker::Read_PLY_file(const std::string& fname, Tooth& tooth)
 {
-    std::ifstream in(fname);
+    std::ifstream in(fname, std::ios::in | std::ios::binary);
     std::string s[3] = {""};
     std::string trash;
 
@@ -204,9 +825,13 @@ int morphomaker::Read_PLY_file(const std::string& fname, Tooth& tooth)
     eat_comments_(in);
     in >> s[0]; in >> s[1]; in >> s[2];
     std::getline(in, trash);
-    if (s[0].compare("format") || s[1].compare("ascii") || atoi(s[2].c_str())!=1.0) {
-        std::cerr << "Unknown format \"" << s[1] << "\". Only ascii supported. Aborting."
-                  << std::endl;
+
+    int format = -1;
+    if (!s[1].compare("ascii"))                 format = PLY_ASCII;
+    if (!s[1].compare("binary_little_endian"))  format = PLY_BINARY_LE;
+    if (!s[1].compare("binary_big_endian"))     format = PLY_BINARY_BE;
+    if (s[0].compare("format") || format < 0 || atof(s[2].c_str())!=1.0) {
+        std::cerr << "Unknown format \"" << s[1] << "\". Aborting." << std::endl;
         return EXIT_FAILURE;
     }
 
@@ -214,12 +839,15 @@ int morphomaker::Read_PLY_file(const std::string& fname, Tooth& tooth)
     int n_vert=0, n_face=0;
     int n_dim=0, n_colors=0;
     std::vector<std::string> morphogens;
+    std::vector<ply_property_> vert_props, face_props, conc_props;
 
     while (true) {
         if (!in.good()) return EXIT_FAILURE;
         eat_comments_(in);
         in >> s[0];
         if (!s[0].compare("end_header")) {
+            // Binary data starts right after the end of this line.
+            std::getline(in, trash);
             break;
         }
         in >> s[1]; in >> s[2];
@@ -228,13 +856,12 @@ int morphomaker::Read_PLY_file(const std::string& fname, Tooth& tooth)
         if (!s[0].compare("element")) {
             if (!s[1].compare("vertex")) {
                 n_vert = atoi(s[2].c_str());
-                read_ply_vertex_(in, n_dim, n_colors);
+                read_ply_properties_(in, vert_props);
+                count_ply_vertex_(vert_props, n_dim, n_colors);
             }
             if (!s[1].compare("face")) {
                 n_face = atoi(s[2].c_str());
-                // The next line should declare the vertex_indices, not interested.
-                eat_comments_(in);
-                std::getline(in, trash);
+                read_ply_properties_(in, face_props);
             }
             if (!s[1].compare("concentrations")) {
                 // This must equal to n_vert.
@@ -242,15 +869,52 @@ int morphomaker::Read_PLY_file(const std::string& fname, Tooth& tooth)
                     std::cerr << "Invalid number of concentrations. Aborting." << std::endl;
                     return EXIT_FAILURE;
                 }
-                read_ply_concentrations_(in, morphogens);
+                read_ply_properties_(in, conc_props);
+                for (auto& p : conc_props) {
+                    if (p.type == PLY_FLOAT32 || p.type == PLY_FLOAT64) {
+                        morphogens.push_back(p.name);
+                    }
+                }
             }
         }
         else {
         }
     }
 
+    if (n_vert < 0 || n_face < 0) {
+        std::cerr << "Error: Invalid element counts in " << fname << "."
+                  << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // Reject counts the rest of the file can't hold before allocating for them.
+    std::streampos start = in.tellg();
+    in.seekg(0, std::ios::end);
+    uint64_t remaining = in.tellg() - start;
+    in.seekg(start);
+    if (ply_min_bytes_(vert_props, n_vert, format) +
+        ply_min_bytes_(face_props, n_face, format) +
+        ply_min_bytes_(conc_props, n_vert, format) > remaining + 1) {
+        std::cerr << "Error: Element counts in " << fname << " exceed the file "
+                  << "size." << std::endl;
+        return EXIT_FAILURE;
+    }
+
     Mesh mesh( n_vert, n_face );
 
+    if (format != PLY_ASCII) {
+        if (morphogens.size() != conc_props.size()) {
+            std::cerr << "Unsupported concentration type. Aborting." << std::endl;
+            return EXIT_FAILURE;
+        }
+        if (read_ply_binary_( in, format, n_vert, n_face, vert_props,
+                              face_props, conc_props, mesh )) {
+            return EXIT_FAILURE;
+        }
+        tooth.add_mesh( mesh );
+        return EXIT_SUCCESS;
+    }
+
     // Read n_dim vertices + n_colors colors per line.
     // NOTE: Unrecognised entries ignored.
     float p[maxVar] = {0.0};
@@ -268,7 +932,7 @@ int morphomaker::Read_PLY_file(const std::string& fname, Tooth& tooth)
         }
         std::getline(in, trash);
 
-        mesh::vertex_color color;
+        mesh::vertex_color color = { 0.0, 0.0, 0.0, 1.0 };
         if ( n_colors >= 3 ) {
             color.r = p[n_dim];
             color.g = p[n_dim+1];
@@ -305,9 +969,10 @@ int morphomaker::Read_PLY_file(const std::string& fname, Tooth& tooth)
     }
 
     // Concentrations, if present.
+    std::vector<mesh::property_column> columns( morphogens.size(),
+                                                mesh::property_column(n_vert) );
     for (i=0; i<n_vert; i++) {
         if (!in.good()) return EXIT_FAILURE;
-        mesh::property prop;
 
         for (j=0; j<(int)morphogens.size(); j++) {
             if (!in.good()) return EXIT_FAILURE;
@@ -318,11 +983,11 @@ int morphomaker::Read_PLY_file(const std::string& fname, Tooth& tooth)
             }
             mesh::vertex_color c;
             c.r = v; c.g = v; c.b = v; c.a = 1.0;
-            prop.push_back( v );
+            columns[j][i] = v;
             mesh.set_vertex_color( i, c );
         }
-        mesh.set_property( prop );
     }
+    mesh.set_property_columns( columns );
 
     tooth.add_mesh( mesh );
 
@@ -334,8 +999,13 @@ int morphomaker::Read_PLY_file(const std::string& fname, Tooth& tooth)
 /**
  * @brief Read object data in OFF file format.
  *
- * Limitations:
- * - Data lines must not have any trailing whitespaces.
+ * The file is memory-mapped and scanned in place. Vertices, colors and
+ * polygon indices are written directly into arrays allocated once from the
+ * counts given in the header.
+ *
+ * - Vertex lines may have 3 columns (coordinates) or 7 columns (coordinates
+ *   and RGBA color); extra columns beyond 7 are ignored.
+ * - Comment lines ('#') accepted anywhere.
  *
  * @param fname     File name.
  * @param tooth     Tooth object to store the object data.
@@ -343,82 +1013,100 @@ int morphomaker::Read_PLY_file(const std::string& fname, Tooth& tooth)
  */
 int morphomaker::Read_OFF_file(const std::string& fname, Tooth& tooth)
 {
-    std::ifstream in(fname);
-    if (!in.good()) {
+    mapped_file_ file(fname);
+    if (!file.good()) {
         std::cerr << "Error: Cannot open file '" << fname << "' for reading."
                   << std::endl;
         return EXIT_FAILURE;
     }
+    const char* p = file.begin();
+    const char* end = file.end();
 
-    // Must find 'OFF' or 'COFF' tag on the first non-comment line.
-    eat_comments_(in);
-    std::string s;
-    in >> s;
-    if (s.find("OFF") && s.find("COFF")) {
-        std::cerr << "Error: Invalid header in " << fname << ". Expecting "
-                  << "to find 'OFF' or 'COFF'." << std::endl;
+    mesh::vertex_array vertices;
+    mesh::color_array colors;
+    uint32_t nfaces = 0;
+    if (read_off_vertices_(p, end, fname, vertices, colors, nfaces)) {
         return EXIT_FAILURE;
     }
+    const uint32_t nvertices = vertices.size();
 
-    // The next line should contain the vertices, faces counts.
-    eat_comments_(in);
-    int nvertices=0, nfaces=0, nedges=0;
-    in >> nvertices; in >> nfaces; in >> nedges;
-
-    Mesh mesh( nvertices, nfaces );
+    // Read nfaces lines of polygon data into flat arrays.
+    std::vector<uint32_t> sizes( nfaces );
+    std::vector<uint32_t> indices( 4*size_t(nfaces) );
+    size_t n_indices = 0;
 
-    // Maximum number of variables. For now, either 3 vertices,
-    // or 3 vertices + 4 colors.
-    const int maxVar = 7;
-    float p[maxVar] = {0.0};
-    int t[4] = {0};
+    for (uint32_t i=0; i<nfaces; i++) {
+        p = skip_comments_(p, end);
+        if (p >= end) return EXIT_FAILURE;
 
-    // Read nvertices lines of vertex data.
-    int i,j;
-    for (i=0; i<nvertices; i++) {
-        if (!in.good()) return EXIT_FAILURE;
-        eat_comments_(in);
+        uint32_t n = 0;
+        scan_uint_(p, end, n);
+        if (n<3 || n>4) {
+            std::cerr << "Error: Unsupported polygon size " << n << "."
+                      << " Only triangles and quads supported." << std::endl;
+            return EXIT_FAILURE;
+        }
 
-        // Read node coordinates and potentially vertex color information.
-        for (j=0; j<maxVar; j++) {
-            if (in.peek() == '\n') {
-                break;
+        // TODO: Split quads to triangles.
+        for (uint32_t j=0; j<n; j++) {
+            if (!scan_uint_(p, end, indices[n_indices+j]) ||
+                indices[n_indices+j] >= nvertices) {
+                std::cerr << "Error: Invalid polygon " << i << " in " << fname
+                          << "." << std::endl;
+                return EXIT_FAILURE;
             }
-            in >> p[j];
-        }
-        mesh.add_vertex( p[0], p[1], p[2] );
-        mesh::vertex_color c = { 0.0, 0.0, 0.0, 0.0 };
-        if ( j == 7 ) {     // Only acccept RGBA colors, hence must be 7 cols.
-            c = { p[3], p[4], p[5], p[6] };
         }
-        mesh.set_vertex_color( i, c );
+        sizes[i] = n;
+        n_indices += n;
+        p = next_line_(p, end);
     }
+    indices.resize( n_indices );
+
+    Mesh mesh;
+    mesh.set_vectices( vertices );
+    mesh.set_vertex_colors( colors );
 
     // Store a copy of current object colors to avoid losing them later when
     // manipulating vertex colors from the interface.
     mesh.set_alt_colors( mesh.get_vertex_colors() );
 
-    // Read nfaces lines of polygon data.
-    for (i=0; i<nfaces; i++) {
-        if (!in.good()) return EXIT_FAILURE;
-        eat_comments_(in);
+    mesh.set_polygons( sizes, indices );
+    tooth.add_mesh( mesh );
 
-        in >> t[0];
-        if (t[0]<3 || t[0]>4) {
-            std::cerr << "Error: Unsupported polygon size " << t[0] << "."
-                      << " Only triangles and quads supported." << std::endl;
-            return EXIT_FAILURE;
-        }
+    return EXIT_SUCCESS;
+}
 
-        // TODO: Split quads to triangles.
-        std::vector<uint32_t> polygon;
-        for (j=1; j<=t[0]; j++) {
-            in >> t[j];
-            polygon.push_back(t[j]);
-        }
-        mesh.add_polygon( polygon );
+
+
+/**
+ * @brief Reads the vertices and vertex colors of an OFF file, skipping the
+ *        polygons (e.g. Humppa's own polygons are not reliable).
+ * @param fname     File name.
+ * @param tooth     Tooth object to store the object data.
+ * @return          EXIT_SUCCESS, EXIT_FAILURE.
+ */
+int morphomaker::Read_OFF_vertices(const std::string& fname, Tooth& tooth)
+{
+    mapped_file_ file(fname);
+    if (!file.good()) {
+        std::cerr << "Error: Cannot open file '" << fname << "' for reading."
+                  << std::endl;
+        return EXIT_FAILURE;
+    }
+    const char* p = file.begin();
+    const char* end = file.end();
+
+    mesh::vertex_array vertices;
+    mesh::color_array colors;
+    uint32_t nfaces = 0;
+    if (read_off_vertices_(p, end, fname, vertices, colors, nfaces)) {
+        return EXIT_FAILURE;
     }
 
+    Mesh mesh;
+    mesh.set_vectices( vertices );
+    mesh.set_vertex_colors( colors );
+    mesh.set_alt_colors( mesh.get_vertex_colors() );
     tooth.add_mesh( mesh );
 
     return EXIT_SUCCESS;
@@ -429,125 +1117,129 @@ int morphomaker::Read_OFF_file(const std::string& fname, Tooth& tooth)
 /**
  * @brief Reads Hummpa .dad file.
  *
- * @param step      Current step
- * @param stepsize  Step size
- * @param run_id    Model run id
+ * The file is scanned once from start to end. Sections are expected in the
+ * order written by Humppa: parameters, neighbours, cell shapes, knots, cell
+ * coordinates, concentrations. Only cell shapes and the epithelial
+ * concentrations are stored, and the neighbours if asked for; the other
+ * sections and the mesenchymal concentration rows are skipped without parsing
+ * their values.
+ *
+ * The number of cells in each section header must equal the number of mesh
+ * vertices in tooth, so the mesh should be read first.
+ *
+ * @param fname     File name.
  * @param tooth     Tooth object for storing the data
+ * @param nlist     If given, gets the neighbours of each cell as 0-based
+ *                  indices in the order of the file, without Humppa's border
+ *                  node.
  * @return          -1 File reading failed. 0 OK.
  */
-int morphomaker::Read_Humppa_DAD_file( int step, int stepsize, int run_id,
-                                       Tooth& tooth)
+int morphomaker::Read_Humppa_DAD_file( const std::string& fname, Tooth& tooth,
+                                       std::vector<std::vector<uint32_t>>* nlist )
 {
-    // Construct the file name, open for reading.
-    QString target = QString::number(step*stepsize) + "*"
-                     + QString::number(run_id) + "*.dad";
-    QStringList filter(target);
-    QDir qdir("./");
-    QFileInfoList files = qdir.entryInfoList( filter, QDir::Files );
-    if (files.size() == 0)
-        return -1;
-
-    char dadFileName[1024];
-    strcpy( dadFileName, files.at(0).fileName().toStdString().c_str() );
-    FILE* input = fopen(dadFileName, "r");
-    if (input == nullptr) {
+    mapped_file_ file(fname);
+    if (!file.good()) {
         if (DEBUG_MODE) fprintf(stderr, "%s(): Can't open file '%s'. Aborted.\n",
-                                __FUNCTION__, dadFileName);
+                                __FUNCTION__, fname.c_str());
         return -1;
     }
+    const char* p = file.begin();
+    const char* end = file.end();
+
+    const uint32_t ncels = tooth.get_mesh().get_vertices().size();
+    uint32_t value = 0;
+
+    // Parameters: 30 values written as F15.6, followed by the number of
+    // mesenchymal layers. Wide values run together, so the fields are counted
+    // by width.
+    uint32_t ncz = 0, ncils = 0;
+    p = skip_fields_(p, end, 30, 15);
+    if (p == nullptr) return -1;
+    p = skip_space_(p, end);
+    if (!scan_uint_(p, end, ncz) || !scan_uint_(p, end, ncils) || ncz == 0)
+        return -1;
 
-    // A helper for converting given string 's' (which may contain extra white
-    // spaces) to an integer. Returns 0 if 's' consists of a non-integer.
-    auto str2int_ = []( std::string& s ) {
-        int i = !s.empty() && (s.find_first_not_of("0123456789") == std::string::npos);
-        return i ? std::atoi(s.c_str()) : 0;
-    };
-
-    uint32_t filePos=0, cnt=0;
-    int col0 = stepsize;
-    char tmp[256];
-
-    while (!feof(input)) {
-        if (fgets(tmp, 255, input) == nullptr) {
-            fclose(input);
-            return -1;
+    // Neighbours: per cell the number of neighbours and their 1-based indices.
+    if (!scan_dad_header_(p, end, value, ncels)) return -1;
+    if (nlist != nullptr) {
+        nlist->assign( ncels, std::vector<uint32_t>() );
+    }
+    for (uint32_t i=0; i<ncels; i++) {
+        uint32_t k = 0;
+        p = skip_space_(p, end);
+        if (!scan_uint_(p, end, k)) return -1;
+        if (nlist == nullptr) {
+            if ((p = skip_tokens_(p, end, k)) == nullptr) return -1;
+            continue;
         }
 
-        // Figure out the current file/data position from the first two columns.
-        std::stringstream ss(tmp);
-        std::string cols[2];
-        ss >> cols[0] >> cols[1];
-
-        if (str2int_(cols[0]) == col0 &&
-            str2int_(cols[1]) == (int)tooth.get_mesh().get_vertices().size()) {
-            if (filePos == 4) {     // found 1st "4 [nvertices]"
-                filePos = 4;
-                break;
-            }
-            if (filePos == 3) {     // found 1st "5 [nvertices]" (concentrations)
-                filePos = 4;
-                col0 = 4;
-                cnt = 0;
-                continue;
-            }
-            if (filePos == 2) {     // found 3rd "[stepsize] [nvertices]"
-                filePos = 3;
-                col0 = 5;
-                continue;
-            }
-            if (filePos == 1) {     // found 2nd "[stepsize] [nvertices]" (cell shapes)
-                filePos = 2;
-                continue;
-            }
-            if (filePos == 0) {     // found 1st "[stepsize] [nvertices]"
-                filePos = 1;
-                continue;
+        auto& list = nlist->at(i);
+        list.reserve( k );
+        for (uint32_t j=0; j<k; j++) {
+            uint32_t v = 0;
+            p = skip_space_(p, end);
+            if (!scan_uint_(p, end, v)) return -1;
+            if (v > 0 && v <= ncels) {
+                list.push_back( v-1 );
             }
         }
+    }
 
-
-        if (filePos == 2) {     // read cell shapes
-            if (!cols[1].compare("cell")) {
-                cnt++;
-                continue;
-            }
-
-            ss.clear();
-            ss.str(tmp);
-            std::string str;
-            std::vector<float> data(3);
-            for (size_t i=0; i<data.size(); ++i) {
-                ss >> str;
-                data[i] = std::atof( str.c_str() );
-            }
-
-            mesh::vertex vert = { data[0], data[1], data[2] };
-            tooth.add_cell_shape( cnt-1, vert );
+    // Cell shapes: per cell "[k] cell shape" followed by k boundary vertices.
+    mesh::vertex_array shape_vertices;
+    std::vector<uint32_t> shape_offsets( ncels+1, 0 );
+    shape_vertices.reserve( 8*size_t(ncels) );
+
+    if (!scan_dad_header_(p, end, value, ncels)) return -1;
+    for (uint32_t i=0; i<ncels; i++) {
+        uint32_t k = 0;
+        p = skip_space_(p, end);
+        if (!scan_uint_(p, end, k)) return -1;
+        p = next_line_(p, end);
+
+        for (uint32_t j=0; j<k; j++) {
+            mesh::vertex v;
+            p = skip_space_(p, end);
+            if (!scan_float_(p, end, v.x)) return -1;
+            if (!scan_float_(p, end, v.y)) return -1;
+            if (!scan_float_(p, end, v.z)) return -1;
+            shape_vertices.push_back( v );
         }
+        shape_offsets[i+1] = shape_vertices.size();
+    }
 
-        if (filePos == 4) {     // read cell data (concentrations)
-            ss.clear();
-            ss.str(tmp);
-            std::string str;
-            std::vector<float> data(5);
-            for (size_t i=0; i<data.size(); ++i) {
-                ss >> str;
-                data[i] = std::atof( str.c_str() );
-            }
-
-            // Concentrations are given as four lines per epithelial cell, with
-            // first line for the epithelial concentration followed by mesenchymal
-            // concentrations for a stack of three cells. Only want to first line.
-            if (cnt%4 == 0) {
-                tooth.add_cell_data( data );
-                cnt = 0;
-            }
-            cnt++;
+    // Knots: the number of knot cells followed by their indices.
+    uint32_t nknots = 0;
+    if (!scan_dad_header_(p, end, value, ncels)) return -1;
+    p = skip_space_(p, end);
+    if (!scan_uint_(p, end, nknots)) return -1;
+    if ((p = skip_tokens_(p, end, nknots)) == nullptr) return -1;
+
+    // Cell coordinates; the same as the mesh vertices.
+    if (!scan_dad_header_(p, end, value, ncels)) return -1;
+    if ((p = skip_tokens_(p, end, 3*size_t(ncels))) == nullptr) return -1;
+
+    // Concentrations are given as ncz rows of ng values per epithelial cell,
+    // the first row for the epithelial concentration followed by mesenchymal
+    // concentrations for a stack of cells. Only want the first row.
+    uint32_t ng = 0;
+    if (!scan_dad_header_(p, end, ng, ncels) || ng == 0) return -1;
+
+    std::vector<std::vector<float>> cell_data( ncels, std::vector<float>(ng) );
+    for (uint32_t i=0; i<ncels; i++) {
+        auto& data = cell_data[i];
+        for (uint32_t j=0; j<ng; j++) {
+            p = skip_space_(p, end);
+            if (!scan_float_(p, end, data[j])) return -1;
         }
+        if ((p = skip_tokens_(p, end, (ncz-1)*size_t(ng))) == nullptr)
+            return -1;
     }
 
-    fclose(input);
+    tooth.set_cell_shapes( shape_vertices, shape_offsets );
+    for (auto& data : cell_data) {
+        tooth.add_cell_data( std::move(data) );
+    }
 
     return 0;
 }
-
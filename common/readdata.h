@@ -1,5 +1,6 @@
 #pragma once
 
+#include <vector>
 #include "tooth.h"
 
 namespace morphomaker {
@@ -10,6 +11,9 @@ int Read_PLY_file(const std::string&, Tooth&);
 
 int Read_OFF_file(const std::string&, Tooth&);
 
-int Read_Humppa_DAD_file( int, int, int, Tooth& );
+int Read_OFF_vertices(const std::string&, Tooth&);
+
+int Read_Humppa_DAD_file( const std::string&, Tooth&,
+                          std::vector<std::vector<uint32_t>>* nlist=nullptr );
 
 }
@@ -0,0 +1,617 @@
+/**
+ *  @file stepcache.cpp
+ *  @brief Writes and reads binary step cache files.
+ *
+ */
+
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+
+#include "stepcache.h"
+#include "toothlife.h"
+
+
+namespace {
+
+const char stepcache_magic_[8] = { 'T', 'M', 'S', 'T', 'E', 'P', 0, 0 };
+const uint32_t stepcache_bom_ = 0x01020304;
+
+// Header size: magic, version, byte order mark, model, run ID, step size,
+// number of steps, index offset.
+const size_t stepcache_header_size_ = 8 + 4*6 + 8;
+
+
+/**
+ * @brief Appends raw bytes to a buffer.
+ */
+void put_( std::vector<char>& buf, const void* p, size_t n )
+{
+    const char* c = static_cast<const char*>(p);
+    buf.insert( buf.end(), c, c+n );
+}
+
+
+template <typename T>
+void put_value_( std::vector<char>& buf, T v )
+{
+    put_( buf, &v, sizeof(T) );
+}
+
+
+template <typename T>
+void put_array_( std::vector<char>& buf, const T* data, size_t n )
+{
+    put_value_<uint32_t>( buf, n );
+    put_( buf, data, n*sizeof(T) );
+}
+
+
+void put_string_( std::vector<char>& buf, const std::string& s )
+{
+    put_array_( buf, s.data(), s.size() );
+}
+
+
+/**
+ * @brief Bounds-checked cursor over a byte buffer.
+ *        Any read past the end sets the failure flag and returns zeros.
+ */
+class cursor_
+{
+public:
+    cursor_( const char* p, size_t n ) : m_p(p), m_end(p+n), m_fail(false) {}
+
+    bool fail() const   { return m_fail; }
+
+    bool get( void* dst, size_t n )
+    {
+        if (n == 0) {
+            return !m_fail;
+        }
+        if (m_fail || size_t(m_end-m_p) < n) {
+            m_fail = true;
+            memset( dst, 0, n );
+            return false;
+        }
+        memcpy( dst, m_p, n );
+        m_p += n;
+        return true;
+    }
+
+    template <typename T>
+    T value()
+    {
+        T v;
+        get( &v, sizeof(T) );
+        return v;
+    }
+
+    template <typename T>
+    void array( std::vector<T>& v )
+    {
+        uint32_t n = value<uint32_t>();
+        if (m_fail || size_t(m_end-m_p)/sizeof(T) < n) {
+            m_fail = true;
+            return;
+        }
+        v.resize( n );
+        get( v.data(), n*sizeof(T) );
+    }
+
+    std::string string()
+    {
+        std::vector<char> v;
+        array( v );
+        return std::string( v.begin(), v.end() );
+    }
+
+private:
+    const char* m_p;
+    const char* m_end;
+    bool m_fail;
+};
+
+
+/**
+ * @brief Serializes the run parameters.
+ */
+void put_parameters_( std::vector<char>& buf, Parameters* par )
+{
+    if (par == nullptr) {
+        put_string_( buf, "" );
+        put_string_( buf, "" );
+        put_value_<uint32_t>( buf, 0 );
+        put_value_<uint32_t>( buf, 0 );
+        return;
+    }
+
+    put_string_( buf, par->getModelName() );
+    put_string_( buf, par->getID() );
+
+    auto& params = par->getParameters();
+    put_value_<uint32_t>( buf, params.size() );
+    for (auto& p : params) {
+        put_string_( buf, p.name );
+        put_value_<double>( buf, p.value );
+    }
+
+    auto keys = par->getKeywords();
+    put_value_<uint32_t>( buf, keys->size() );
+    for (auto& key : *keys) {
+        put_string_( buf, key );
+        put_string_( buf, par->getKey(key) );
+    }
+}
+
+
+/**
+ * @brief Serializes a single step.
+ */
+void put_tooth_( std::vector<char>& buf, Tooth& tooth )
+{
+    Mesh& mesh = tooth.get_mesh();
+    auto dim = tooth.get_domain_dim();
+
+    put_value_<int32_t>( buf, tooth.get_tooth_type() );
+    put_value_<int32_t>( buf, dim.first );
+    put_value_<int32_t>( buf, dim.second );
+
+    auto& vertices = mesh.get_vertices();
+    auto& colors = mesh.get_vertex_colors(0);
+    auto& alt_colors = mesh.get_vertex_colors(1);
+    put_array_( buf, vertices.data(), vertices.size() );
+    put_array_( buf, colors.data(), colors.size() );
+    put_array_( buf, alt_colors.data(), alt_colors.size() );
+
+    auto& polygons = mesh.get_polygons();
+    auto& offsets = polygons.get_offsets();
+    auto& indices = polygons.get_indices();
+    std::vector<uint32_t> sizes( polygons.size() );
+    for (size_t i=0; i<sizes.size(); i++) {
+        sizes[i] = offsets[i+1] - offsets[i];
+    }
+    put_array_( buf, sizes.data(), sizes.size() );
+    put_array_( buf, indices.data(), indices.size() );
+
+    put_value_<uint32_t>( buf, mesh.get_property_count() );
+    for (size_t j=0; j<mesh.get_property_count(); j++) {
+        auto& column = mesh.get_property_column(j);
+        put_array_( buf, column.data(), column.size() );
+    }
+
+    auto& cell_data = tooth.get_cell_data();
+    put_value_<uint32_t>( buf, cell_data.size() );
+    for (auto& data : cell_data) {
+        put_array_( buf, data.data(), data.size() );
+    }
+
+    auto& shape_vertices = tooth.get_cell_shape_vertices();
+    auto& shape_offsets = tooth.get_cell_shape_offsets();
+    put_array_( buf, shape_vertices.data(), shape_vertices.size() );
+    put_array_( buf, shape_offsets.data(), shape_offsets.size() );
+}
+
+
+/**
+ * @brief Deserializes a single step into tooth.
+ * @return      false if the record is corrupt.
+ */
+bool get_tooth_( cursor_& in, Tooth& tooth )
+{
+    int type = in.value<int32_t>();
+    int m = in.value<int32_t>();
+    int n = in.value<int32_t>();
+    if (in.fail()) {
+        return false;
+    }
+
+    tooth = Tooth( type );
+    tooth.set_domain_dim( m, n );
+
+    mesh::vertex_array vertices;
+    mesh::color_array colors, alt_colors;
+    std::vector<uint32_t> sizes, indices;
+    in.array( vertices );
+    in.array( colors );
+    in.array( alt_colors );
+    in.array( sizes );
+    in.array( indices );
+
+    // Polygon sizes must add up to the number of indices, the indices must
+    // refer to vertices and the colors, if any, must be given per vertex.
+    size_t n_indices = 0;
+    for (auto s : sizes) n_indices += s;
+    if (in.fail() || n_indices != indices.size()) {
+        return false;
+    }
+    const size_t n_vertices = vertices.size();
+    for (auto i : indices) {
+        if (i >= n_vertices) {
+            return false;
+        }
+    }
+    if ((!colors.empty() && colors.size() != n_vertices) ||
+        (!alt_colors.empty() && alt_colors.size() != n_vertices)) {
+        return false;
+    }
+
+    Mesh mesh;
+    mesh.set_vectices( vertices );
+    mesh.set_vertex_colors( colors );
+    mesh.set_alt_colors( alt_colors );
+    mesh.set_polygons( sizes, indices );
+
+    uint32_t n_props = in.value<uint32_t>();
+    std::vector<mesh::property_column> columns( n_props );
+    for (uint32_t i=0; i<n_props && !in.fail(); i++) {
+        in.array( columns[i] );
+        if (columns[i].size() != n_vertices) {
+            return false;
+        }
+    }
+    mesh.set_property_columns( columns );
+    tooth.add_mesh( mesh );
+
+    uint32_t n_data = in.value<uint32_t>();
+    for (uint32_t i=0; i<n_data && !in.fail(); i++) {
+        std::vector<float> data;
+        in.array( data );
+        tooth.add_cell_data( std::move(data) );
+    }
+
+    mesh::vertex_array shape_vertices;
+    std::vector<uint32_t> shape_offsets;
+    in.array( shape_vertices );
+    in.array( shape_offsets );
+    for (size_t i=0; i<shape_offsets.size(); i++) {
+        uint32_t prev = i ? shape_offsets[i-1] : 0;
+        if (shape_offsets[i] < prev || shape_offsets[i] > shape_vertices.size()) {
+            return false;
+        }
+    }
+    tooth.set_cell_shapes( shape_vertices, shape_offsets );
+
+    return !in.fail();
+}
+
+}
+
+
+
+/**
+ * @brief Serializes a single step as a step cache record.
+ * @param buf       Buffer the record is appended to.
+ * @param tooth     Step.
+ */
+void morphomaker::Write_step_record( std::vector<char>& buf, Tooth& tooth )
+{
+    put_tooth_( buf, tooth );
+}
+
+
+
+/**
+ * @brief Deserializes a single step cache record.
+ * @param data      Record.
+ * @param size      Record size in bytes.
+ * @param tooth     Target Tooth object; replaced by the step.
+ * @return          EXIT_SUCCESS, EXIT_FAILURE if the record is corrupt.
+ */
+int morphomaker::Read_step_record( const char* data, size_t size, Tooth& tooth )
+{
+    cursor_ in( data, size );
+    return get_tooth_( in, tooth ) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+
+/**
+ * @brief Writes a complete model run into a step cache file.
+ *
+ * The file is first written under a temporary name and renamed when
+ * complete, so a partially written cache is never picked up by a reader. If
+ * the steps were written as they were added (ToothLife::setStepCache()),
+ * that file is completed instead.
+ *
+ * @param fname         File name.
+ * @param toothLife     Model run.
+ * @param stepsize      Model step size.
+ * @return              EXIT_SUCCESS, EXIT_FAILURE.
+ */
+int morphomaker::Write_step_cache( const std::string& fname,
+                                   ToothLife& toothLife, int stepsize )
+{
+    if (toothLife.hasStepCache()) {
+        return toothLife.finishStepCache( fname );
+    }
+
+    StepCacheWriter writer( fname, toothLife.getCurrentModel(), toothLife.getID(),
+                            stepsize, toothLife.getParameters() );
+    Tooth buffer( 0 );
+    for (int i=0; writer.good() && i<toothLife.getLifeSize(); i++) {
+        Tooth* tooth = toothLife.getTooth( i, buffer );
+        if (tooth == nullptr) {
+            std::cerr << "Error: Step " << i << " not available for '" << fname
+                      << "'." << std::endl;
+            return EXIT_FAILURE;
+        }
+        writer.append( *tooth );
+    }
+
+    return writer.finish();
+}
+
+
+
+/**
+ * @brief Reads a complete model run from a step cache file.
+ * @param fname     File name.
+ * @return          New ToothLife object, nullptr if reading failed.
+ */
+ToothLife* morphomaker::Read_step_cache( const std::string& fname )
+{
+    StepCacheReader reader( fname );
+    if (!reader.good()) {
+        return nullptr;
+    }
+
+    ToothLife* toothLife = new ToothLife( reader.getCurrentModel(),
+                                          reader.getID() );
+    toothLife->setParameters( &reader.getParameters() );
+
+    for (int i=0; i<reader.getLifeSize(); i++) {
+        Tooth* tooth = reader.readTooth( i, *toothLife );
+        if (tooth == nullptr) {
+            delete toothLife;
+            return nullptr;
+        }
+        toothLife->addTooth( tooth );
+    }
+
+    return toothLife;
+}
+
+
+
+/**
+ * @brief Starts a step cache file: writes the header and the parameters
+ *        under a temporary name.
+ * @param fname         File name.
+ * @param model         Model index.
+ * @param id            Run ID.
+ * @param stepsize      Model step size.
+ * @param parameters    Model parameters, may be nullptr.
+ */
+StepCacheWriter::StepCacheWriter( const std::string& fname, int model, int id,
+                                  int stepsize, Parameters* parameters )
+    : m_fname(fname), m_tmpname(fname + ".part"), m_good(false), m_done(false),
+      m_pos(0)
+{
+    m_out.open( m_tmpname, std::ios::out | std::ios::binary );
+    if (!m_out.good()) {
+        std::cerr << "Error: Cannot open file '" << m_tmpname << "' for writing."
+                  << std::endl;
+        return;
+    }
+
+    // Header; the number of steps and the index offset are filled in once
+    // known.
+    put_( m_buf, stepcache_magic_, 8 );
+    put_value_<uint32_t>( m_buf, STEPCACHE_VERSION );
+    put_value_<uint32_t>( m_buf, stepcache_bom_ );
+    put_value_<int32_t>( m_buf, model );
+    put_value_<int32_t>( m_buf, id );
+    put_value_<int32_t>( m_buf, stepsize );
+    put_value_<uint32_t>( m_buf, 0 );
+    put_value_<uint64_t>( m_buf, 0 );
+    put_parameters_( m_buf, parameters );
+    m_out.write( m_buf.data(), m_buf.size() );
+    m_pos = m_buf.size();
+
+    m_good = m_out.good();
+}
+
+
+
+StepCacheWriter::~StepCacheWriter()
+{
+    if (!m_done) {
+        m_out.close();
+        std::remove( m_tmpname.c_str() );
+    }
+}
+
+
+
+/**
+ * @brief Appends a step record. Steps are serialized one at a time to keep
+ *        the buffer small.
+ * @param tooth     Step.
+ * @return          EXIT_SUCCESS, EXIT_FAILURE.
+ */
+int StepCacheWriter::append( Tooth& tooth )
+{
+    if (!m_good || m_done) {
+        return EXIT_FAILURE;
+    }
+
+    m_buf.clear();
+    put_tooth_( m_buf, tooth );
+    m_offsets.push_back( m_pos );
+    m_out.write( m_buf.data(), m_buf.size() );
+    m_pos += m_buf.size();
+
+    m_good = m_out.good();
+    return m_good ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+
+/**
+ * @brief Writes the index, patches the header and renames the file.
+ * @param fname     File name, the one given to the constructor if empty.
+ * @return          EXIT_SUCCESS, EXIT_FAILURE.
+ */
+int StepCacheWriter::finish( const std::string& fname )
+{
+    if (!m_good || m_done) {
+        return EXIT_FAILURE;
+    }
+    std::string target = fname.empty() ? m_fname : fname;
+
+    // Index, then patch the number of steps and its offset into the header.
+    uint32_t n_steps = m_offsets.size();
+    m_out.write( reinterpret_cast<const char*>(m_offsets.data()),
+                 m_offsets.size()*sizeof(uint64_t) );
+    m_out.seekp( stepcache_header_size_ - sizeof(uint64_t) - sizeof(uint32_t) );
+    m_out.write( reinterpret_cast<const char*>(&n_steps), sizeof(uint32_t) );
+    m_out.write( reinterpret_cast<const char*>(&m_pos), sizeof(uint64_t) );
+    m_out.close();
+
+    m_good = !m_out.fail();
+    if (!m_good) {
+        std::cerr << "Error: Writing '" << m_tmpname << "' failed." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::remove( target.c_str() );
+    if (std::rename( m_tmpname.c_str(), target.c_str() )) {
+        m_good = false;
+        return EXIT_FAILURE;
+    }
+
+    m_done = true;
+    return EXIT_SUCCESS;
+}
+
+
+
+/**
+ * @brief Opens a step cache file and reads its header, parameters and index.
+ * @param fname     File name.
+ */
+StepCacheReader::StepCacheReader( const std::string& fname )
+    : m_good(false), m_model(0), m_id(0), m_stepSize(1), m_indexOffset(0)
+{
+    m_in.open( fname, std::ios::in | std::ios::binary );
+    if (!m_in.good()) {
+        return;
+    }
+
+    m_in.seekg( 0, std::ios::end );
+    uint64_t size = m_in.tellg();
+    m_in.seekg( 0, std::ios::beg );
+    if (size < stepcache_header_size_) {
+        return;
+    }
+
+    char header[stepcache_header_size_];
+    m_in.read( header, stepcache_header_size_ );
+    cursor_ in( header, stepcache_header_size_ );
+
+    char magic[8];
+    in.get( magic, 8 );
+    uint32_t version = in.value<uint32_t>();
+    uint32_t bom = in.value<uint32_t>();
+    if (memcmp(magic, stepcache_magic_, 8) || version != STEPCACHE_VERSION ||
+        bom != stepcache_bom_) {
+        std::cerr << "Error: '" << fname << "' is not a supported step cache."
+                  << std::endl;
+        return;
+    }
+
+    m_model = in.value<int32_t>();
+    m_id = in.value<int32_t>();
+    m_stepSize = in.value<int32_t>();
+    uint32_t n_steps = in.value<uint32_t>();
+    m_indexOffset = in.value<uint64_t>();
+
+    if (m_indexOffset < stepcache_header_size_ ||
+        m_indexOffset + n_steps*sizeof(uint64_t) > size) {
+        return;
+    }
+
+    // Index.
+    m_offsets.resize( n_steps );
+    m_in.seekg( m_indexOffset );
+    if (!m_in.read( reinterpret_cast<char*>(m_offsets.data()),
+                    n_steps*sizeof(uint64_t) )) {
+        return;
+    }
+
+    uint64_t prev = stepcache_header_size_;
+    for (uint32_t i=0; i<n_steps; i++) {
+        if (m_offsets[i] < prev || m_offsets[i] > m_indexOffset) {
+            return;
+        }
+        prev = m_offsets[i];
+    }
+
+    // Parameters take the space between the header and the first step.
+    uint64_t par_end = n_steps ? m_offsets[0] : m_indexOffset;
+    std::vector<char> buf( par_end - stepcache_header_size_ );
+    m_in.seekg( stepcache_header_size_ );
+    if (!m_in.read( buf.data(), buf.size() )) {
+        return;
+    }
+    cursor_ par( buf.data(), buf.size() );
+
+    std::string name = par.string();
+    m_parameters.setModelName( name );
+    m_parameters.setID( par.string() );
+
+    uint32_t n_params = par.value<uint32_t>();
+    for (uint32_t i=0; i<n_params && !par.fail(); i++) {
+        parameter p = { "", "", PARTYPE_FIELD, {}, false, 0.0 };
+        p.name = par.string();
+        p.value = par.value<double>();
+        m_parameters.addParameter( p );
+    }
+
+    uint32_t n_keys = par.value<uint32_t>();
+    for (uint32_t i=0; i<n_keys && !par.fail(); i++) {
+        std::string key = par.string();
+        m_parameters.setKey( key, par.string() );
+    }
+    if (par.fail()) {
+        return;
+    }
+
+    m_good = true;
+}
+
+
+
+/**
+ * @brief Reads step i with a single seek and read.
+ * @param i             Step index.
+ * @param toothLife     ToothLife the Tooth object is allocated from.
+ * @return              New Tooth object owned by toothLife but not added to
+ *                      it; nullptr if i is out of range or the record is
+ *                      corrupt.
+ */
+Tooth* StepCacheReader::readTooth( int i, ToothLife& toothLife )
+{
+    if (!m_good || i < 0 || i >= (int)m_offsets.size()) {
+        return nullptr;
+    }
+
+    uint64_t begin = m_offsets[i];
+    uint64_t end = (i+1 < (int)m_offsets.size()) ? m_offsets[i+1] : m_indexOffset;
+
+    std::vector<char> buf( end - begin );
+    m_in.clear();
+    m_in.seekg( begin );
+    if (!m_in.read( buf.data(), buf.size() )) {
+        return nullptr;
+    }
+
+    Tooth* tooth = toothLife.newTooth( 0 );
+    if (morphomaker::Read_step_record( buf.data(), buf.size(), *tooth )) {
+        toothLife.discardTooth( tooth );
+        return nullptr;
+    }
+
+    return tooth;
+}
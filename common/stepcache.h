@@ -0,0 +1,135 @@
+#pragma once
+
+/**
+ *  @file stepcache.h
+ *  @brief Binary step cache (.tmstep) for complete model runs.
+ *
+ *  A step cache stores a whole ToothLife: run information, model parameters
+ *  and every Tooth object with its mesh, cell data and cell shapes. Steps are
+ *  stored back to back and located through an offset index at the end of the
+ *  file, so any single step can be loaded with one seek.
+ *
+ *  File layout (version 2, host byte order):
+ *
+ *  Header:
+ *    char[8]   "TMSTEP\0\0"
+ *    uint32    version
+ *    uint32    byte order mark 0x01020304
+ *    int32     model index, run ID, step size
+ *    uint32    number of steps
+ *    uint64    offset of the step index
+ *  Parameters:
+ *    string    model name, parameters ID
+ *    uint32    number of parameters; per parameter string name, float64 value
+ *    uint32    number of keywords; per keyword string key, string value
+ *  Steps, one record per step:
+ *    int32     tooth type, domain dimensions M, N
+ *    array     vertices (float32 xyz), colors, alt colors (float32 rgba)
+ *    array     polygon sizes, polygon indices (uint32)
+ *    uint32    number of properties; per property array (float32) of the
+ *              property values of all vertices
+ *    uint32    number of cell data vectors; per vector array (float32)
+ *    array     cell shape vertices (float32 xyz), offsets (uint32)
+ *  Index:
+ *    uint64    record offset of each step
+ *
+ *  Arrays are written as a uint32 element count followed by the elements,
+ *  strings as a uint32 length followed by the characters.
+ *
+ *  The file is either written at once from a ToothLife (Write_step_cache())
+ *  or step by step as the steps are added (StepCacheWriter), which keeps it
+ *  exact when the ToothLife stores the steps delta-encoded.
+ */
+
+#include <string>
+#include <fstream>
+#include <vector>
+#include <stdint.h>
+
+#include "tooth.h"
+#include "parameters.h"
+
+#define STEPCACHE_VERSION   2
+#define STEPCACHE_EXT       ".tmstep"
+
+class ToothLife;
+
+
+namespace morphomaker {
+
+int Write_step_cache( const std::string&, ToothLife&, int );
+
+ToothLife* Read_step_cache( const std::string& );
+
+void Write_step_record( std::vector<char>&, Tooth& );
+
+int Read_step_record( const char*, size_t, Tooth& );
+
+}
+
+
+
+class StepCacheWriter
+{
+public:
+    // Starts a step cache file for a run; the file appears under fname only
+    // when completed with finish().
+    StepCacheWriter( const std::string& fname, int model, int id, int stepsize,
+                     Parameters* parameters );
+    // Removes the file if it wasn't completed.
+    ~StepCacheWriter();
+
+    // Returns true if all writes so far succeeded.
+    bool good()                             { return m_good; }
+
+    // Appends a step. Returns EXIT_SUCCESS, EXIT_FAILURE.
+    int append( Tooth& tooth );
+
+    // Writes the index and moves the file to fname, or to the name given to
+    // the constructor if empty. Returns EXIT_SUCCESS, EXIT_FAILURE.
+    int finish( const std::string& fname="" );
+
+private:
+    std::ofstream m_out;
+    std::string m_fname;
+    std::string m_tmpname;
+    bool m_good;
+    bool m_done;
+    uint64_t m_pos;
+    std::vector<uint64_t> m_offsets;
+    std::vector<char> m_buf;
+};
+
+
+
+class StepCacheReader
+{
+public:
+    // Opens a step cache file and reads its header, parameters and index.
+    StepCacheReader( const std::string& fname );
+    ~StepCacheReader()  {}
+
+    // Returns true if the file was opened and recognized.
+    bool good()                             { return m_good; }
+
+    // Run information stored in the file.
+    int getCurrentModel()                   { return m_model; }
+    int getID()                             { return m_id; }
+    int getStepSize()                       { return m_stepSize; }
+    int getLifeSize()                       { return m_offsets.size(); }
+    Parameters& getParameters()             { return m_parameters; }
+
+    // Reads step i into a new Tooth object allocated from toothLife; nullptr
+    // if failed.
+    Tooth* readTooth( int i, ToothLife& toothLife );
+
+private:
+    std::ifstream m_in;
+    bool m_good;
+    int m_model;
+    int m_id;
+    int m_stepSize;
+    uint64_t m_indexOffset;
+    std::vector<uint64_t> m_offsets;
+    Parameters m_parameters;
+};
@@ -0,0 +1,250 @@
+/**
+ *  @file stepspill.cpp
+ *  @brief Steps of a model run paged out to a temporary file.
+ *
+ */
+
+#include <iostream>
+#include <cstdio>
+#include <iterator>
+
+#include "stepspill.h"
+#include "stepcache.h"
+
+
+
+/**
+ * @brief Creates the spill file.
+ * @param fname     File name; an existing file is overwritten.
+ * @param capacity  Maximum number of steps kept in memory.
+ */
+StepSpill::StepSpill( const std::string& fname, size_t capacity )
+    : m_fname(fname), m_good(false), m_outPos(0), m_capacity(capacity ? capacity : 1),
+      m_pinned(-1), m_hits(0), m_misses(0)
+{
+    m_out.open( fname, std::ios::out | std::ios::trunc | std::ios::binary );
+    if (!m_out.good()) {
+        std::cerr << "Error: Cannot open file '" << fname << "' for writing."
+                  << std::endl;
+        return;
+    }
+    m_in.open( fname, std::ios::in | std::ios::binary );
+    m_good = m_in.good();
+}
+
+
+
+/**
+ * @brief Closes and removes the spill file.
+ */
+StepSpill::~StepSpill()
+{
+    m_out.close();
+    m_in.close();
+    std::remove( m_fname.c_str() );
+}
+
+
+
+/**
+ * @brief Appends a step to the file and moves it to the cache.
+ *
+ * The record is serialized before taking any lock; the file lock is only held
+ * for the write itself.
+ *
+ * @param tooth     Step; left empty if successful.
+ * @return          EXIT_SUCCESS, EXIT_FAILURE.
+ */
+int StepSpill::write( Tooth& tooth )
+{
+    if (!m_good) {
+        return EXIT_FAILURE;
+    }
+
+    std::vector<char> buf;
+    morphomaker::Write_step_record( buf, tooth );
+
+    int i;
+    {
+        std::lock_guard<std::mutex> lock(m_outMtx);
+        m_out.write( buf.data(), buf.size() );
+        m_out.flush();
+        if (m_out.fail()) {
+            std::cerr << "Error: Writing '" << m_fname << "' failed." << std::endl;
+            m_good = false;
+            return EXIT_FAILURE;
+        }
+        i = m_records.size();
+        m_records.push_back( std::make_pair(m_outPos, buf.size()) );
+        m_outPos += buf.size();
+    }
+
+    // The newest step is the one most likely to be viewed next.
+    std::lock_guard<std::mutex> lock(m_cacheMtx);
+    m_cache.emplace_front( i, Tooth(0) );
+    std::swap( m_cache.front().second, tooth );
+    m_cached[i] = m_cache.begin();
+    evict_();
+
+    return EXIT_SUCCESS;
+}
+
+
+
+/**
+ * @brief Returns step i from the cache or the file.
+ *
+ * On a miss the step is read and decoded without holding the cache lock.
+ *
+ * @param i     Step index.
+ * @return      Cached Tooth object, nullptr if i is out of range or reading
+ *              failed.
+ */
+Tooth* StepSpill::read( int i )
+{
+    {
+        std::lock_guard<std::mutex> lock(m_cacheMtx);
+        auto it = m_cached.find(i);
+        if (it != m_cached.end()) {
+            m_cache.splice( m_cache.begin(), m_cache, it->second );
+            m_pinned = i;
+            m_hits++;
+            return &(m_cache.front().second);
+        }
+    }
+    m_misses++;
+
+    Tooth tooth( 0 );
+    if (readRecord_( i, tooth )) {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(m_cacheMtx);
+    auto it = m_cached.find(i);
+    if (it != m_cached.end()) {
+        // Read by another thread meanwhile.
+        m_cache.splice( m_cache.begin(), m_cache, it->second );
+        m_pinned = i;
+        return &(m_cache.front().second);
+    }
+    m_cache.emplace_front( i, Tooth(0) );
+    std::swap( m_cache.front().second, tooth );
+    m_cached[i] = m_cache.begin();
+    m_pinned = i;
+    evict_();
+
+    return &(m_cache.front().second);
+}
+
+
+
+/**
+ * @brief Reads step i into buffer, bypassing the cache.
+ * @param i         Step index.
+ * @param buffer    Target Tooth object.
+ * @return          Pointer to buffer, nullptr if failed.
+ */
+Tooth* StepSpill::read( int i, Tooth& buffer )
+{
+    {
+        std::lock_guard<std::mutex> lock(m_cacheMtx);
+        auto it = m_cached.find(i);
+        if (it != m_cached.end()) {
+            buffer = it->second->second;
+            return &buffer;
+        }
+    }
+    if (readRecord_( i, buffer )) {
+        return nullptr;
+    }
+    return &buffer;
+}
+
+
+
+int StepSpill::size()
+{
+    std::lock_guard<std::mutex> lock(m_outMtx);
+    return m_records.size();
+}
+
+
+
+void StepSpill::setCapacity( size_t n )
+{
+    std::lock_guard<std::mutex> lock(m_cacheMtx);
+    m_capacity = n ? n : 1;
+    evict_();
+}
+
+
+
+size_t StepSpill::getCapacity()
+{
+    std::lock_guard<std::mutex> lock(m_cacheMtx);
+    return m_capacity;
+}
+
+
+
+size_t StepSpill::bytes()
+{
+    std::lock_guard<std::mutex> lock(m_cacheMtx);
+    size_t n = 0;
+    for (auto& step : m_cache) {
+        n += step.second.bytes();
+    }
+    return n;
+}
+
+
+
+/**
+ * @brief Reads and decodes the record of step i.
+ * @param i         Step index.
+ * @param tooth     Target Tooth object.
+ * @return          EXIT_SUCCESS, EXIT_FAILURE.
+ */
+int StepSpill::readRecord_( int i, Tooth& tooth )
+{
+    std::pair<uint64_t,uint64_t> record;
+    {
+        std::lock_guard<std::mutex> lock(m_outMtx);
+        if (i < 0 || i >= (int)m_records.size()) {
+            return EXIT_FAILURE;
+        }
+        record = m_records[i];
+    }
+
+    std::vector<char> buf( record.second );
+    {
+        std::lock_guard<std::mutex> lock(m_inMtx);
+        m_in.clear();
+        m_in.seekg( record.first );
+        if (!m_in.read( buf.data(), buf.size() )) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    return morphomaker::Read_step_record( buf.data(), buf.size(), tooth );
+}
+
+
+
+/**
+ * @brief Drops least recently used steps until the cache fits its capacity.
+ *        The step returned last by read() is kept even if steps written since
+ *        have made it the least recently used one. The cache lock must be
+ *        held.
+ */
+void StepSpill::evict_()
+{
+    while (m_cache.size() > m_capacity) {
+        auto last = std::prev( m_cache.end() );
+        if (last->first == m_pinned) {
+            last = std::prev( last );
+        }
+        m_cached.erase( last->first );
+        m_cache.erase( last );
+    }
+}
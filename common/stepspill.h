@@ -0,0 +1,94 @@
+#pragma once
+
+/**
+ *  @class StepSpill
+ *  @brief Steps of a model run paged out to a temporary file.
+ *
+ *  Steps are appended to the file as step cache records (see stepcache.h) as
+ *  they arrive, and only a bounded number of decoded Tooth objects is kept in
+ *  memory. Steps not in memory are read back from the file when requested;
+ *  when the cache is full, the least recently used step is dropped.
+ *
+ *  Appending (model thread) and reading (GUI thread) use separate file
+ *  handles and locks, so reading a step doesn't wait for a step being
+ *  serialized and vice versa. The file is removed when the object is deleted.
+ */
+
+#include <string>
+#include <fstream>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <stdint.h>
+
+#include "tooth.h"
+
+#define STEPSPILL_EXT   ".tmspill"
+
+
+class StepSpill
+{
+public:
+    // Creates the spill file fname; keeps at most capacity steps in memory.
+    StepSpill( const std::string& fname, size_t capacity );
+    ~StepSpill();
+
+    // Returns true if the file is usable.
+    bool good()                             { return m_good; }
+
+    // Appends a step to the file and moves its contents to the cache; tooth
+    // is left empty. Returns EXIT_SUCCESS, or EXIT_FAILURE with tooth intact.
+    int write( Tooth& tooth );
+
+    // Returns step i, reading it from the file if not cached; nullptr if
+    // failed. The object stays valid until it is dropped from the cache, at
+    // least until the next call, even if steps are written meanwhile.
+    Tooth* read( int i );
+
+    // Reads step i into buffer without caching it.
+    Tooth* read( int i, Tooth& buffer );
+
+    // Returns the number of steps in the file.
+    int size();
+
+    // Set/get the maximum number of cached steps (at least 1).
+    void setCapacity( size_t n );
+    size_t getCapacity();
+
+    // Cache hit and miss counts of read(i).
+    uint64_t getHits()                      { return m_hits; }
+    uint64_t getMisses()                    { return m_misses; }
+
+    // Returns the number of bytes held by the cached steps.
+    size_t bytes();
+
+private:
+    int readRecord_( int i, Tooth& tooth );
+    void evict_();
+
+    std::string m_fname;
+    std::atomic<bool> m_good;
+
+    // Appending; m_records is read by readers under the same lock.
+    std::ofstream m_out;
+    uint64_t m_outPos;
+    std::vector<std::pair<uint64_t,uint64_t>> m_records; // offset, size
+    std::mutex m_outMtx;
+
+    // Reading.
+    std::ifstream m_in;
+    std::mutex m_inMtx;
+
+    // Decoded steps, most recently used first.
+    typedef std::list<std::pair<int,Tooth>> cache_list;
+    cache_list m_cache;
+    std::unordered_map<int,cache_list::iterator> m_cached;
+    size_t m_capacity;
+    int m_pinned;                       // step returned last by read()
+    std::mutex m_cacheMtx;
+
+    std::atomic<uint64_t> m_hits;
+    std::atomic<uint64_t> m_misses;
+};
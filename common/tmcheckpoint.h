@@ -0,0 +1,50 @@
+#ifndef TMCHECKPOINT_H
+#define TMCHECKPOINT_H
+
+/**
+ * @file tmcheckpoint.h
+ * @brief Checkpoint/restart protocol between model binaries and ToothMaker.
+ *
+ * ToothMaker creates a checkpoint folder into the run folder before starting
+ * a model and passes its path in the environment variable TMCHECKPOINT_ENV,
+ * and the checkpoint interval in iterations in TMCHECKPOINT_EVERY_ENV. Models
+ * that support checkpoints save their state at about that interval, after
+ * the output of a step has been written:
+ *
+ *   <folder>/<iter>.ckpt.part     written first, then renamed to
+ *   <folder>/<iter>.ckpt          complete checkpoint after iteration <iter>
+ *
+ * The rename marks the checkpoint complete; ToothMaker never reads a .part
+ * file. The model may remove its older checkpoints. The content is private
+ * to the model. If TMCHECKPOINT_FINAL_ENV is "1", the model also saves a
+ * checkpoint after its last iteration.
+ *
+ * If the model crashes or exits with an error, ToothMaker restarts it with
+ * the same command line followed by
+ *
+ *   --resume <checkpoint file>
+ *
+ * (arguments 5 and 6 for Humppa style input). The model then continues from
+ * the state after iteration <iter>, writing or publishing only the steps
+ * after it, and reports progress from <iter> on. Steps that ToothMaker has
+ * already read are not read again.
+ *
+ * Parameter scans share the iterations before a branch point between the
+ * scanned parameter sets: the base parameters are run once up to the branch
+ * iteration with a final checkpoint, and each parameter set is started with
+ *
+ *   --branch <checkpoint file>
+ *
+ * which continues from the checkpoint as --resume does, except that the
+ * model parameters are taken from the parameter file of the run, not from
+ * the checkpoint.
+ */
+
+#define TMCHECKPOINT_ENV        "TOOTHMAKER_CHECKPOINT"
+#define TMCHECKPOINT_EVERY_ENV  "TOOTHMAKER_CHECKPOINT_EVERY"
+#define TMCHECKPOINT_FINAL_ENV  "TOOTHMAKER_CHECKPOINT_FINAL"
+#define TMCHECKPOINT_EXT        ".ckpt"
+#define TMCHECKPOINT_RESUME     "--resume"
+#define TMCHECKPOINT_BRANCH     "--branch"
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef TMPROGRESS_H
+#define TMPROGRESS_H
+
+/**
+ * @file tmprogress.h
+ * @brief Progress reporting protocol between model binaries and ToothMaker.
+ *
+ * ToothMaker creates a small fixed-size file into the run folder before
+ * starting a model and passes its path in the environment variable
+ * TMPROGRESS_ENV. The model overwrites the iteration counter in place as it
+ * runs; ToothMaker maps the file to memory and reads the counter whenever
+ * it updates its progress display, so per-iteration progress costs the model
+ * at most one write to the page cache, without opening files or growing them.
+ *
+ * Layout (native byte order), TMPROGRESS_SIZE bytes:
+ *
+ *   offset  0  uint64_t magic      set by ToothMaker
+ *   offset  8  uint32_t version    set by ToothMaker
+ *   offset 12  uint32_t state      TMPROGRESS_NONE/RUNNING/DONE, set by the model
+ *   offset 16  uint64_t iter       iterations completed, set by the model
+ *   offset 24  uint64_t total      total iterations, 0 if unknown (optional)
+ *
+ * C/C++ models use the client library in models/utils/tmring, which maps the
+ * file; others may simply write the fields at their offsets, e.g. Fortran
+ * with access='stream' and write(unit, pos=17) followed by flush(unit).
+ * The counter is reported only once state is set to TMPROGRESS_RUNNING.
+ */
+
+#include "tmring.h"
+
+#define TMPROGRESS_ENV      "TOOTHMAKER_PROGRESS"
+#define TMPROGRESS_MAGIC    0x474f52504d54ULL   /* "TMPROG" */
+#define TMPROGRESS_VERSION  1
+#define TMPROGRESS_SIZE     64
+
+/* Model states */
+#define TMPROGRESS_NONE     0       /* not reporting (yet) */
+#define TMPROGRESS_RUNNING  1       /* counter is valid */
+#define TMPROGRESS_DONE     2       /* model has finished */
+
+typedef struct {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t state;
+    uint64_t iter;
+    uint64_t total;
+} tmprogress_header;
+
+#endif
@@ -0,0 +1,111 @@
+#ifndef TMRING_H
+#define TMRING_H
+
+/**
+ * @file tmring.h
+ * @brief Step streaming protocol between model binaries and ToothMaker.
+ *
+ * Models with output style 'Stream' publish their steps through a ring
+ * buffer in a file mapped to memory by both processes, instead of writing
+ * output files to be parsed. ToothMaker creates the file in the run folder
+ * before starting the model and passes its path in the environment variable
+ * TMRING_ENV. Models use the client library in models/utils/tmring; files
+ * may still be written for archival, they are exported with the run.
+ *
+ * Layout (native byte order, all offsets from the start of the file):
+ *
+ *   0                   tmring_header
+ *   TMRING_HEADER_SIZE  slot 0
+ *   ...                 slot i at TMRING_HEADER_SIZE + i*slot_size
+ *
+ * Each slot holds one step: a tmring_record followed by, back to back,
+ *
+ *   float    xyz[3*nvert]          vertex coordinates
+ *   float    rgba[4*nvert]         vertex colors, if ncolor == nvert
+ *   uint32_t sizes[npoly]          number of vertices of each polygon (3, 4)
+ *   uint32_t indices[nindex]       vertex indices of all polygons
+ *   float    data[ncell*ndata]     ndata values per cell (e.g. morphogen
+ *                                  concentrations), cell i at i*ndata
+ *
+ * There is one producer (the model) and one consumer (ToothMaker). The
+ * producer writes slot head % slot_count and then increments head; the
+ * consumer reads slot tail % slot_count and then increments tail. The ring
+ * is full when head-tail == slot_count, the producer then waits. Counters
+ * are accessed with the acquire/release helpers below.
+ *
+ * A step larger than a slot can't be published; the model should fall back
+ * to writing files.
+ *
+ * The step number is iteration/step size as in output file names. The view
+ * modes follow Humppa: vertex color alpha marks differentiated cells (0-0.6)
+ * and knots (>= 0.6), and cell i is the cell of vertex i.
+ */
+
+#include <stdint.h>
+
+#define TMRING_ENV          "TOOTHMAKER_RING"
+#define TMRING_MAGIC        0x474e49524d54ULL   /* "TMRING" */
+#define TMRING_VERSION      1
+#define TMRING_HEADER_SIZE  4096
+
+/* Producer states */
+#define TMRING_DETACHED     0       /* no producer yet */
+#define TMRING_ATTACHED     1       /* publishing */
+#define TMRING_DONE         2       /* all steps published */
+
+typedef struct {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t slot_count;
+    uint64_t slot_size;             /* bytes per slot, including the record */
+    uint64_t head;                  /* steps published (producer) */
+    uint64_t tail;                  /* steps consumed (consumer) */
+    uint32_t producer;              /* TMRING_DETACHED/ATTACHED/DONE */
+    uint32_t consumer_closed;       /* 1 if the consumer has gone */
+} tmring_header;
+
+typedef struct {
+    int32_t  step;
+    uint32_t nvert;
+    uint32_t ncolor;                /* 0 or nvert */
+    uint32_t npoly;
+    uint32_t nindex;
+    uint32_t ncell;
+    uint32_t ndata;
+    uint32_t reserved;
+    uint64_t bytes;                 /* record and its arrays */
+} tmring_record;
+
+
+/* Shared counters; the other process sees the data written before a
+   release store once it has loaded the counter with acquire. */
+static inline uint64_t tmring_load_( const uint64_t* p )
+{
+    return __atomic_load_n( p, __ATOMIC_ACQUIRE );
+}
+
+static inline void tmring_store_( uint64_t* p, uint64_t v )
+{
+    __atomic_store_n( p, v, __ATOMIC_RELEASE );
+}
+
+static inline uint32_t tmring_load32_( const uint32_t* p )
+{
+    return __atomic_load_n( p, __ATOMIC_ACQUIRE );
+}
+
+static inline void tmring_store32_( uint32_t* p, uint32_t v )
+{
+    __atomic_store_n( p, v, __ATOMIC_RELEASE );
+}
+
+/* Size of a record with its arrays. */
+static inline uint64_t tmring_record_bytes_( uint64_t nvert, uint64_t ncolor,
+                                             uint64_t npoly, uint64_t nindex,
+                                             uint64_t ncell, uint64_t ndata )
+{
+    return sizeof(tmring_record) + 4*(3*nvert + 4*ncolor + npoly + nindex
+                                      + ncell*ndata);
+}
+
+#endif
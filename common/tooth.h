@@ -10,7 +10,8 @@
  * Each Tooth object owns the following fields:
  * - Mesh for storing 3D geometry.
  * - Cell data vector for storing concentrations.
- * - Cell shape vector for storing cell boundary vertices.
+ * - Cell shape vector for storing cell boundary vertices of all cells back to
+ *   back, with offsets to the first vertex of each cell.
  *
  * All the above fields are filled independently, hence it is important to make
  * sure that e.g. the mesh vertex order corresponds to the cell data order.
@@ -19,6 +20,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <utility>
 
 #include "morphomaker.h"
 #include "parameters.h"
@@ -31,24 +33,38 @@ public:
 
     // Set a tooth for render type (RENDER_MESH, RENDER_PIXEL, RENDER_HUMPPA).
     Tooth( int type ) : m_toothType(type), m_dim(0,0)   {}
-    ~Tooth()    {}
 
-    // Add boundary vertices for cell i (RENDER_HUMPPA)
-    void add_cell_shape( uint32_t i, mesh::vertex& vert )
+    // Set boundary vertices of all cells at once (RENDER_HUMPPA). Vertices of
+    // cell i are verts[offsets[i]] ... verts[offsets[i+1]-1].
+    void set_cell_shapes( mesh::vertex_array& verts, std::vector<uint32_t>& offsets )
     {
-        if ( m_cellShapes.size() > i )
-            m_cellShapes.at(i).push_back( vert );
-        else {
-            std::vector<mesh::vertex> s = { vert };
-            m_cellShapes.push_back(s);
-        }
+        m_cellShapes.swap( verts );
+        m_cellShapeOffsets.swap( offsets );
     }
 
-    // Returns cell shapes (RENDER_HUMPPA)
-    std::vector<mesh::vertex_array>& get_cell_shapes()  { return m_cellShapes; }
+    // Returns the number of cell shapes (RENDER_HUMPPA)
+    uint32_t get_cell_shape_count()
+    {
+        return m_cellShapeOffsets.empty() ? 0 : m_cellShapeOffsets.size()-1;
+    }
+
+    // Returns boundary vertices of cell i (RENDER_HUMPPA)
+    mesh::array_view<mesh::vertex> get_cell_shape( uint32_t i )
+    {
+        if ( i+1 >= m_cellShapeOffsets.size() )
+            throw std::out_of_range("Tooth::get_cell_shape");
+        uint32_t begin = m_cellShapeOffsets[i];
+        return mesh::array_view<mesh::vertex>( m_cellShapes.data()+begin,
+                                               m_cellShapeOffsets[i+1]-begin );
+    }
+
+    // Returns boundary vertices of all cells and their offsets (RENDER_HUMPPA)
+    const mesh::vertex_array& get_cell_shape_vertices()     { return m_cellShapes; }
+    const std::vector<uint32_t>& get_cell_shape_offsets()   { return m_cellShapeOffsets; }
 
     // Set cell data (e.g., morphogen concentrations, RENDER_HUMPPA)
     void add_cell_data( std::vector<float>& data )      { m_cellData.push_back(data); }
+    void add_cell_data( std::vector<float>&& data )     { m_cellData.push_back(std::move(data)); }
     std::vector<std::vector<float>>& get_cell_data()    { return m_cellData; }
 
     // Set 2D domain dimensions (RENDER_PIXEL)
@@ -58,15 +74,39 @@ public:
     // Returns Tooth object type (RENDER_MESH, RENDER_PIXEL, RENDER_HUMPPA)
     int get_tooth_type()                                { return m_toothType; }
 
-    // Sets object mesh (RENDER_MESH)
-    void add_mesh( Mesh& m )                            { m_mesh = m; }
+    // Sets object mesh (RENDER_MESH); takes the contents of m.
+    void add_mesh( Mesh& m )                            { std::swap(m_mesh, m); }
     Mesh& get_mesh()                                    { return m_mesh; }
 
+    // Release unused capacity.
+    void shrink_to_fit()
+    {
+        m_mesh.shrink_to_fit();
+        m_cellData.shrink_to_fit();
+        for (auto& d : m_cellData)
+            d.shrink_to_fit();
+        m_cellShapes.shrink_to_fit();
+        m_cellShapeOffsets.shrink_to_fit();
+    }
+
+    // Returns the number of bytes held by the object.
+    size_t bytes()
+    {
+        size_t n = sizeof(Tooth) - sizeof(Mesh) + m_mesh.bytes();
+        n += m_cellData.capacity() * sizeof(std::vector<float>);
+        for (auto& d : m_cellData)
+            n += d.capacity() * sizeof(float);
+        n += m_cellShapes.capacity() * sizeof(mesh::vertex);
+        n += m_cellShapeOffsets.capacity() * sizeof(uint32_t);
+        return n;
+    }
+
 
 
 private:
     std::vector<std::vector<float>> m_cellData;     // morphogen concentrations for RENDER_HUMPPA
-    std::vector<mesh::vertex_array> m_cellShapes;   // cell boundaries for RENDER_HUMPPA
+    mesh::vertex_array m_cellShapes;                // cell boundaries for RENDER_HUMPPA
+    std::vector<uint32_t> m_cellShapeOffsets;       // cell i boundary start in m_cellShapes
     int m_toothType;                                // render mode
     std::pair<int,int> m_dim;                       // domain dimensions for RENDER_PIXEL
     Mesh m_mesh;                                    // mesh object for RENDER_MESH
@@ -0,0 +1,434 @@
+/**
+ *  @file toothdelta.cpp
+ *  @brief Encodes Tooth objects as differences to reference Tooth objects and
+ *         back.
+ *
+ */
+
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include <unordered_map>
+
+#include "toothdelta.h"
+
+
+namespace {
+
+const float delta_range_ = 32767.0f;
+
+
+/**
+ * @brief Stores quantised differences, either all of them or only the
+ *        non-zero ones with their indices.
+ */
+template <typename D>
+void put_diffs_( const std::vector<int32_t>& q, bool sparse,
+                 std::vector<uint32_t>& index, std::vector<D>& diff )
+{
+    if (!sparse) {
+        diff.assign( q.begin(), q.end() );
+        return;
+    }
+    for (size_t i=0; i<q.size(); i++) {
+        if (q[i] == 0) continue;
+        index.push_back( i );
+        diff.push_back( q[i] );
+    }
+}
+
+
+template <typename D>
+void add_diffs_( float* out, const std::vector<uint32_t>& index,
+                 const std::vector<D>& diff, float quantum )
+{
+    if (index.empty()) {
+        for (size_t i=0; i<diff.size(); i++)
+            out[i] += diff[i] * quantum;
+    }
+    else {
+        for (size_t i=0; i<diff.size(); i++)
+            out[index[i]] += diff[i] * quantum;
+    }
+}
+
+
+/**
+ * @brief Encodes the float values of cur as differences to ref.
+ *        T is float or a struct of floats (vertex, vertex_color).
+ */
+template <typename T>
+void encode_floats_( const std::vector<T>& ref, const std::vector<T>& cur,
+                     delta::float_array& d )
+{
+    const size_t k = sizeof(T)/sizeof(float);
+    const float* rf = reinterpret_cast<const float*>( ref.data() );
+    const float* cf = reinterpret_cast<const float*>( cur.data() );
+    const size_t n = cur.size()*k;
+    const size_t m = std::min( ref.size()*k, n );
+
+    float vmax = 0.0f;
+    for (size_t i=0; i<m; i++) {
+        if (std::isfinite(rf[i])) vmax = std::max( vmax, std::fabs(rf[i]) );
+        if (std::isfinite(cf[i])) vmax = std::max( vmax, std::fabs(cf[i]) );
+    }
+    d.size = n;
+    d.quantum = (vmax > 0.0f) ? vmax/delta_range_ : 1.0f;
+
+    // Quantise the differences. Values out of the 16-bit range (or not
+    // finite) are stored as such.
+    std::vector<int32_t> q( m, 0 );
+    std::vector<bool> exc( m, false );
+    size_t changed = 0, wide = 0;
+    for (size_t i=0; i<m; i++) {
+        if (cf[i] == rf[i]) continue;
+        float v = (cf[i]-rf[i]) / d.quantum;
+        if (!(std::fabs(v) <= delta_range_)) {
+            exc[i] = true;
+            continue;
+        }
+        q[i] = std::lround(v);
+        if (q[i] != 0) changed++;
+        if (std::abs(q[i]) > 127) wide++;
+    }
+
+    // Pick the smallest of 8/16-bit differences for all or only the changed
+    // values; with 8 bits the wider differences are stored as such.
+    const size_t exc_size = sizeof(uint32_t) + sizeof(float);
+    size_t dense16 = 2*m;
+    size_t dense8 = m + wide*exc_size;
+    size_t sparse16 = changed*(sizeof(uint32_t)+2);
+    size_t sparse8 = (changed-wide)*(sizeof(uint32_t)+1) + wide*exc_size;
+    size_t best = std::min( std::min(dense16, dense8), std::min(sparse16, sparse8) );
+    bool use8 = (best == dense8 || best == sparse8);
+    bool sparse = (best == sparse16 || best == sparse8);
+
+    for (size_t i=0; i<m; i++) {
+        if (use8 && std::abs(q[i]) > 127) {
+            exc[i] = true;
+            q[i] = 0;
+        }
+        if (!exc[i]) continue;
+        d.exc_index.push_back( i );
+        d.exc_value.push_back( cf[i] );
+    }
+
+    if (changed > 0) {
+        if (use8)
+            put_diffs_( q, sparse, d.index, d.diff8 );
+        else
+            put_diffs_( q, sparse, d.index, d.diff16 );
+    }
+    d.index.shrink_to_fit();
+    d.diff8.shrink_to_fit();
+    d.diff16.shrink_to_fit();
+    d.exc_index.shrink_to_fit();
+    d.exc_value.shrink_to_fit();
+
+    d.tail.assign( cf+m, cf+n );
+}
+
+
+/**
+ * @brief Reconstructs the float values encoded by encode_floats_().
+ */
+template <typename T>
+void decode_floats_( const std::vector<T>& ref, const delta::float_array& d,
+                     std::vector<T>& out )
+{
+    const size_t k = sizeof(T)/sizeof(float);
+    const float* rf = reinterpret_cast<const float*>( ref.data() );
+    const size_t m = std::min( ref.size()*k, size_t(d.size) );
+
+    out.resize( d.size/k );
+    float* of = reinterpret_cast<float*>( out.data() );
+    std::copy( rf, rf+m, of );
+
+    add_diffs_( of, d.index, d.diff8, d.quantum );
+    add_diffs_( of, d.index, d.diff16, d.quantum );
+    for (size_t i=0; i<d.exc_index.size(); i++)
+        of[d.exc_index[i]] = d.exc_value[i];
+
+    std::copy( d.tail.begin(), d.tail.end(), of+m );
+}
+
+
+/**
+ * @brief Encodes the values of cur that differ from ref.
+ */
+void encode_uints_( const std::vector<uint32_t>& ref,
+                    const std::vector<uint32_t>& cur, delta::uint_array& d )
+{
+    size_t m = std::min( ref.size(), cur.size() );
+    d.size = cur.size();
+    for (size_t i=0; i<m; i++) {
+        if (ref[i] == cur[i]) continue;
+        d.index.push_back( i );
+        d.value.push_back( cur[i] );
+    }
+    d.tail.assign( cur.begin()+m, cur.end() );
+}
+
+
+void decode_uints_( const std::vector<uint32_t>& ref,
+                    const delta::uint_array& d, std::vector<uint32_t>& out )
+{
+    size_t m = std::min( ref.size(), size_t(d.size) );
+    out.assign( ref.begin(), ref.begin()+m );
+    for (size_t i=0; i<d.index.size(); i++)
+        out[d.index[i]] = d.value[i];
+    out.insert( out.end(), d.tail.begin(), d.tail.end() );
+}
+
+
+uint64_t hash_( const mesh::array_view<uint32_t>& p )
+{
+    uint64_t h = 14695981039346656037ull;
+    for (auto i : p) {
+        h ^= i;
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+
+bool equal_( const mesh::array_view<uint32_t>& a,
+             const mesh::array_view<uint32_t>& b )
+{
+    return a.size() == b.size() && std::equal( a.begin(), a.end(), b.begin() );
+}
+
+
+/**
+ * @brief Encodes the polygons of cur as runs copied from ref and new polygons.
+ */
+void encode_polygons_( const mesh::polygon_list& ref,
+                       const mesh::polygon_list& cur, delta::polygon_array& d )
+{
+    std::unordered_map<uint64_t, uint32_t> lookup( ref.size() );
+    for (size_t j=0; j<ref.size(); j++)
+        lookup.emplace( hash_(ref[j]), j );
+
+    size_t i = 0;
+    while (i < cur.size()) {
+        auto it = lookup.find( hash_(cur[i]) );
+        if (it != lookup.end() && equal_( ref[it->second], cur[i] )) {
+            size_t j = it->second, n = 1;
+            while (i+n < cur.size() && j+n < ref.size()
+                   && equal_( ref[j+n], cur[i+n] ))
+                n++;
+            d.runs.push_back( j );
+            d.runs.push_back( n );
+            d.runs.push_back( 0 );
+            i += n;
+            continue;
+        }
+
+        if (d.runs.empty()) {
+            d.runs.assign( 3, 0 );
+        }
+        d.runs.back()++;
+        d.sizes.push_back( cur[i].size() );
+        d.indices.insert( d.indices.end(), cur[i].begin(), cur[i].end() );
+        i++;
+    }
+    d.runs.shrink_to_fit();
+    d.sizes.shrink_to_fit();
+    d.indices.shrink_to_fit();
+}
+
+
+void decode_polygons_( const mesh::polygon_list& ref,
+                       const delta::polygon_array& d, std::vector<uint32_t>& sizes,
+                       std::vector<uint32_t>& indices )
+{
+    size_t k = 0, pos = 0;
+    for (size_t r=0; r+2<d.runs.size(); r+=3) {
+        for (size_t j=d.runs[r]; j<d.runs[r]+d.runs[r+1]; j++) {
+            auto p = ref[j];
+            sizes.push_back( p.size() );
+            indices.insert( indices.end(), p.begin(), p.end() );
+        }
+        for (size_t j=0; j<d.runs[r+2]; j++, k++) {
+            auto it = d.indices.begin() + pos;
+            sizes.push_back( d.sizes[k] );
+            indices.insert( indices.end(), it, it+d.sizes[k] );
+            pos += d.sizes[k];
+        }
+    }
+}
+
+
+/**
+ * @brief Returns the number of bytes allocated by an encoded array.
+ */
+size_t bytes_( const delta::float_array& d )
+{
+    return (d.index.capacity() + d.exc_index.capacity())*sizeof(uint32_t)
+           + d.diff8.capacity() + d.diff16.capacity()*sizeof(int16_t)
+           + (d.exc_value.capacity() + d.tail.capacity())*sizeof(float);
+}
+
+
+size_t bytes_( const delta::uint_array& d )
+{
+    return (d.index.capacity() + d.value.capacity() + d.tail.capacity())
+           * sizeof(uint32_t);
+}
+
+
+size_t bytes_( const delta::polygon_array& d )
+{
+    return (d.runs.capacity() + d.sizes.capacity() + d.indices.capacity())
+           * sizeof(uint32_t);
+}
+
+
+/**
+ * @brief Cell data rows back to back and the size of each row.
+ */
+void flatten_( std::vector<std::vector<float>>& rows, std::vector<float>& values,
+               std::vector<uint32_t>& sizes )
+{
+    size_t n = 0;
+    for (auto& r : rows) n += r.size();
+    values.reserve( n );
+    sizes.reserve( rows.size() );
+    for (auto& r : rows) {
+        values.insert( values.end(), r.begin(), r.end() );
+        sizes.push_back( r.size() );
+    }
+}
+
+
+/**
+ * @brief Cell shape sizes from cell shape offsets.
+ */
+std::vector<uint32_t> shape_sizes_( const std::vector<uint32_t>& offsets )
+{
+    std::vector<uint32_t> sizes( offsets.size() ? offsets.size()-1 : 0 );
+    for (size_t i=0; i<sizes.size(); i++)
+        sizes[i] = offsets[i+1] - offsets[i];
+    return sizes;
+}
+
+}
+
+
+
+/**
+ * @brief Encodes tooth as a difference to ref.
+ * @param ref       Reference; must be kept unchanged for apply().
+ * @param tooth     Tooth object to encode.
+ */
+ToothDelta::ToothDelta( Tooth& ref, Tooth& tooth )
+{
+    m_toothType = tooth.get_tooth_type();
+    m_dim = tooth.get_domain_dim();
+
+    Mesh& rm = ref.get_mesh();
+    Mesh& m = tooth.get_mesh();
+    encode_floats_( rm.get_vertices(), m.get_vertices(), m_vertices );
+    encode_floats_( rm.get_vertex_colors(0), m.get_vertex_colors(0), m_colors );
+    encode_floats_( rm.get_vertex_colors(1), m.get_vertex_colors(1), m_altColors );
+    encode_polygons_( rm.get_polygons(), m.get_polygons(), m_polygons );
+
+    const mesh::property_column empty;
+    m_properties.resize( m.get_property_count() );
+    for (size_t j=0; j<m_properties.size(); j++) {
+        auto& rc = (j < rm.get_property_count()) ? rm.get_property_column(j) : empty;
+        encode_floats_( rc, m.get_property_column(j), m_properties[j] );
+    }
+
+    std::vector<float> ref_data, data;
+    std::vector<uint32_t> ref_sizes, sizes;
+    flatten_( ref.get_cell_data(), ref_data, ref_sizes );
+    flatten_( tooth.get_cell_data(), data, sizes );
+    encode_uints_( ref_sizes, sizes, m_cellDataSizes );
+    encode_floats_( ref_data, data, m_cellData );
+
+    encode_uints_( shape_sizes_( ref.get_cell_shape_offsets() ),
+                   shape_sizes_( tooth.get_cell_shape_offsets() ),
+                   m_cellShapeSizes );
+    encode_floats_( ref.get_cell_shape_vertices(), tooth.get_cell_shape_vertices(),
+                    m_cellShapes );
+}
+
+
+
+/**
+ * @brief Reconstructs the encoded Tooth object.
+ * @param ref       Reference given to the constructor.
+ * @param out       Output; overwritten. Must not be ref.
+ */
+void ToothDelta::apply( Tooth& ref, Tooth& out ) const
+{
+    out = Tooth( m_toothType );
+    out.set_domain_dim( m_dim.first, m_dim.second );
+
+    Mesh& rm = ref.get_mesh();
+    Mesh mesh;
+    mesh::vertex_array vertices;
+    decode_floats_( rm.get_vertices(), m_vertices, vertices );
+    mesh.set_vectices( vertices );
+
+    mesh::color_array colors, alt_colors;
+    decode_floats_( rm.get_vertex_colors(0), m_colors, colors );
+    decode_floats_( rm.get_vertex_colors(1), m_altColors, alt_colors );
+    mesh.set_vertex_colors( colors );
+    mesh.set_alt_colors( alt_colors );
+
+    std::vector<uint32_t> sizes, indices;
+    decode_polygons_( rm.get_polygons(), m_polygons, sizes, indices );
+    mesh.set_polygons( sizes, indices );
+
+    const mesh::property_column empty;
+    std::vector<mesh::property_column> columns( m_properties.size() );
+    for (size_t j=0; j<columns.size(); j++) {
+        auto& rc = (j < rm.get_property_count()) ? rm.get_property_column(j) : empty;
+        decode_floats_( rc, m_properties[j], columns[j] );
+    }
+    mesh.set_property_columns( columns );
+    out.add_mesh( mesh );
+
+    std::vector<float> ref_data, data;
+    std::vector<uint32_t> ref_sizes, data_sizes;
+    flatten_( ref.get_cell_data(), ref_data, ref_sizes );
+    decode_uints_( ref_sizes, m_cellDataSizes, data_sizes );
+    decode_floats_( ref_data, m_cellData, data );
+    size_t pos = 0;
+    for (auto n : data_sizes) {
+        out.add_cell_data( std::vector<float>( data.begin()+pos, data.begin()+pos+n ) );
+        pos += n;
+    }
+
+    std::vector<uint32_t> shape_sizes, shape_offsets;
+    decode_uints_( shape_sizes_( ref.get_cell_shape_offsets() ), m_cellShapeSizes,
+                   shape_sizes );
+    if (!shape_sizes.empty()) {
+        shape_offsets.resize( shape_sizes.size()+1, 0 );
+        for (size_t i=0; i<shape_sizes.size(); i++)
+            shape_offsets[i+1] = shape_offsets[i] + shape_sizes[i];
+    }
+    mesh::vertex_array shapes;
+    decode_floats_( ref.get_cell_shape_vertices(), m_cellShapes, shapes );
+    out.set_cell_shapes( shapes, shape_offsets );
+}
+
+
+
+/**
+ * @brief Returns the number of bytes held by the object.
+ */
+size_t ToothDelta::bytes() const
+{
+    size_t n = sizeof(ToothDelta);
+    n += bytes_(m_vertices) + bytes_(m_colors) + bytes_(m_altColors);
+    n += bytes_(m_polygons);
+    n += m_properties.capacity() * sizeof(delta::float_array);
+    for (auto& p : m_properties)
+        n += bytes_(p);
+    n += bytes_(m_cellDataSizes) + bytes_(m_cellData);
+    n += bytes_(m_cellShapeSizes) + bytes_(m_cellShapes);
+    return n;
+}
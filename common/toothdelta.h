@@ -0,0 +1,96 @@
+#pragma once
+
+/**
+ *  @class ToothDelta
+ *  @brief Tooth object stored as a difference to a reference Tooth.
+ *
+ *  Consecutive steps of a model run share most of their topology and their
+ *  values change only slightly. A ToothDelta stores a step relative to another
+ *  step of the same run (usually the previous one):
+ *
+ *  - Float data (vertices, colors, properties, cell data, cell shapes) is
+ *    stored as quantised differences to the reference values, 8 or 16 bits
+ *    per value, or only the values that changed if that is smaller. The
+ *    quantisation step is the largest absolute value of the array / 32767.
+ *    Values that can't be quantised, and values past the end of the reference
+ *    array, are stored as such.
+ *  - Polygons are stored as runs of polygons copied from the reference and
+ *    the polygons not found in the reference.
+ *  - Other index data (cell shape sizes, cell data sizes) is stored as the
+ *    values that differ from the reference.
+ *
+ *  The step is reconstructed with apply(). Since values are quantised, the
+ *  reconstruction differs from the encoded Tooth by at most half the
+ *  quantisation step.
+ */
+
+#include <vector>
+#include <utility>
+#include <stdint.h>
+
+#include "tooth.h"
+
+
+namespace delta {
+
+// Float array as quantised differences to a reference array.
+struct float_array {
+    uint32_t size = 0;                  // number of values
+    float quantum = 1.0f;               // quantisation step
+    std::vector<uint32_t> index;        // changed values; empty if all stored
+    std::vector<int8_t> diff8;          // quantised differences, either 8 bit
+    std::vector<int16_t> diff16;        // or 16 bit
+    std::vector<uint32_t> exc_index;    // values stored as such
+    std::vector<float> exc_value;
+    std::vector<float> tail;            // values past the reference array
+};
+
+// Index array as the values that differ from a reference array.
+struct uint_array {
+    uint32_t size = 0;
+    std::vector<uint32_t> index;
+    std::vector<uint32_t> value;
+    std::vector<uint32_t> tail;         // values past the reference array
+};
+
+// Polygons as runs copied from the reference list and new polygons. Each run
+// is three values: first reference polygon, number of polygons copied and
+// number of new polygons that follow.
+struct polygon_array {
+    std::vector<uint32_t> runs;
+    std::vector<uint32_t> sizes;        // sizes of the new polygons
+    std::vector<uint32_t> indices;      // vertex indices of the new polygons
+};
+
+}   // END namespace
+
+
+
+class ToothDelta
+{
+public:
+    // Encode tooth as a difference to ref.
+    ToothDelta( Tooth& ref, Tooth& tooth );
+
+    // Reconstruct the tooth into out from the reference it was encoded with.
+    void apply( Tooth& ref, Tooth& out ) const;
+
+    // Returns the number of bytes held by the object.
+    size_t bytes() const;
+
+private:
+    int m_toothType;
+    std::pair<int,int> m_dim;
+
+    delta::float_array m_vertices;
+    delta::float_array m_colors;
+    delta::float_array m_altColors;
+    delta::polygon_array m_polygons;
+    std::vector<delta::float_array> m_properties;
+
+    delta::uint_array m_cellDataSizes;
+    delta::float_array m_cellData;
+
+    delta::uint_array m_cellShapeSizes;
+    delta::float_array m_cellShapes;
+};
@@ -7,11 +7,31 @@
  * A model run consists of model parameters, a set of Tooth objects (one per
  * step) and a run ID to distinguish between ToothLife objects.
  *
+ * Tooth objects are allocated from a per-run pool with newTooth() and owned by
+ * the ToothLife; they are all released at once when the run is deleted or
+ * cleared. bytes() reports the memory held by the run.
+ *
+ * Optionally (setDeltaEncoding()) only every n-th step is stored as such
+ * (keyframe) and the steps in between as ToothDelta's relative to the
+ * previous step. Those steps are reconstructed from the keyframe when
+ * requested with getTooth(). The deltas are lossy; finish() stores the last
+ * step exactly, and setStepCache() writes the exact steps to a step cache
+ * file as they are added.
+ *
+ * Alternatively (setSpill()) all steps are paged out to a temporary file as
+ * they are added and only the most recently used steps are kept in memory
+ * (see StepSpill); delta encoding is not used then.
+ *
  */
 
 #include <vector>
+#include <deque>
+#include <memory>
 #include <mutex>
 #include "tooth.h"
+#include "toothdelta.h"
+#include "stepspill.h"
+#include "stepcache.h"
 #include "parameters.h"
 
 
@@ -20,7 +40,10 @@ class ToothLife
 
 public:
     // Construct Tooth for model i with run ID j.
-    ToothLife( int i=0, int j=0 ) : m_parameters(nullptr)
+    ToothLife( int i=0, int j=0 ) : m_parameters(nullptr), m_bytes(0),
+                                    m_keyInterval(0), m_ref(nullptr),
+                                    m_refBytes(0), m_last(nullptr),
+                                    m_lastBytes(0), m_view(0), m_viewIndex(-1)
     {
         m_currentModel = i;
         m_id = j;
@@ -28,9 +51,7 @@ public:
 
     ~ToothLife()
     {
-        for (size_t i=0; i<m_teeth.size(); i++)
-            delete m_teeth.at(i);
-        m_teeth.clear();
+        clear();
         if (m_parameters != nullptr)
             delete m_parameters;
     }
@@ -46,26 +67,258 @@ public:
     // Get current model parameters.
     Parameters *getParameters()             { return m_parameters; }
 
-    // Add a tooth object.
+    // Allocate a tooth object for render type 'type' from the run's pool.
+    // The object is owned by ToothLife; pass it to addTooth() when filled or
+    // to discardTooth() if it won't be used.
+    Tooth *newTooth( int type )
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        return newTooth_(type);
+    }
+
+    // Store every n-th step as such (keyframe) and the others as differences
+    // to the previous step; n=0 stores all steps as such (default). Must be
+    // set before adding tooth objects.
+    void setDeltaEncoding( int n )
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        if (m_teeth.empty())
+            m_keyInterval = n;
+    }
+
+    // Page steps out to file fname, keeping at most capacity steps in memory.
+    // Must be set before adding tooth objects. Returns false if the file
+    // can't be created; the steps are then kept in memory.
+    bool setSpill( const std::string& fname, size_t capacity )
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        if (!m_teeth.empty())
+            return false;
+        m_spill.reset( new StepSpill( fname, capacity ) );
+        if (!m_spill->good()) {
+            m_spill.reset();
+            return false;
+        }
+        m_keyInterval = 0;
+        m_cache.reset();
+        return true;
+    }
+
+    // Write the steps to step cache file fname as they are added, before
+    // delta encoding, so that the file is exact; see finishStepCache(). Must
+    // be set before adding tooth objects. Returns false if paging out (the
+    // cache is then written from the spill file) or if the file can't be
+    // created; the steps are then stored without delta encoding.
+    bool setStepCache( const std::string& fname, int stepsize )
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        if (!m_teeth.empty() || m_spill)
+            return false;
+        m_cache.reset( new StepCacheWriter( fname, m_currentModel, m_id,
+                                            stepsize, m_parameters ) );
+        if (!m_cache->good()) {
+            m_cache.reset();
+            m_keyInterval = 0;
+            return false;
+        }
+        return true;
+    }
+
+    // Returns true if the steps are written to a step cache file.
+    bool hasStepCache()
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        return m_cache != nullptr;
+    }
+
+    // Complete the step cache file, under fname if given. Call when no more
+    // steps will be added. Returns EXIT_SUCCESS, EXIT_FAILURE.
+    int finishStepCache( const std::string& fname="" )
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        if (!m_cache)
+            return EXIT_FAILURE;
+        return m_cache->finish( fname );
+    }
+
+    // Set/get the number of paged out steps kept in memory.
+    void setCacheCapacity( size_t n )       { if (m_spill) m_spill->setCapacity(n); }
+    size_t getCacheCapacity()               { return m_spill ? m_spill->getCapacity() : 0; }
+
+    // Number of requests for paged out steps served from memory (hits) and
+    // read from the file (misses).
+    uint64_t getCacheHits()                 { return m_spill ? m_spill->getHits() : 0; }
+    uint64_t getCacheMisses()               { return m_spill ? m_spill->getMisses() : 0; }
+
+    // Add a tooth object allocated with newTooth(); it must not be modified
+    // afterwards. With delta encoding or paging the object may be reused by
+    // ToothLife.
     void addTooth( Tooth *tooth )
+    {
+        tooth->shrink_to_fit();
+        std::unique_lock<std::mutex> lock(m_mtx);
+        if (m_cache) {
+            // Steps are added by one thread at a time; a failed write makes
+            // finishStepCache() fail.
+            StepCacheWriter *cache = m_cache.get();
+            lock.unlock();
+            cache->append( *tooth );
+            lock.lock();
+        }
+        if (m_spill) {
+            // Serializing takes long; the spill has locks of its own.
+            StepSpill *spill = m_spill.get();
+            lock.unlock();
+            int rv = spill->write( *tooth );
+            lock.lock();
+            if (rv == EXIT_SUCCESS) {
+                m_teeth.push_back(nullptr);
+                m_spares.push_back(tooth);
+                return;
+            }
+            // Writing failed, keep the step in memory.
+        }
+
+        size_t i = m_teeth.size();
+        if (m_keyInterval <= 0 || i % m_keyInterval == 0 || m_ref == nullptr) {
+            // The next step is encoded against a copy: the stored step may be
+            // modified for viewing (see Model::fill_mesh()).
+            Tooth *ref = nullptr;
+            if (m_keyInterval > 0) {
+                ref = newTooth_(0);
+                lock.unlock();
+                *ref = *tooth;
+                lock.lock();
+            }
+            m_teeth.push_back(tooth);
+            m_bytes += tooth->bytes();
+            setReference_( ref );
+            setLast_( nullptr );
+            return;
+        }
+
+        // Encode as a difference to the previous step; the reconstruction is
+        // the reference of the next step. Both references are private to
+        // ToothLife and only used by the adding thread.
+        Tooth *ref = m_ref;
+        Tooth *rec = newTooth_(0);
+        lock.unlock();
+        ToothDelta *delta = new ToothDelta( *ref, *tooth );
+        delta->apply( *ref, *rec );
+        lock.lock();
+
+        m_teeth.push_back(nullptr);
+        m_deltas.resize(i+1);
+        m_deltas.back().reset(delta);
+        m_bytes += delta->bytes();
+        setReference_( rec );
+        setLast_( tooth );
+    }
+
+    // Store the last step as such if it was delta-encoded, so that the final
+    // state of the run is exact. Call when the run has ended; a step added
+    // afterwards is stored as a keyframe.
+    void finish()
     {
         std::lock_guard<std::mutex> lock(m_mtx);
-        m_teeth.push_back(tooth);
+        if (m_last != nullptr) {
+            size_t i = m_teeth.size()-1;
+            m_bytes -= m_deltas.at(i)->bytes();
+            m_deltas.at(i).reset();
+            m_teeth.at(i) = m_last;
+            m_bytes += m_lastBytes;
+            m_last = nullptr;
+            m_lastBytes = 0;
+            if (m_viewIndex == (int)i)
+                m_viewIndex = -1;
+        }
+        setReference_( nullptr );
     }
 
-    // Get a tooth object by index.
-    Tooth *getTooth( int i )
+    // Return an unused tooth object allocated with newTooth() to the pool.
+    void discardTooth( Tooth *tooth )
     {
         std::lock_guard<std::mutex> lock(m_mtx);
-        if (i>=0 && i<(int)(m_teeth.size()))
+        *tooth = Tooth( tooth->get_tooth_type() );
+        m_spares.push_back(tooth);
+    }
+
+    // Remove all tooth objects, releasing their memory.
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_teeth.clear();
+        m_deltas.clear();
+        m_pool.clear();
+        m_spares.clear();
+        m_spill.reset();
+        m_cache.reset();
+        m_ref = nullptr;
+        m_refBytes = 0;
+        m_last = nullptr;
+        m_lastBytes = 0;
+        m_bytes = 0;
+        m_view = Tooth(0);
+        m_viewIndex = -1;
+    }
+
+    // Return the number of bytes held in memory by the tooth objects.
+    size_t bytes()
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        return m_bytes + m_refBytes + m_lastBytes
+               + (m_spill ? m_spill->bytes() : 0);
+    }
+
+    // Get a tooth object by index. A delta-encoded step is reconstructed into
+    // an object that stays valid until another delta-encoded step is
+    // requested; a paged out step is valid until dropped from memory, at
+    // least until the next request.
+    Tooth *getTooth( int i )
+    {
+        std::unique_lock<std::mutex> lock(m_mtx);
+        if (i<0 || i>=(int)(m_teeth.size()))
+            return nullptr;
+        if (m_teeth.at(i) != nullptr)
+            return m_teeth.at(i);
+        if (m_spill) {
+            StepSpill *spill = m_spill.get();
+            lock.unlock();
+            return spill->read( i );
+        }
+        if (m_viewIndex != i) {
+            decodeTooth_( i, m_view, m_viewIndex );
+            m_viewIndex = i;
+        }
+        return &m_view;
+    }
+
+    // Get a tooth object by index. A delta-encoded or paged out step is
+    // reconstructed into buffer.
+    Tooth *getTooth( int i, Tooth& buffer )
+    {
+        std::unique_lock<std::mutex> lock(m_mtx);
+        if (i<0 || i>=(int)(m_teeth.size()))
+            return nullptr;
+        if (m_teeth.at(i) != nullptr)
             return m_teeth.at(i);
-        return nullptr;
+        if (m_spill) {
+            StepSpill *spill = m_spill.get();
+            lock.unlock();
+            return spill->read( i, buffer );
+        }
+        return decodeTooth_( i, buffer, -1 );
     }
 
     // Return the number of tooth objects.
-    int getLifeSize()                       { return m_teeth.size(); }
+    int getLifeSize()
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        return m_teeth.size();
+    }
 
-    // Get model index.
+    // Set/get model index.
+    void setCurrentModel( int i )           { m_currentModel = i; }
     int getCurrentModel()                   { return m_currentModel; }
 
     // Get model run ID.
@@ -74,9 +327,81 @@ public:
 
 
 private:
+    // Allocate a tooth object from the pool; the caller holds the lock.
+    Tooth *newTooth_( int type )
+    {
+        if (!m_spares.empty()) {
+            Tooth *tooth = m_spares.back();
+            m_spares.pop_back();
+            *tooth = Tooth(type);
+            return tooth;
+        }
+        m_pool.emplace_back(type);
+        return &m_pool.back();
+    }
+
+    // Set the reference of the next delta-encoded step, an object not stored
+    // as a step; the previous one is returned to the pool.
+    void setReference_( Tooth *tooth )
+    {
+        if (m_ref != nullptr) {
+            *m_ref = Tooth(0);
+            m_spares.push_back(m_ref);
+        }
+        m_ref = tooth;
+        m_refBytes = (tooth != nullptr) ? tooth->bytes() : 0;
+    }
+
+    // Keep the exact object of the last step if it was delta-encoded, for
+    // finish(); the previous one is returned to the pool.
+    void setLast_( Tooth *tooth )
+    {
+        if (m_last != nullptr) {
+            *m_last = Tooth(0);
+            m_spares.push_back(m_last);
+        }
+        m_last = tooth;
+        m_lastBytes = (tooth != nullptr) ? tooth->bytes() : 0;
+    }
+
+    // Reconstruct delta-encoded step i into out by applying the deltas from
+    // the previous stored step on. If out holds step 'from' after it
+    // (from<i), starts from there.
+    Tooth *decodeTooth_( int i, Tooth& out, int from )
+    {
+        int key = i;
+        while (m_teeth.at(key) == nullptr)
+            key--;
+        Tooth *prev = m_teeth.at(key);
+        if (from > key && from < i) {
+            prev = &out;
+            key = from;
+        }
+        Tooth tmp(0);
+        for (int j=key+1; j<=i; j++) {
+            m_deltas.at(j)->apply( *prev, tmp );
+            std::swap( out, tmp );
+            prev = &out;
+        }
+        return &out;
+    }
+
     Parameters* m_parameters;           // model parameters
     unsigned int m_currentModel;        // model index
     std::vector<Tooth*> m_teeth;        // vector of model states
+    std::deque<Tooth> m_pool;           // storage of the model states
+    std::vector<Tooth*> m_spares;       // unused objects in m_pool
+    size_t m_bytes;                     // bytes held by m_teeth, m_deltas
+    int m_keyInterval;                  // keyframe interval, 0 if no deltas
+    std::vector<std::unique_ptr<ToothDelta>> m_deltas;  // delta-encoded steps
+    Tooth* m_ref;                       // reference of the next delta
+    size_t m_refBytes;                  // bytes of m_ref
+    Tooth* m_last;                      // last step if delta-encoded
+    size_t m_lastBytes;                 // bytes of m_last
+    std::unique_ptr<StepSpill> m_spill; // paged out steps, if any
+    std::unique_ptr<StepCacheWriter> m_cache;   // step cache being written
+    Tooth m_view;                       // last reconstructed step
+    int m_viewIndex;                    // index of m_view, -1 if none
     int m_id;                           // model run ID
     std::mutex m_mtx;
 };
@@ -0,0 +1,234 @@
+/**
+ *  @file writemesh.cpp
+ *  @brief Writes mesh data in formats understood by the readers in readdata.cpp.
+ *
+ */
+
+#include <fstream>
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <limits>
+
+#include "morphomaker.h"
+#include "mesh.h"
+#include "writemesh.h"
+
+
+namespace {
+
+/**
+ * @brief Returns true if the host stores numbers in little endian byte order.
+ */
+bool host_little_endian_()
+{
+    const uint16_t i = 1;
+    char c;
+    memcpy(&c, &i, 1);
+    return c == 1;
+}
+
+
+/**
+ * @brief Appends a value to a byte buffer in little endian byte order.
+ * @param buf       Output buffer.
+ * @param v         Value.
+ */
+template <typename T>
+void put_le_( std::vector<char>& buf, T v )
+{
+    char b[sizeof(T)];
+    memcpy(b, &v, sizeof(T));
+    if (!host_little_endian_()) {
+        std::reverse(b, b+sizeof(T));
+    }
+    buf.insert(buf.end(), b, b+sizeof(T));
+}
+
+
+/**
+ * @brief Converts a color component in range [0,1] to uchar.
+ */
+uint8_t color_byte_( float c )
+{
+    if (c <= 0.0) return 0;
+    if (c >= 1.0) return 255;
+    return (uint8_t)(c*255.0 + 0.5);
+}
+
+}
+
+
+
+/**
+ * @brief Writes mesh into a PLY file.
+ *
+ * Writes vertices (x, y, z as floats, vertex colors as RGBA uchars), polygons
+ * (uint vertex counts, so any polygon size) and mesh properties as
+ * 'concentrations' element with one float per property. ASCII floats are
+ * written with enough digits to be read back exactly with Read_PLY_file().
+ *
+ * The binary format is binary_little_endian. The whole file is assembled in
+ * memory and written out with a single write.
+ *
+ * @param fname     File name.
+ * @param mesh      Mesh object.
+ * @param binary    If true writes binary PLY, else ascii.
+ * @return          EXIT_SUCCESS, EXIT_FAILURE.
+ */
+int morphomaker::Write_PLY_file( const std::string& fname, Mesh& mesh,
+                                 bool binary )
+{
+    std::ofstream out(fname, std::ios::out | std::ios::binary);
+    if (!out.good()) {
+        std::cerr << "Error: Cannot open file '" << fname << "' for writing."
+                  << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    auto& vertices = mesh.get_vertices();
+    // Readers keep the colors given in the file as the alternative set, so
+    // prefer those over the primary colors if available.
+    auto& colors = mesh.get_vertex_colors(1).size() == vertices.size() ?
+                   mesh.get_vertex_colors(1) : mesh.get_vertex_colors();
+    auto& polygons = mesh.get_polygons();
+
+    // Properties are stored per vertex; all vertices must have them.
+    size_t n_prop = mesh.get_property_count();
+    if (n_prop > 0 && mesh.get_property_column(0).size() != vertices.size()) {
+        n_prop = 0;
+    }
+    std::vector<const float*> columns;
+    for (size_t j=0; j<n_prop; j++) {
+        columns.push_back( mesh.get_property_column(j).data() );
+    }
+
+    out << "ply" << "\n";
+    out << "format " << (binary ? "binary_little_endian" : "ascii") << " 1.0\n";
+    out << "comment Generated by " << PROGRAM_NAME << "\n";
+    out << "element vertex " << vertices.size() << "\n";
+    out << "property float x\n" << "property float y\n" << "property float z\n";
+    out << "property uchar red\n" << "property uchar green\n"
+        << "property uchar blue\n" << "property uchar alpha\n";
+    out << "element face " << polygons.size() << "\n";
+    out << "property list uint int vertex_indices\n";
+    if (n_prop > 0) {
+        out << "element concentrations " << vertices.size() << "\n";
+        for (size_t i=0; i<n_prop; i++) {
+            out << "property float c" << i << "\n";
+        }
+    }
+    out << "end_header\n";
+
+    mesh::vertex_color black = { 0.0, 0.0, 0.0, 1.0 };
+
+    if (!binary) {
+        out.precision( std::numeric_limits<float>::max_digits10 );
+        for (size_t i=0; i<vertices.size(); i++) {
+            auto& c = colors.size() > i ? colors.at(i) : black;
+            out << vertices.at(i).x << " " << vertices.at(i).y << " "
+                << vertices.at(i).z << " " << (int)color_byte_(c.r) << " "
+                << (int)color_byte_(c.g) << " " << (int)color_byte_(c.b) << " "
+                << (int)color_byte_(c.a) << "\n";
+        }
+        for (auto& p : polygons) {
+            out << p.size();
+            for (auto i : p) out << " " << i;
+            out << "\n";
+        }
+        for (size_t i=0; n_prop>0 && i<vertices.size(); i++) {
+            for (size_t j=0; j<n_prop; j++) {
+                out << (j ? " " : "") << columns[j][i];
+            }
+            out << "\n";
+        }
+        out.close();
+        return out.good() ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    size_t n_indices = polygons.get_indices().size();
+
+    std::vector<char> buf;
+    buf.reserve( vertices.size()*(16 + 4*n_prop) + (polygons.size() + n_indices)*4 );
+
+    for (size_t i=0; i<vertices.size(); i++) {
+        auto& c = colors.size() > i ? colors.at(i) : black;
+        put_le_<float>( buf, vertices.at(i).x );
+        put_le_<float>( buf, vertices.at(i).y );
+        put_le_<float>( buf, vertices.at(i).z );
+        put_le_<uint8_t>( buf, color_byte_(c.r) );
+        put_le_<uint8_t>( buf, color_byte_(c.g) );
+        put_le_<uint8_t>( buf, color_byte_(c.b) );
+        put_le_<uint8_t>( buf, color_byte_(c.a) );
+    }
+
+    for (auto& p : polygons) {
+        put_le_<uint32_t>( buf, p.size() );
+        for (auto i : p) put_le_<int32_t>( buf, i );
+    }
+
+    for (size_t i=0; n_prop>0 && i<vertices.size(); i++) {
+        for (size_t j=0; j<n_prop; j++) {
+            put_le_<float>( buf, columns[j][i] );
+        }
+    }
+
+    out.write( buf.data(), buf.size() );
+    out.close();
+
+    return out.good() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+
+/**
+ * @brief Writes mesh into a COFF file.
+ *
+ * Writes vertices with RGBA vertex colors and polygons; coordinates are
+ * written with enough digits to be read back exactly with Read_OFF_file().
+ *
+ * @param fname     File name.
+ * @param mesh      Mesh object.
+ * @param comment   Comment line(s) written before the header, if any.
+ * @return          EXIT_SUCCESS, EXIT_FAILURE.
+ */
+int morphomaker::Write_OFF_file( const std::string& fname, Mesh& mesh,
+                                 const std::string& comment )
+{
+    std::ofstream out(fname);
+    if (!out.good()) {
+        std::cerr << "Error: Cannot open file '" << fname << "' for writing."
+                  << std::endl;
+        return EXIT_FAILURE;
+    }
+    out.precision( std::numeric_limits<float>::max_digits10 );
+
+    auto& vertices = mesh.get_vertices();
+    auto& colors = mesh.get_vertex_colors(1).size() == vertices.size() ?
+                   mesh.get_vertex_colors(1) : mesh.get_vertex_colors();
+    auto& polygons = mesh.get_polygons();
+
+    if (!comment.empty()) {
+        out << "# " << comment << "\n";
+    }
+    out << "COFF\n";
+    out << vertices.size() << " " << polygons.size() << " " << vertices.size()
+        << "\n";
+
+    mesh::vertex_color black = { 0.0, 0.0, 0.0, 1.0 };
+    for (size_t i=0; i<vertices.size(); i++) {
+        auto& c = colors.size() > i ? colors.at(i) : black;
+        out << vertices.at(i).x << " " << vertices.at(i).y << " "
+            << vertices.at(i).z << " " << c.r << " " << c.g << " " << c.b
+            << " " << c.a << "\n";
+    }
+    for (auto& p : polygons) {
+        out << p.size();
+        for (auto i : p) out << " " << i;
+        out << "\n";
+    }
+
+    out.close();
+    return out.good() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <string>
+#include "mesh.h"
+
+namespace morphomaker {
+
+int Write_PLY_file( const std::string&, Mesh&, bool binary=true );
+int Write_OFF_file( const std::string&, Mesh&, const std::string& comment="" );
+
+}
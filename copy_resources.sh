@@ -88,11 +88,14 @@ dir_exists models/utils
 printf "\n** Copying model utilities.\n"
 for d in models/utils/*/; do
     if [ -d $d ]; then
-        # Assume the binary name matches with the folder name.
+        # Assume the binary name matches with the folder name; libraries
+        # (e.g. tmring) have no binary.
         fname=`echo $d | cut -d'/' -f 3`
-        cmd='cp '$d''$fname' '$RESOURCES'bin/'
-        echo $cmd
-        $cmd
+        if [ -f $d$fname ]; then
+            cmd='cp '$d''$fname' '$RESOURCES'bin/'
+            echo $cmd
+            $cmd
+        fi
     fi
 done
 
@@ -13,11 +13,19 @@ SOURCES += \
     src/gui/parameterwindow.cpp \
     src/gui/scanwindow.cpp \
     src/misc/binaryhandler.cpp \
+    src/misc/outputwatcher.cpp \
+    src/misc/workspace.cpp \
+    src/misc/builtinparsers.cpp \
+    src/misc/parsepipeline.cpp \
+    src/misc/stepstream.cpp \
     src/main.cpp \
     src/gui/hampu.cpp \
     src/gui/glwidget.cpp \
     src/gui/controlpanel.cpp \
     src/misc/scanlist.cpp \
+    src/misc/jobledger.cpp \
+    src/misc/resultstore.cpp \
+    src/misc/leasequeue.cpp \
     src/cli/cmdappcore.cpp \
     src/cli/glengine.cpp \
     src/utils/writeparameters.cpp \
@@ -30,6 +38,10 @@ SOURCES += \
     ../common/parameters.cpp \
     ../common/colormap.cpp \
     ../common/readdata.cpp \
+    ../common/writemesh.cpp \
+    ../common/stepcache.cpp \
+    ../common/stepspill.cpp \
+    ../common/toothdelta.cpp \
     src/renderer/gl_modern.cpp \
     src/renderer/gl_legacy.cpp
 
@@ -37,10 +49,18 @@ HEADERS += \
     src/gui/parameterwindow.h \
     src/gui/scanwindow.h \
     src/misc/binaryhandler.h \
+    src/misc/outputwatcher.h \
+    src/misc/workspace.h \
+    src/misc/builtinparsers.h \
+    src/misc/parsepipeline.h \
+    src/misc/stepstream.h \
     src/gui/hampu.h \
     src/gui/glwidget.h \
     src/gui/controlpanel.h \
     src/misc/scanlist.h \
+    src/misc/jobledger.h \
+    src/misc/resultstore.h \
+    src/misc/leasequeue.h \
     src/cli/cmdappcore.h \
     src/cli/glengine.h \
     src/renderer/glcore.h \
@@ -55,9 +75,17 @@ HEADERS += \
     ../common/parameters.h \
     ../common/tooth.h \
     ../common/toothlife.h \
+    ../common/toothdelta.h \
     ../common/morphomaker.h \
     ../common/colormap.h \
     ../common/readdata.h \
+    ../common/writemesh.h \
+    ../common/stepcache.h \
+    ../common/stepspill.h \
+    ../common/tmring.h \
+    ../common/tmprogress.h \
+    ../common/tmcheckpoint.h \
+    ../common/outputparser.h \
     src/renderer/gl_modern.h \
     src/renderer/gl_legacy.h
 
@@ -5,16 +5,41 @@
  *  Overview:
  *  1) User calls startParameterScan(), which sets up the scan queue and calls
  *     scanParameters().
- *  2) scanParameters() picks the first item in scan queue & calls runModel().
- *  3) Upon model exit updateModel() gets called, which stores the results.
- *  4) updateModel() calls scanParameters(), i.e. back to 2), until the scan
- *     queue is empty and the program exits.
+ *  2) scanParameters() picks the next items in scan queue & calls runModel()
+ *     for each idle job slot (--jobs N slots, each with a model instance).
+ *  3) Upon model exit updateModel() gets called, which renders the results and
+ *     exports them in a separate thread. A run found in the result store is
+ *     loaded by runModel() instead, and goes straight to 3).
+ *  4) When exported, finishJob() frees the slot and calls scanParameters(),
+ *     i.e. back to 2), until the scan queue is empty, all runs are done and
+ *     the program exits.
+ *
+ *  If the scan list gives a branch iteration, the base parameters are first
+ *  run alone up to it, saving the model state and the steps (the prefix).
+ *  Each scan item then starts from that state with its own parameters, and
+ *  only the iterations after the branch point are computed per item. Their
+ *  step caches contain the whole run; the output files of the model only the
+ *  steps after the branch point.
+ *
+ *  The state of each scan item is recorded in the ledger SCAN_LEDGER in the
+ *  run folder. With --resume, the items done in an interrupted run of the
+ *  same scan are skipped.
+ *
+ *  With --shared, the scan items are claimed from a queue folder shared with
+ *  other processes running the same scan, possibly on other nodes (see
+ *  LeaseQueue); its markers replace the ledger. The files otherwise shared by
+ *  all runs are written into the data folder of each item.
  *
  */
 
 #include <ctime>
+#include <algorithm>
 #include <iostream>
 #include <QDir>
+#include <QFile>
+#include <QCryptographicHash>
+#include <QStandardPaths>
+#include <QElapsedTimer>
 
 #include "cli/cmdappcore.h"
 #include "misc/binaryhandler.h"
@@ -22,6 +47,8 @@
 #include "utils/readxml.h"
 #include "utils/writedata.h"
 #include "misc/loader.h"
+#include "stepcache.h"
+#include "tmcheckpoint.h"
 
 
 
@@ -45,18 +72,13 @@ CmdAppCore::CmdAppCore(int & argc, char ** argv) : QCoreApplication(argc, argv)
     runDir = QDir::currentPath();
 
     // Initializing temporary folder:
-    QDir *qdir = new QDir();
-    QString tempPath = qdir->tempPath();
-    char tmp[1024];
-    int pid = (int)QCoreApplication::applicationPid();
-    sprintf(tmp, "%s/%s_%d", tempPath.toStdString().c_str(), PROGRAM_NAME, pid);
-    systemTempPath = tmp;
-    if (!qdir->exists(QString(systemTempPath.c_str()))) {
-        qdir->mkdir(QString(systemTempPath.c_str()));
-    }
+    systemTempPath = workspace.path().toStdString();
     std::cout << "Temp. folder: " << systemTempPath << std::endl;
 
-    fileIndex = 0;
+    // Completed runs are kept for runs of the same parameters.
+    QString store = QStandardPaths::writableLocation( QStandardPaths::GenericCacheLocation )
+                    + "/" + PROGRAM_NAME + "/" + RESULT_STORE_DIR;
+    resultStore.open( store, RESULT_STORE_BYTES );
 }
 
 
@@ -68,58 +90,152 @@ CmdAppCore::CmdAppCore(int & argc, char ** argv) : QCoreApplication(argc, argv)
 void CmdAppCore::writeStatusBar(std::string msg="")
 {
     if (msg.empty()) return;
-    fprintf(stdout, "\r%s", msg.c_str());
+    // Padded to overwrite the previous message.
+    fprintf(stdout, "\r%-79s", msg.c_str());
     fflush(stdout);
 }
 
 
 
 /**
- * @brief Updates model view window & development slider position.
- * - Called by a QTimer set in the constructor().
+ * @brief Saves images of the steps of a model run not saved yet.
+ * @param i     Job slot.
  */
-void CmdAppCore::updateProgress()
+void CmdAppCore::saveImages(int i)
 {
-    int i;
+    job& j = jobs.at(i);
+    int stepsize = j.model->getStepSize();
+    int k;
 
-    for (i=fileIndex; i<toothLife->getLifeSize(); i++) {
-        glengine->setRenderMode( models.at(modelId)->getRenderMode() );
-        glengine->setVisualData( toothLife, i+1, models.at(modelId) );
+    for (k=j.fileIndex; k<j.toothLife->getLifeSize(); k++) {
+        glengine->setRenderMode( j.model->getRenderMode() );
+        glengine->setVisualData( j.toothLife, k+1, j.model );
 
         QImage img = glengine->screenshotGL();
         char tmp[256];
-        int stepsize = models.at(modelId)->getStepSize();
-        sprintf(tmp, "%s_%.10d.png", PROGRAM_NAME, (i+1)*stepsize);
+        if (jobs.size() > 1) {
+            // Concurrent runs would overwrite each others' images.
+            sprintf(tmp, "%s_%s_%.10d.png", PROGRAM_NAME,
+                    j.parameters->getID().c_str(), (k+1)*stepsize);
+        }
+        else {
+            sprintf(tmp, "%s_%.10d.png", PROGRAM_NAME, (k+1)*stepsize);
+        }
         QString target = runDir + "/images/" + QString(tmp);
         img.save(target);
     }
 
-    fileIndex = i;
+    j.fileIndex = k;
 }
 
 
 
 /**
- *  @brief Called whenever model has finished/exited.
- *  - Updates status bar etc.
+ * @brief Reports progress of the slowest running model, saves the images of
+ *        the running models if requested.
+ * - Called by a QTimer set in the constructor().
+ */
+void CmdAppCore::updateProgress()
+{
+    int n = 0, eta = -1;
+    float prog = 100.0;
+    for (uint32_t i=0; i<jobs.size(); i++) {
+        if (jobs.at(i).toothLife != NULL && !jobs.at(i).exporter.joinable() &&
+            !jobs.at(i).restored) {
+            // Each scan item has the steps of the prefix.
+            if (expImg && !jobs.at(i).prefix) {
+                saveImages(i);
+            }
+
+            Model* model = jobs.at(i).model;
+            prog = std::min( prog, model->getProgress() );
+            eta = std::max( eta, model->getRemainingTime(jobs.at(i).timeStart) );
+            n++;
+        }
+    }
+    if (n == 0) {
+        return;
+    }
+
+    char msg[256];
+    int len = sprintf(msg, "Running... %.1f%% complete.", prog);
+    if (n > 1) {
+        len = sprintf(msg, "Running %d models... %.1f%% complete.", n, prog);
+    }
+    if (eta >= 0) {
+        sprintf(msg+len, " About %.2d:%.2d:%.2d left.", eta/3600,
+                (eta%3600)/60, eta%60);
+    }
+    writeStatusBar(msg);
+}
+
+
+
+/**
+ *  @brief Called whenever model has finished/exited; calls finishRun().
  */
 void CmdAppCore::updateModel()
 {
     if (DEBUG_MODE) fprintf(stderr, "%s():\n", __FUNCTION__);
 
+    int i;
+    for (i=0; i<(int)jobs.size(); i++) {
+        if (jobs.at(i).model == sender()) break;
+    }
+    if (i == (int)jobs.size() || jobs.at(i).toothLife == NULL ||
+        jobs.at(i).exporter.joinable() || jobs.at(i).restored) {
+        return;     // Not running.
+    }
+
+    finishRun(i);
+}
+
+
+
+/**
+ *  @brief Called when a model run has finished or has been restored.
+ *  - Updates status bar, renders the images; the GL context is only used
+ *    from this thread.
+ *  - Leaves exporting the data files to a separate thread, which calls
+ *    finishJob() when done.
+ * @param i     Job slot.
+ */
+void CmdAppCore::finishRun(int i)
+{
+    job& j = jobs.at(i);
+
+    if (j.lost) {
+        finishJob(i);
+        return;
+    }
+
+    if (j.prefix) {
+        finishPrefix(i);
+        return;
+    }
+
+    // The last step is rendered and exported; store it exactly.
+    j.toothLife->finish();
+
     // Reports total running time.
-    int timeDiff = time(NULL)-timeStart;
+    int timeDiff = time(NULL)-j.timeStart;
     int hours = timeDiff/(3600);
     int mins = (timeDiff-(hours*3600)) / 60;
     int secs = timeDiff - (hours*3600) - (mins*60);
     char timeMsg[265];
-    sprintf(timeMsg, "Finished after %.2d:%.2d:%.2d.", hours, mins, secs);
+    if (jobs.size() > 1) {
+        sprintf(timeMsg, "%s finished after %.2d:%.2d:%.2d.",
+                j.parameters->getID().c_str(), hours, mins, secs);
+    }
+    else {
+        sprintf(timeMsg, "Finished after %.2d:%.2d:%.2d.", hours, mins, secs);
+    }
     writeStatusBar(timeMsg);
     fprintf(stdout, "\n");
 
-    Model* model = models.at( modelId );
+    Model* model = j.model;
     glengine->setRenderMode( model->getRenderMode() );
-    glengine->setVisualData( toothLife, toothLife->getLifeSize(), model );
+    glengine->setVisualData( j.toothLife, j.toothLife->getLifeSize(), model );
 
     //
     // Render images
@@ -130,70 +246,162 @@ void CmdAppCore::updateModel()
     // List of requested orientations (names only)
     std::vector<std::string>& req_orients = scanList->getOrientations();
 
-    QString par_id = QString::fromStdString( parameters->getID() );
-    QString run_id = QString::number( toothLife->getID() );
+    QString par_id = QString::fromStdString( j.parameters->getID() );
 
     // Save images at the requested orientations, or do nothing node given.
     for (auto orient : req_orients) {
-        uint32_t i;
-        for (i=0; i<orients.size(); i++) {
-            if (!orients.at(i).name.compare( orient )) {
+        uint32_t k;
+        for (k=0; k<orients.size(); k++) {
+            if (!orients.at(k).name.compare( orient )) {
                 break;
             }
         }
-        if (i == orients.size()) continue;  // Unrecognized orientation requested.
+        if (k == orients.size()) continue;  // Unrecognized orientation requested.
 
-        glengine->setViewOrientation( orients.at(i).rotx, orients.at(i).roty );
+        glengine->setViewOrientation( orients.at(k).rotx, orients.at(k).roty );
         QImage img = glengine->screenshotGL();
         QString target = runDir + "/" + SSHOT_SAVE_DIR + "/" + PROGRAM_NAME
-                         + "_" + par_id + "_" + QString::number(i) + ".png";
+                         + "_" + par_id + "_" + QString::number(k) + ".png";
         std::cout << "Image saved, size " << img.size().height() << "x"
                   << img.size().width() << ", orientation " << orient << std::endl;
         img.save(target);
     }
 
+    if (expImg) {
+        saveImages(i);
+    }
+
     //
     // Export data files
     //
 
+    j.exporter = std::thread( &CmdAppCore::exportRun, this, i );
+}
+
+
+
+/**
+ * @brief Exports the data files of a finished model run.
+ * - Runs in a thread of its own; no GL calls here.
+ * @param i     Job slot.
+ */
+void CmdAppCore::exportRun(int i)
+{
+    job& j = jobs.at(i);
+    Model* model = j.model;
+    QString par_id = QString::fromStdString( j.parameters->getID() );
+    QString run_id = QString::number( j.toothLife->getID() );
+
     // Create main data folder
     QString folder = runDir + "/" + DATA_SAVE_DIR;
-    QDir qdir(folder);
-    if (!qdir.exists()) {
-        qdir.mkdir(folder);
-    }
+    QDir qdir;
+    qdir.mkpath(folder);
 
     // Create an additional subfolder to distiguish between different runs by
     // parameter ID.
-    qdir.mkdir(par_id);
     folder = folder + "/" + par_id;
+    qdir.mkpath(folder);
 
     // Copy simulation output files to the target folder.
+    if (!j.restored) {
+        model->writeStepCache( *j.toothLife );
+    }
     model->exportData( run_id, folder );
 
-    if (model->getRenderMode() == RENDER_HUMPPA) {
-        // TODO: Model specific stuff like the following belongs to
-        // result parsers, not here.
-        Tooth* tooth = toothLife->getTooth( toothLife->getLifeSize()-1 );
+    // Complete runs from the start are stored.
+    if (!j.restored && !j.branched && model->runCompleted()) {
+        resultStore.store( j.runKey, workspace.runFolder(j.toothLife->getID()) );
+    }
+
+    {
+        // Files shared by all runs; per item if shared with other processes.
+        std::lock_guard<std::mutex> lock(exportMutex);
+        QString shared = queue.good() ? folder : runDir;
+
+        if (model->getRenderMode() == RENDER_HUMPPA) {
+            // TODO: Model specific stuff like the following belongs to
+            // result parsers, not here.
+            Tooth* tooth = j.toothLife->getTooth( j.toothLife->getLifeSize()-1 );
+
+            QString file = shared + "/local_maxima.txt";
+            morphomaker::Export_local_maxima( *tooth, file.toStdString(),
+                                              par_id.toStdString() );
+            file = shared + "/cuspA_baseline.txt";
+            morphomaker::Export_main_cusp_baseline( *tooth, file.toStdString(),
+                                                    par_id.toStdString() );
+        }
 
-        QString file = runDir + "/local_maxima.txt";
-        morphomaker::Export_local_maxima( *tooth, file.toStdString(),
-                                          par_id.toStdString() );
-        file = runDir + "/cuspA_baseline.txt";
-        morphomaker::Export_main_cusp_baseline( *tooth, file.toStdString(),
-                                                par_id.toStdString() );
+        // Apply result parsers on the output files at the export folder.
+        model->runResultParsers( shared );
     }
 
-    // Apply result parsers on the output files at the export folder.
-    model->runResultParsers( runDir );
+    QMetaObject::invokeMethod( this, "finishJob", Qt::QueuedConnection,
+                               Q_ARG(int, i) );
+}
 
-    if (expImg) {
-        progressTimer->stop();
-        updateProgress();
+
+
+/**
+ * @brief Called when the prefix of a branched scan has been run; saves its
+ *        steps and starts the scan items. If the model didn't save its state,
+ *        the items are run from the start.
+ * @param i     Job slot.
+ */
+void CmdAppCore::finishPrefix(int i)
+{
+    job& j = jobs.at(i);
+    Model* model = j.model;
+
+    if (model->getReturnValue() || !QFile::exists(prefixState) ||
+        morphomaker::Write_step_cache( prefixCache, *j.toothLife,
+                                       model->getStepSize() )) {
+        fprintf(stdout, "\nModel state at iteration %d not available, running "
+                "the scan items from the start.\n", branchIter);
+        branchIter = 0;
+    }
+    else {
+        writeStatusBar("Branch point reached.");
+        fprintf(stdout, "\n");
+    }
+    prefixDone = true;
+
+    workspace.releaseRunFolder( j.toothLife->getID() );
+    delete j.toothLife;
+    j.toothLife = NULL;
+    j.prefix = false;
+
+    scanParameters();
+}
+
+
+
+/**
+ * @brief Called when a model run has been exported, or its lease lost; frees
+ *        the job slot.
+ * @param i     Job slot.
+ */
+void CmdAppCore::finishJob(int i)
+{
+    job& j = jobs.at(i);
+    if (j.exporter.joinable()) {
+        j.exporter.join();
+    }
+
+    // A lost item is left to the worker that took it over.
+    if (!j.lost) {
+        std::string location = std::string(DATA_SAVE_DIR) + "/" + j.parameters->getID();
+        bool failed = !j.restored && j.model->getReturnValue();
+        ledger.setState( j.scanJob, failed ? JobLedger::FAILED : JobLedger::DONE,
+                         location );
+        queue.finish( j.scanJob, failed, location );
     }
 
     // All done, clean up for next run:
-    delete toothLife;
+    workspace.releaseRunFolder( j.toothLife->getID() );
+    delete j.toothLife;
+    j.toothLife = NULL;
+    delete j.parameters;
+    j.parameters = NULL;
 
     scanParameters();
 }
@@ -201,51 +409,251 @@ void CmdAppCore::updateModel()
 
 
 /**
- * @brief Starts the model.
+ * @brief Starts a model run in a job slot.
+ * @param i     Job slot.
  */
-void CmdAppCore::runModel()
+void CmdAppCore::runModel(int i)
 {
     if (DEBUG_MODE) fprintf(stderr, "%s():\n", __FUNCTION__);
 
     glengine->clearScreen();
 
-    // NOTE: Model/run ID is set as time(NULL), meaning that if two consequtive
-    // model runs occur within one second they are assigned the same ID, leading
-    // to undefined behaviour!
-    int run_id = time(NULL);
-    toothLife = new ToothLife(0, run_id);
+    int run_id = workspace.newRunId();
+    workspace.acquireRunFolder(run_id);
 
-    Model* model = models.at(modelId);
-    model->setParameters(parameters);
+    job& j = jobs.at(i);
+    j.toothLife = new ToothLife(0, run_id);
+    j.toothLife->setDeltaEncoding( DELTA_KEYFRAME_INTERVAL );
+    j.fileIndex = 0;
+
+    Model* model = j.model;
+    model->setParameters(j.parameters);
     int stepsize = model->getStepSize();
 
-    models.at(modelId)->init_model( QString(systemTempPath.c_str()), 1,
-                                    *toothLife, nIter, stepsize, time(NULL), -1 );
-    timeStart = model->start_model();
+    // Long runs are paged out to the temp. folder.
+    if (nIter/stepsize > SPILL_MIN_STEPS) {
+        std::string spill = systemTempPath + "/" + std::to_string(run_id)
+                            + STEPSPILL_EXT;
+        j.toothLife->setSpill( spill, SPILL_CACHE_STEPS );
+    }
+
+    // The prefix of a branched scan runs up to the branch iteration.
+    int niter = nIter;
+    j.prefix = branchIter > 0 && !prefixDone;
+    j.branched = false;
+    j.restored = false;
+    j.lost = false;
+
+    // A run in the result store is loaded instead of run again.
+    if (!j.prefix) {
+        j.runKey = model->getRunKey(nIter);
+        QString folder = workspace.runFolder(run_id);
+        QString steps = folder + "/" + QString::number(run_id) + STEPCACHE_EXT;
+        if (resultStore.restore( j.runKey, folder, steps ) == 0) {
+            if (addSteps( i, steps.toStdString() ) == 0) {
+                fprintf(stdout, "Loaded from the result store.\n");
+                model->setTempPath( QString(systemTempPath.c_str()) );
+                j.restored = true;
+                j.timeStart = time(NULL);
+                QMetaObject::invokeMethod( this, "finishRun", Qt::QueuedConnection,
+                                           Q_ARG(int, i) );
+                return;
+            }
+            QDir(folder).removeRecursively();
+            workspace.acquireRunFolder(run_id);
+        }
+    }
+
+    // Steps are kept delta-encoded in memory; the step cache is written from
+    // the exact steps as they are added.
+    QString steps = workspace.runFolder(run_id) + "/" + QString::number(run_id)
+                    + STEPCACHE_EXT;
+    j.toothLife->setStepCache( steps.toStdString(), stepsize );
+
+    model->setSaveState( j.prefix ? prefixState : QString() );
+    model->setBranchState( QString(), 0 );
+    if (j.prefix) {
+        niter = branchIter;
+    }
+    else if (branchIter > 0 && addSteps(i, prefixCache) == 0) {
+        model->setBranchState( prefixState, branchIter );
+        j.branched = true;
+    }
+
+    model->init_model( QString(systemTempPath.c_str()), 1,
+                       *j.toothLife, niter, stepsize, run_id, -1 );
+    j.timeStart = model->start_model();
+}
+
+
+
+/**
+ * @brief Adds the steps of a step cache into the ToothLife of a job; the
+ *        prefix of a branched scan or a stored run.
+ * @param i     Job slot.
+ * @param file  Step cache file.
+ * @return      0 if success, else -1 and the ToothLife is left empty.
+ */
+int CmdAppCore::addSteps(int i, const std::string& file)
+{
+    job& j = jobs.at(i);
+    StepCacheReader reader( file );
+    for (int k=0; reader.good() && k<reader.getLifeSize(); k++) {
+        Tooth* tooth = reader.readTooth( k, *j.toothLife );
+        if (tooth == nullptr) {
+            break;
+        }
+        j.toothLife->addTooth( tooth );
+    }
+
+    if (!reader.good() || j.toothLife->getLifeSize() != reader.getLifeSize()) {
+        fprintf(stderr, "Error: Couldn't read '%s', running %s from the start.\n",
+                file.c_str(), j.parameters->getID().c_str());
+        j.toothLife->clear();
+        return -1;
+    }
+
+    return 0;
 }
 
 
 
 /**
- * @brief Picks the next item in the scan queue & call runModel().
+ * @brief Fills the idle job slots with the next items in the scan queue &
+ *        calls runModel(); exits when the queue is empty and all runs done.
  */
 void CmdAppCore::scanParameters()
 {
     if (DEBUG_MODE) fprintf(stderr, "%s():\n", __FUNCTION__);
 
-    int nScanItems = scanList->getScanQueueSize();
+    long nScanItems = scanList->getScanQueueSize();
+    int running = 0;
+
+    // The prefix of a branched scan is run first, alone.
+    if (branchIter > 0 && !prefixDone) {
+        if (jobs.at(0).toothLife == NULL && !scanDone()) {
+            fprintf(stdout, "\n*** Running the base parameters up to the branch "
+                    "point, %d iterations ***\n", branchIter);
+            jobs.at(0).parameters = parameters;
+            runModel(0);
+            return;
+        }
+        if (jobs.at(0).toothLife != NULL) {
+            return;
+        }
+    }
+
+    for (uint32_t i=0; i<jobs.size(); i++) {
+        if (jobs.at(i).toothLife != NULL) {
+            running++;
+            continue;
+        }
+
+        long k = nextScanJob();
+        Parameters *par = scanList->getScanJob(k);
+        if (par==NULL) {
+            if (k >= 0) {
+                queue.finish( k, true, "" );
+            }
+            continue;
+        }
+        std::string location = std::string(DATA_SAVE_DIR) + "/" + par->getID();
+        if (queue.good()) {
+            // Other processes write the job list file too.
+            QString folder = runDir + "/" + QString::fromStdString(location);
+            QDir().mkpath(folder);
+            scanList->writeScanJob(k, (folder + "/" + SCAN_LIST).toStdString());
+        }
+        else {
+            scanList->writeScanJob(k);
+        }
+        ledger.setState( k, JobLedger::RUNNING, location );
+
+        fprintf(stdout, "\n*** Scanning item %ld/%ld (%s), %d iterations ***\n",
+                k+1, nScanItems, par->getID().c_str(), nIter);
+        jobs.at(i).parameters = par;
+        jobs.at(i).scanJob = k;
+        runModel(i);
+        running++;
+    }
 
-    parameters = scanList->getScanItem(currentScanItem);
-    if (parameters==NULL) {
+    if (running == 0) {
+        // Items leased by other processes are claimed if they expire.
+        if (!scanDone()) {
+            QTimer::singleShot( LEASE_HEARTBEAT*1000, this, SLOT(scanParameters()) );
+            return;
+        }
         fprintf(stdout, "Scanning finished.\n");
         QApplication::exit();
-        return;
     }
+}
 
-    fprintf(stdout, "\n*** Scanning item %d/%d (%s), %d iterations ***\n",
-            currentScanItem+1, nScanItems, parameters->getID().c_str(), nIter);
-    runModel();
-    currentScanItem++;
+
+
+/**
+ * @brief Returns the index of the next scan item to run, claimed from the
+ *        shared queue if any; skips the items done in an earlier run.
+ * @return      Item index, -1 if none.
+ */
+long CmdAppCore::nextScanJob()
+{
+    if (queue.good()) {
+        return queue.claim();
+    }
+
+    long n = scanList->getScanQueueSize();
+    while (currentScanItem < n &&
+           ledger.getState(currentScanItem) == JobLedger::DONE) {
+        currentScanItem++;
+    }
+    return currentScanItem < n ? currentScanItem++ : -1;
+}
+
+
+
+/**
+ * @brief Returns true if no scan items are left to run, by this process or
+ *        by others sharing the queue.
+ */
+bool CmdAppCore::scanDone()
+{
+    if (queue.good()) {
+        return queue.drained();
+    }
+
+    long n = scanList->getScanQueueSize();
+    while (currentScanItem < n &&
+           ledger.getState(currentScanItem) == JobLedger::DONE) {
+        currentScanItem++;
+    }
+    return currentScanItem >= n;
+}
+
+
+
+/**
+ * @brief Renews the leases of the items claimed from the shared queue; stops
+ *        the items taken over by other processes meanwhile.
+ * - Called by a QTimer set in startParameterScan().
+ */
+void CmdAppCore::renewLeases()
+{
+    std::vector<long> lost;
+    queue.renew(lost);
+
+    for (long k : lost) {
+        for (uint32_t i=0; i<jobs.size(); i++) {
+            job& j = jobs.at(i);
+            if (j.toothLife == NULL || j.prefix || j.scanJob != k ||
+                j.exporter.joinable()) {
+                continue;
+            }
+            fprintf(stdout, "\nItem %ld was taken over by another process, "
+                    "stopping it.\n", k+1);
+            j.lost = true;
+            j.model->stop_model();
+        }
+    }
 }
 
 
@@ -295,15 +703,27 @@ int CmdAppCore::setModel(char *pfile)
  * @param step      Step size for storing intermediate results (DISABLED)
  * @param expimg    1 to store images
  * @param res       Image resolution width & height (single value!)
+ * @param njobs     Maximum number of models running at once
+ * @param resume    1 to skip the items done in an interrupted run of the scan
+ * @param shared    Queue folder shared with other processes, or NULL
  * @return          -1 if errors, else 0
  */
 int CmdAppCore::startParameterScan(int niter, char *param, char *scanfile,
-                                   int step, int expimg, int res)
+                                   int step, int expimg, int res, int njobs,
+                                   int resume, char *shared)
 {
     if (DEBUG_MODE) fprintf(stderr, "%s():\n", __FUNCTION__);
 
     (void)step;
 
+    QElapsedTimer timer;
+    timer.start();
+
+    if (systemTempPath.empty()) {
+        fprintf(stderr, "Error: Couldn't create the temp. folder.\n");
+        return -1;
+    }
+
     int rv = glengine->createGLContext();  // Creates off-screen GL context.
     if (rv) {
         QApplication::exit();
@@ -316,6 +736,31 @@ int CmdAppCore::startParameterScan(int niter, char *param, char *scanfile,
     // Check & set all model related stuff.
     if (setModel(param)) return -1;
 
+    // One model instance per job slot, each with its own run folder.
+    Model* model = models.at(modelId);
+    jobs.resize( njobs > 1 ? njobs : 1 );
+    jobs.at(0).model = model;
+    for (uint32_t i=1; i<jobs.size(); i++) {
+        Model* instance = morphomaker::Create_model( model->getInterfaceXML() );
+        if (instance == NULL) {
+            jobs.resize(i);
+            break;
+        }
+        connect(instance, SIGNAL(msgStatusBar(std::string)), this,
+                SLOT(writeStatusBar(std::string)));
+        connect(instance, SIGNAL(finished()), this, SLOT(updateModel()));
+        jobs.at(i).model = instance;
+    }
+    for (auto& j : jobs) {
+        j.toothLife = NULL;
+        j.parameters = NULL;
+        j.scanJob = -1;
+        j.prefix = false;
+        j.branched = false;
+        j.restored = false;
+        j.lost = false;
+    }
+
     // Read & populate scan list.
     QString source = runDir + "/" + QString(scanfile);
     scanList = morphomaker::Read_scanlist(source.toStdString());
@@ -326,13 +771,68 @@ int CmdAppCore::startParameterScan(int niter, char *param, char *scanfile,
 
     QString target = runDir + "/" + SCAN_LIST;
     scanList->setBaseParameters(parameters);
-    scanList->populateScanQueue(target.toStdString());
+    if (scanList->populateScanQueue(target.toStdString(), 1,
+                                    resume || shared != NULL)) {
+        return -1;
+    }
     glengine->setViewMode(scanList->getViewMode());
 
+    // The scan is identified by its input files and the number of iterations.
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    for (QString file : { runDir + "/" + QString(param), source }) {
+        QFile f(file);
+        if (f.open(QIODevice::ReadOnly)) {
+            hash.addData(f.readAll());
+        }
+    }
+    hash.addData(QByteArray::number(niter));
+    std::string scanId = hash.result().toHex().toStdString();
+
+    if (shared != NULL) {
+        // Items are claimed from the queue; done items are skipped anyway.
+        target = QDir(runDir).absoluteFilePath( QString(shared) );
+        if (queue.open( target.toStdString(), scanList->getScanQueueSize(),
+                        scanId )) {
+            fprintf(stderr, "Error: Couldn't join the scan queue '%s'.\n",
+                    target.toStdString().c_str());
+            return -1;
+        }
+        leaseTimer = new QTimer(this);
+        leaseTimer->setInterval(LEASE_HEARTBEAT*1000);
+        connect(leaseTimer, SIGNAL(timeout()), this, SLOT(renewLeases()));
+        leaseTimer->start();
+    }
+    else {
+        target = runDir + "/" + SCAN_LEDGER;
+        if (ledger.open( target.toStdString(), scanList->getScanQueueSize(),
+                         scanId, resume )) {
+            fprintf(stderr, "Error: Couldn't open the scan ledger '%s'.\n",
+                    target.toStdString().c_str());
+            return -1;
+        }
+    }
+    if (resume && shared == NULL) {
+        fprintf(stdout, "Resuming scan, %ld/%ld items done.\n",
+                ledger.count(JobLedger::DONE), scanList->getScanQueueSize());
+    }
+
     nIter = niter;
     expImg = expimg;
     currentScanItem = 0;
 
+    // Branch points are rounded down to a step; the prefix must be shorter
+    // than the run.
+    int stepsize = model->getStepSize();
+    branchIter = stepsize > 0 ? scanList->getBranchIteration()/stepsize*stepsize : 0;
+    if (branchIter >= nIter) {
+        fprintf(stderr, "Warning: Branch iteration %d not before the last "
+                "iteration, running the scan items from the start.\n", branchIter);
+        branchIter = 0;
+    }
+    prefixDone = false;
+    prefixState = QString(systemTempPath.c_str()) + "/prefix" + TMCHECKPOINT_EXT;
+    prefixCache = systemTempPath + "/prefix" + STEPCACHE_EXT;
+
     // Create folders for storing model output:
     char tmp[1024];
     QDir *qdir = new QDir();
@@ -353,13 +853,15 @@ int CmdAppCore::startParameterScan(int niter, char *param, char *scanfile,
         if (!qdir->exists(QString(tmp))) {
             qdir->mkdir(QString(tmp));
         }
-        progressTimer = new QTimer(this);
-        progressTimer->setInterval(1000);
-        connect(progressTimer, SIGNAL(timeout()), this, SLOT(updateProgress()));
-        progressTimer->start();
     }
 
+    progressTimer = new QTimer(this);
+    progressTimer->setInterval(1000);
+    connect(progressTimer, SIGNAL(timeout()), this, SLOT(updateProgress()));
+    progressTimer->start();
+
     scanParameters();
+    std::cout << "Scan started in " << timer.elapsed() << " ms." << std::endl;
 
     return 0;
 }
@@ -1,10 +1,16 @@
 #pragma once
 
 #include <QCoreApplication>
+#include <thread>
+#include <mutex>
 
 #include "cli/glengine.h"
 #include "readdata.h"
 #include "misc/scanlist.h"
+#include "misc/jobledger.h"
+#include "misc/resultstore.h"
+#include "misc/leasequeue.h"
+#include "misc/workspace.h"
 #include "parameters.h"
 #include "tooth.h"
 #include "toothlife.h"
@@ -18,34 +24,69 @@ class CmdAppCore : public QCoreApplication
 
     public:
         CmdAppCore(int & argc, char ** argv);
-        int startParameterScan(int, char *, char *, int, int, int);
+        int startParameterScan(int, char *, char *, int, int, int, int, int, char *);
 
     private slots:
         void writeStatusBar(std::string);
         void updateProgress();
         void updateModel();
+        void finishRun(int);
+        void finishJob(int);
+        void renewLeases();
+        void scanParameters();
 
     private:
-        void runModel();
-        void scanParameters();
+        // A model run in progress; one per concurrently running model instance.
+        struct job {
+            Model *model;               // model instance of the job slot
+            ToothLife *toothLife;       // model output, NULL if slot is idle
+            Parameters *parameters;     // scan item parameters
+            long scanJob;               // index of the scan item
+            int timeStart;
+            // A general purpose "file" index that starts from zero at the
+            // start of the run, and increases when files are saved etc.
+            int fileIndex;
+            bool prefix;                // shared run up to the branch iteration
+            bool branched;              // started from the prefix state
+            bool restored;              // loaded from the result store
+            bool lost;                  // lease taken over by another worker
+            std::string runKey;         // see Model::getRunKey()
+            std::thread exporter;       // exports the finished run
+        };
+
+        void runModel(int);
+        int addSteps(int, const std::string&);
+        void finishPrefix(int);
+        long nextScanJob();
+        bool scanDone();
         int setModel(char *);
+        void saveImages(int);
+        void exportRun(int);
 
         GLEngine *glengine;
         ScanList *scanList;
         Parameters *parameters;
-        ToothLife *toothLife;
 
         std::vector<Model*> models;
+        std::vector<job> jobs;          // fixed size; one slot per --jobs
+        std::mutex exportMutex;         // serializes writes to runDir
+        Workspace workspace;            // run IDs & run folders
+        JobLedger ledger;               // states of the scan items
+        ResultStore resultStore;        // outputs of completed runs
+        LeaseQueue queue;               // items shared with other processes
         QTimer *progressTimer;
+        QTimer *leaseTimer;
 
         QString runDir;
         std::string systemTempPath;
         int nIter;
         int expImg;
-        int currentScanItem;
-        int timeStart;
+        long currentScanItem;
         int modelId;
-        // A general purpose "file" index that starts from zero at the start of
-        // the program, and increases when files are saved etc.
-        int fileIndex;
+
+        // Branched scans (see ScanList::setBranchIteration()).
+        int branchIter;                 // branch iteration, 0 if not branched
+        bool prefixDone;                // true when the prefix has been run
+        QString prefixState;            // model state at the branch iteration
+        std::string prefixCache;        // steps up to the branch iteration
 };
@@ -15,6 +15,7 @@
 #include <algorithm>
 #include <numeric>
 #include <ctime>
+#include <QStandardPaths>
 
 #include "gui/hampu.h"
 #include "utils/writeparameters.h"
@@ -22,6 +23,7 @@
 #include "utils/writedata.h"
 #include "utils/readxml.h"
 #include "model.h"
+#include "stepcache.h"
 #include "misc/loader.h"
 
 
@@ -37,14 +39,7 @@ Hampu::~Hampu()
         delete models.at(i);
     }
 
-    // Delete the temp. folder. It should be empty by now.
-    QDir qdir;
-    if (qdir.rmdir((QString)tempPathMorpho.c_str())) {
-        if (DEBUG_MODE) fprintf(stderr, "Removed '%s'\n", tempPathMorpho.c_str());
-    }
-    else {
-        if (DEBUG_MODE) fprintf(stderr, "Couldn't remove' '%s'\n", tempPathMorpho.c_str());
-    }
+    // The temp. folder is deleted with the workspace.
 }
 
 
@@ -63,6 +58,7 @@ int Hampu::init_GUI()
     scanning = 0;
     screenshotCounter = 0;
     runCounter = 0;
+    restored = 0;
     timeLimit = -1;     // -1 = no time limit
     parwidget = NULL;
 
@@ -172,18 +168,19 @@ int Hampu::init_GUI()
     // Setting the default model with which the program starts.
     setModelSettings(DEFAULT_MODEL, 1);
 
-    // Create a temporary folder for running the models.
-    int pid = (int)QCoreApplication::applicationPid();
-    QDir qdir;
-    QString tempPath = qdir.tempPath();
-    std::stringstream str;
-    str << tempPath.toStdString() << "/" << PROGRAM_NAME << "_" << pid;
-    str >> tempPathMorpho;
-    if (!qdir.exists(QString(tempPathMorpho.c_str()))) {
-        qdir.mkdir(QString(tempPathMorpho.c_str()));
+    // Temporary folder for running the models.
+    tempPathMorpho = workspace.path().toStdString();
+    if (tempPathMorpho.empty()) {
+        fprintf(stderr, "Error: Couldn't create the temp. folder.\n");
+        return -1;
     }
     std::cout << "Temp. folder: " << tempPathMorpho << std::endl;
 
+    // Completed runs are kept for runs of the same parameters.
+    QString store = QStandardPaths::writableLocation( QStandardPaths::GenericCacheLocation )
+                    + "/" + PROGRAM_NAME + "/" + RESULT_STORE_DIR;
+    resultStore.open( store, RESULT_STORE_BYTES );
+
     // Model progress polling.
     progressTimer = new QTimer(this);
     progressTimer->setInterval(UPDATE_INTERVAL);
@@ -371,6 +368,12 @@ void Hampu::Panel_History(int mode)
  */
 void Hampu::Panel_Import(std::string file)
 {
+    // Step cache files contain a complete model run instead of parameters.
+    if (QString::fromStdString(file).endsWith(STEPCACHE_EXT)) {
+        importStepCache_(file);
+        return;
+    }
+
     // Find the model matching the one given in the parameters file.
     // NOTE: Running Import_parameters() on an empty Parameters object only
     // reads the keys words and values! The actual parameters are read later
@@ -493,23 +496,42 @@ void Hampu::Panel_Run(int nIter)
     // Disable the model menu while running model:
     controlPanel->enableModelList(0);
 
-    // NOTE: Model/run ID is set as time(NULL), meaning that if two consequtive
-    // model runs occur within one second they are assigned the same ID, leading
-    // to undefined behaviour!
-    int run_id = time(NULL);
+    int run_id = workspace.newRunId();
+    workspace.acquireRunFolder(run_id);
     toothLifeWork = new ToothLife( currentModel, run_id );
     toothLifeWork->setParameters( model->getParameters() );
+    toothLifeWork->setDeltaEncoding( DELTA_KEYFRAME_INTERVAL );
 
-    // Clean the history if needed, push the current work into history.
-    while (toothHistory.size() > getMaxHistorySize_()) {
-        delete toothHistory.at(0);
-        toothHistory.erase(toothHistory.begin());
-        controlPanel->removeHistory(0);
+    // Long runs are paged out to the temp. folder.
+    int stepsize = model->getStepSize();
+    if (nIter/stepsize > SPILL_MIN_STEPS) {
+        std::string spill = tempPathMorpho + "/" + std::to_string(run_id)
+                            + STEPSPILL_EXT;
+        toothLifeWork->setSpill( spill, SPILL_CACHE_STEPS );
     }
+
+    // Clean the history if needed, push the current work into history.
+    trimHistory_(0);
     toothHistory.push_back(toothLifeWork);
     currentHistory = controlPanel->addHistory(1);
 
-    int stepsize = model->getStepSize();
+    // A run in the result store is loaded instead of run again.
+    runKey = model->getRunKey(nIter);
+    restored = restoreRun_(run_id) == 0;
+    if (restored) {
+        timeStart = time(NULL);
+        runCounter++;
+        controlPanel->setSliderMinMax(0, (nIter/stepsize));
+        QMetaObject::invokeMethod(this, "updateModel", Qt::QueuedConnection);
+        return;
+    }
+
+    // Steps are kept delta-encoded in memory; the step cache is written from
+    // the exact steps as they are added.
+    QString steps = workspace.runFolder(run_id) + "/" + QString::number(run_id)
+                    + STEPCACHE_EXT;
+    toothLifeWork->setStepCache( steps.toStdString(), stepsize );
+
     int rv = model->init_model( QString(tempPathMorpho.c_str()), 2,
                                 *toothLifeWork, nIter, stepsize, run_id, timeLimit );
     if (rv<0) {
@@ -900,7 +922,18 @@ int Hampu::exportModelData( int step, int datatype, QString export_folder )
         if (model->getRenderMode() == RENDER_HUMPPA) {
             // TODO: Model specific stuff like the following belongs to
             // result parsers, not here.
+            // Delta-encoded steps are inexact in memory; read the step from
+            // the step cache if there is one.
             Tooth* tooth = toothLife->getTooth( viewIntStep );
+            ToothLife exact;
+            StepCacheReader reader( (workspace.runFolder(toothLife->getID()) + "/"
+                                     + run_id + STEPCACHE_EXT).toStdString() );
+            if (reader.good() && viewIntStep < reader.getLifeSize()) {
+                Tooth* cached = reader.readTooth( viewIntStep, exact );
+                if (cached != nullptr) {
+                    tooth = cached;
+                }
+            }
 
             QString file = export_folder + "/local_maxima.txt";
             morphomaker::Export_local_maxima( *tooth, file.toStdString(),
@@ -978,6 +1011,9 @@ void Hampu::updateProgress()
     char msg[256];
     int model_idx = toothLifeWork->getCurrentModel();
 
+    // The running model grows; release older runs if over the memory budget.
+    trimHistory_(1);
+
     // Update the development position only if viewing the currently running
     // model and 'Follows development' is checked.
     if (currentHistory==toothHistory.size()-1 && followDevelopment) {
@@ -1009,15 +1045,21 @@ void Hampu::updateProgress()
     }
 
     float prog = models.at(model_idx)->getProgress();
+    int eta = models.at(model_idx)->getRemainingTime(timeStart);
+    char etaMsg[64] = "";
+    if (eta >= 0) {
+        sprintf(etaMsg, " About %.2d:%.2d:%.2d left.", eta/3600, (eta%3600)/60,
+                eta%60);
+    }
     if (!scanning) {
-        sprintf(msg, "Running... %.1f%% complete.", prog);
+        sprintf(msg, "Running... %.1f%% complete.%s", prog, etaMsg);
         writeStatusBar(msg);
     }
     else {
-        int n = scanList->getScanQueueSize();
-        int i = scanList->getCurrentScanItem();
-        sprintf(msg, "Scanning item %d/%d,  %.1f%% complete. To abort scanning, go Tools -> Scan parameters.",
-                i, n, prog);
+        long n = scanList->getScanQueueSize();
+        long i = scanList->getCurrentScanItem();
+        sprintf(msg, "Scanning item %ld/%ld,  %.1f%% complete.%s To abort scanning, go Tools -> Scan parameters.",
+                i, n, prog, etaMsg);
         writeStatusBar(msg);
     }
 }
@@ -1034,7 +1076,14 @@ void Hampu::updateModel()
 
     progressTimer->stop();
 
-    if (!models.at(currentModel)->getReturnValue()) {
+    // The last step is viewed and exported; store it exactly.
+    toothHistory.at( toothHistory.size()-1 )->finish();
+
+    if (restored) {
+        updateProgress();
+        writeStatusBar("Loaded from the result store.");
+    }
+    else if (!models.at(currentModel)->getReturnValue()) {
         // Call updateProgress one last time to make the current model view is
         // up-to-date.
         updateProgress();
@@ -1059,6 +1108,16 @@ void Hampu::updateModel()
     controlPanel->enableModelList(1);
     controlPanel->updateRunStatus("Run");
 
+    // Store the run so that it can be reopened without re-parsing the output,
+    // and loaded instead of run again if complete.
+    Model* model = models.at(toothLife->getCurrentModel());
+    if (!restored) {
+        model->writeStepCache( *toothLife );
+        if (model->runCompleted()) {
+            resultStore.store( runKey, workspace.runFolder(toothLife->getID()) );
+        }
+    }
+
     if (scanning) {
         QString folder = scanWindow->getResultsFolder();
         if (scanWindow->storeModelSteps()) {
@@ -1274,6 +1333,7 @@ void Hampu::scanParameters_()
     scanning = 1;
     timeLimit = scanWindow->getTimeLimit();
 
+    long k = scanList->getCurrentScanItem();
     Parameters *parameters = scanList->getNextScanJob();
     if (parameters==NULL) {
         // Scanning done (or failed for whatever reason).
@@ -1286,6 +1346,8 @@ void Hampu::scanParameters_()
     }
 
     models.at(currentModel)->setParameters(parameters);
+    scanList->writeScanJob(k);
+    delete parameters;
     Panel_Run(controlPanel->getnIter());
     parwidget->updateButtonValues();
 }
@@ -1312,22 +1374,118 @@ void Hampu::importExampleParameters_()
 
 
 /**
- * @brief Returns the maximum number of runs to be stored in the run history.
- * - During parameter scan the history size is fixed to 0, otherwise given by
- *   MAX_HISTORY_SIZE.
+ * @brief Reads a complete model run from a step cache file into history.
+ * - The model is identified by the model name stored in the run parameters,
+ *   since model indices may differ between sessions.
  *
- * @return  Max. history size.
+ * @param file      File name.
  */
-unsigned int Hampu::getMaxHistorySize_()
+void Hampu::importStepCache_(const std::string& file)
 {
-    if (!scanning) {
-        return (unsigned int)MAX_HISTORY_SIZE;
+    ToothLife* toothLife = morphomaker::Read_step_cache(file);
+    if (toothLife == nullptr) {
+        char msg[256];
+        sprintf(msg, "Error: Can't read step cache '%s'.", file.c_str());
+        writeStatusBar(msg);
+        return;
+    }
+
+    std::string model = toothLife->getParameters()->getKey(PARKEY_MODEL);
+    int modelFound = -1;
+    for (uint32_t i=0; i<models.size(); i++) {
+        if (!model.compare( models.at(i)->getModelName()) ) {
+            modelFound = i;
+            break;
+        }
     }
+    if (modelFound < 0) {
+        char msg[256];
+        sprintf(msg, "Error: Unknown model name '%s' in the step cache.",
+                     model.c_str());
+        writeStatusBar(msg);
+        delete toothLife;
+        return;
+    }
+    toothLife->setCurrentModel(modelFound);
+
+    // Clean the history if needed, push the run into history.
+    trimHistory_(0);
+    toothHistory.push_back(toothLife);
+    controlPanel->addHistory(1);
+    int stepsize = models.at(modelFound)->getStepSize();
+    controlPanel->endHistory( (toothLife->getLifeSize()-1)*stepsize );
+    Panel_History( toothHistory.size()-1 );
+
+    std::stringstream ss;
+    ss << "Read: '" << file << "'";
+    writeStatusBar(ss.str());
+}
+
+
+
+/**
+ * @brief Loads the run of the current parameters from the result store into
+ *        toothLifeWork and its run folder.
+ * @param run_id    Run ID.
+ * @return          0 if loaded, else -1 and the run folder is left empty.
+ */
+int Hampu::restoreRun_(int run_id)
+{
+    QString folder = workspace.runFolder(run_id);
+    QString steps = folder + "/" + QString::number(run_id) + STEPCACHE_EXT;
+    if (resultStore.restore( runKey, folder, steps )) {
+        return -1;
+    }
+
+    StepCacheReader reader( steps.toStdString() );
+    for (int k=0; reader.good() && k<reader.getLifeSize(); k++) {
+        Tooth* tooth = reader.readTooth( k, *toothLifeWork );
+        if (tooth == nullptr) {
+            break;
+        }
+        toothLifeWork->addTooth( tooth );
+    }
+    if (!reader.good() || toothLifeWork->getLifeSize() != reader.getLifeSize()) {
+        toothLifeWork->clear();
+        QDir(folder).removeRecursively();
+        workspace.acquireRunFolder(run_id);
+        return -1;
+    }
+
+    // Exports copy the output files from the run folder.
+    Model* model = models.at(toothLifeWork->getCurrentModel());
+    model->setTempPath( QString(tempPathMorpho.c_str()) );
+
     return 0;
 }
 
 
 
+/**
+ * @brief Removes the oldest runs from the run history until the history fits
+ *        in MAX_HISTORY_BYTES.
+ * - During parameter scan all but the 'keep' newest runs are removed.
+ *
+ * @param keep      Number of newest runs that are never removed.
+ */
+void Hampu::trimHistory_(unsigned int keep)
+{
+    size_t bytes = 0;
+    for (auto toothLife : toothHistory) {
+        bytes += toothLife->bytes();
+    }
+
+    while (toothHistory.size() > keep && (scanning || bytes > MAX_HISTORY_BYTES)) {
+        bytes -= toothHistory.at(0)->bytes();
+        workspace.releaseRunFolder( toothHistory.at(0)->getID() );
+        delete toothHistory.at(0);
+        toothHistory.erase(toothHistory.begin());
+        controlPanel->removeHistory(0);
+    }
+}
+
+
+
 /**
  * @brief Arrow key control for development slider.
  * @param event     Key event.
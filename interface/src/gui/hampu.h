@@ -18,6 +18,8 @@
 #include "gui/parameterwindow.h"
 #include "gui/glwidget.h"
 #include "gui/scanwindow.h"
+#include "misc/workspace.h"
+#include "misc/resultstore.h"
 
 #define EXPORT_DATA         0x01
 #define EXPORT_SCREENSHOTS  0x02
@@ -79,7 +81,9 @@ private:
     void updateCurrentStepView_(int);
     void scanParameters_();
     void importExampleParameters_();
-    unsigned int getMaxHistorySize_();
+    void importStepCache_(const std::string&);
+    int restoreRun_(int);
+    void trimHistory_(unsigned int);
 
     void keyPressEvent(QKeyEvent *);
     void dragEnterEvent(QDragEnterEvent *);
@@ -98,6 +102,10 @@ private:
     ToothLife *toothLifeWork;               // Currently active ToothLife object
     std::vector<ToothLife*> toothHistory;   // Model history
     uint currentHistory;                    // Index of currently viewed history item
+    Workspace workspace;                    // Run IDs & run folders
+    ResultStore resultStore;                // Outputs of completed runs
+    std::string runKey;                     // Run key of the latest run
+    int restored;                           // 1 if the latest run was loaded from resultStore
     std::string tempPathMorpho;             // System temporary files path
     int currentModel;                       // Index of the currently viewed model
 
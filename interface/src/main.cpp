@@ -32,7 +32,12 @@ void printHelp()
     // printf("'--step N' : Step size. Use with '--export-images' to store intermedia results\n");
     // printf("             from the model every N iterations.\n");
     printf("'--resolution [pixels]' : Pixel width/height of rendered square images.\n");
-    printf("                          Defaults to %d.", SQUARE_WIN_SIZE);
+    printf("                          Defaults to %d.\n", SQUARE_WIN_SIZE);
+    printf("'--jobs N' : Number of models to run at once when scanning. Defaults to 1.\n");
+    printf("'--resume' : Continues an interrupted scan, skipping the items done. The\n");
+    printf("             parameters, scan file and iterations must be the same.\n");
+    printf("'--shared [folder]' : Shares the scan items with other processes running the\n");
+    printf("                      same scan through a folder, e.g. on other nodes.\n");
     printf("\n");
 }
 
@@ -58,10 +63,14 @@ void printVersion()
  * @param step      Step size.
  * @param expimg    Export images (1/0).
  * @param res       Resolution for square domain.
+ * @param jobs      Number of concurrent model runs.
+ * @param resume    Resume an interrupted scan (1/0).
+ * @param shared    Queue folder shared with other processes.
  * @return          1 if requested version or help, else 0.
  */
 int handleArguments(int argc, char **argv, int *niter, int *parfile, int *scanfile,
-                    int *step, int *expimg, int *res)
+                    int *step, int *expimg, int *res, int *jobs, int *resume,
+                    int *shared)
 {
     int i;
 
@@ -81,6 +90,9 @@ int handleArguments(int argc, char **argv, int *niter, int *parfile, int *scanfi
         if (!strcmp(argv[i], "--step")) *step=atoi(argv[i+1]);
         if (!strcmp(argv[i], "--export-images")) *expimg=1;
         if (!strcmp(argv[i], "--resolution")) *res=atoi(argv[i+1]);
+        if (!strcmp(argv[i], "--jobs")) *jobs=atoi(argv[i+1]);
+        if (!strcmp(argv[i], "--resume")) *resume=1;
+        if (!strcmp(argv[i], "--shared")) *shared=i+1;
     }
 
     return 0;
@@ -119,11 +131,11 @@ void message_output(QtMsgType type, const QMessageLogContext& context, const QSt
 int main(int argc, char *argv[])
 {
     int niter=-1, parfile=0, scanfile=0;
-    int step=-1, expimg=0, res=SQUARE_WIN_SIZE;
+    int step=-1, expimg=0, res=SQUARE_WIN_SIZE, jobs=1, resume=0, shared=0;
 
     if (argc>1) {
         if (handleArguments( argc, argv, &niter, &parfile, &scanfile, &step,
-                             &expimg, &res )) {
+                             &expimg, &res, &jobs, &resume, &shared )) {
             return 0;
         }
     }
@@ -134,7 +146,8 @@ int main(int argc, char *argv[])
     if (argc>1 && niter>-1 && parfile>0 && scanfile>0) {
         CmdAppCore cmdAppCore(argc, argv);
         if (cmdAppCore.startParameterScan( niter, argv[parfile], argv[scanfile],
-                                           step, expimg, res )) {
+                                           step, expimg, res, jobs, resume,
+                                           shared ? argv[shared] : NULL )) {
             return -1;
         }
         return cmdAppCore.exec();
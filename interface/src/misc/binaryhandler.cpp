@@ -10,20 +10,108 @@
 
 #include <iostream>
 #include <sstream>
-#include <cmath>
+#include <cctype>
+#include <algorithm>
 #include <ctime>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <mutex>
 
 #include <QDir>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QCryptographicHash>
 #include <QCoreApplication>
 #include <QTextStream>
 #include <QTime>
 #include <QDebug>
 
 #include "misc/binaryhandler.h"
+#include "misc/loader.h"
 #include "utils/writeparameters.h"
 #include "readdata.h"
 #include "morphomaker.h"
 
+#if defined(__linux__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+
+namespace {
+
+// A model file staged into the temp. folder.
+struct staged_file_ {
+    qint64 size;            // source size when staged
+    QDateTime modified;     // source modification time when staged
+};
+
+// Staged files of the process by staged path; shared by all handlers.
+std::map<QString, staged_file_> staged_files_;
+std::mutex staged_mtx_;
+
+
+
+/**
+ * @brief Returns the content hash of a file.
+ * @param path      File path.
+ * @return          SHA-1 hash, empty if the file can't be read.
+ */
+QByteArray file_hash_( const QString& path )
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QByteArray();
+    }
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(&file);
+    return hash.result();
+}
+
+
+
+/**
+ * @brief Places a file into the temp. folder as a hard link, or a symbolic
+ *        link if hard links fail (e.g. different file systems), or a copy.
+ *        The file is completed under a temporary name and then renamed into
+ *        place, so running models never see a partial file.
+ * @param source    Source file path.
+ * @param dest      Target file path.
+ * @return          0 if success, else -1.
+ */
+int stage_file_( const QString& source, const QString& dest )
+{
+    QString part = dest + ".part";
+    QFile::remove(part);
+
+    bool staged = false;
+#if defined(__linux__) || defined(__APPLE__)
+    staged = !link( QFile::encodeName(source).constData(),
+                    QFile::encodeName(part).constData() );
+    if (!staged) {
+        staged = QFile::link(source, part);
+    }
+#endif
+    if (!staged && !QFile::copy(source, part)) {
+        return -1;
+    }
+
+    if (std::rename( QFile::encodeName(part).constData(),
+                     QFile::encodeName(dest).constData() )) {
+        QFile::remove(dest);
+        if (!QFile::rename(part, dest)) {
+            QFile::remove(part);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+}
+
+
 
 BinaryHandler::BinaryHandler() : Model()
 {
@@ -35,11 +123,18 @@ BinaryHandler::BinaryHandler() : Model()
     m_timeLimit = -1;   // by default allowing the binary to run forever (-1)
     m_id = 0;
     m_toothLife = NULL;
+    m_progress = NULL;
+    m_killedByUser = false;
+    m_nextStep = 0;
+    m_restarts = 0;
+    m_resumeStep = -1;
+    m_branchIter = 0;
 }
 
 
 BinaryHandler::~BinaryHandler()
 {
+    closeProgress_();
 }
 
 
@@ -64,13 +159,59 @@ int BinaryHandler::init_model(const QString& temp_path, const int max_cores,
     m_toothLife = &tlife;
     systemTempPath = temp_path;
 
-    setTempEnv_(temp_path);
+    if (setTempEnv_(temp_path)) {
+        return -1;
+    }
+
+    m_parsers.clear();
+    for (auto& parser : outputParsers) {
+        m_parsers.push_back( morphomaker::Load_output_parser(parser) );
+    }
 
-    QDir qdir;
-    qdir.setCurrent(temp_path);
+    // Paths are absolute; several handlers may run at once and the process
+    // working directory is shared.
+    QDir qdir(temp_path);
     QString run_folder = QString::number(m_id);
     qdir.mkdir(run_folder);
-    qdir.setCurrent(run_folder);
+
+    // Models find the progress counter and the step ring through the
+    // environment. Without the counter progress is tracked per step.
+    QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
+    QString progress = temp_path + "/" + run_folder + "/" + run_folder
+                       + ".tmprogress";
+    if (openProgress_(progress) == 0) {
+        env.insert(TMPROGRESS_ENV, QDir::toNativeSeparators(progress));
+    }
+    if (outputStyle == "Stream") {
+        QString ring = temp_path + "/" + run_folder + "/" + run_folder + ".tmring";
+        if (m_stream.create(ring)) {
+            fprintf(stderr, "Error: Couldn't create '%s'.\n",
+                    ring.toStdString().c_str());
+            return -1;
+        }
+        env.insert(TMRING_ENV, QDir::toNativeSeparators(ring));
+    }
+    // Checkpoints of earlier runs with the same ID are not valid for this one.
+    QString checkpoint = temp_path + "/" + run_folder + "/checkpoint";
+    QDir(checkpoint).removeRecursively();
+    if (qdir.mkpath(run_folder + "/checkpoint")) {
+        env.insert(TMCHECKPOINT_ENV, QDir::toNativeSeparators(checkpoint));
+        env.insert(TMCHECKPOINT_EVERY_ENV,
+                   QString::number(CHECKPOINT_STEPS*step_size));
+        if (!m_saveState.isEmpty()) {
+            env.insert(TMCHECKPOINT_FINAL_ENV, "1");
+        }
+    }
+    if (!m_branchState.isEmpty() &&
+        stage_file_(m_branchState, checkpoint + "/" + BRANCH_STATE)) {
+        fprintf(stderr, "Error: Couldn't stage '%s'.\n",
+                m_branchState.toStdString().c_str());
+        return -1;
+    }
+    m_process.setProcessEnvironment(env);
+    m_nextStep = 0;
+    m_restarts = 0;
+    m_resumeStep = -1;
 
     QString parfile;
     QTextStream str;
@@ -83,6 +224,15 @@ int BinaryHandler::init_model(const QString& temp_path, const int max_cores,
     }
     stepSize = step_size;
     nIter = num_iter;
+    currentIter = 0;
+    startIter = 0;
+
+    // A branched run adds the steps after the branch iteration only.
+    if (!m_branchState.isEmpty()) {
+        m_nextStep = m_branchIter/step_size + 1;
+        currentIter = m_branchIter;
+        startIter = m_branchIter;
+    }
 
     // Can't send the parameter file with the full path to the binary,
     // as some programs have difficulties with long arguments.
@@ -109,8 +259,15 @@ int BinaryHandler::start_model()
     retval = 0;
     m_process.setProcessChannelMode( QProcess::ForwardedChannels );
     m_killedByUser = false;
-    qDebug().nospace() << "Executing " << m_cmd;
-    m_process.start(m_cmd);
+
+    // Watch the run folder for output files before the binary writes any;
+    // run() falls back to polling if not supported.
+    QString run_path = systemTempPath + "/" + QString::number(m_id);
+    m_watcher.watch( run_path.toStdString() );
+
+    qDebug().nospace() << "Executing " << m_cmd << branchArgs_();
+    m_process.setWorkingDirectory(run_path);
+    m_process.start(m_cmd + branchArgs_());
 
     m_killTimer.setInterval(m_timeLimit);
     QObject::connect(&m_killTimer, &QTimer::timeout, [&]() {
@@ -164,11 +321,12 @@ void BinaryHandler::stop_model()
 Mesh& BinaryHandler::fill_mesh( Tooth& tooth )
 {
     Mesh& mesh = tooth.get_mesh();
-    if (outputStyle != "Humppa") {
+    if (outputStyle != "Humppa" && outputStyle != "Stream") {
         return mesh;
     }
 
-    // The following is specific to Humppa.
+    // The following is specific to Humppa; streaming models use the same
+    // conventions.
     // For view_mode=0 use the default tooth color, view_mode=1 uses the vertex
     // colors given in the output .off file, view_mode>1 use the morphogen
     // concentrations stored as cell data.
@@ -215,19 +373,60 @@ Mesh& BinaryHandler::fill_mesh( Tooth& tooth )
 
 
 
+/**
+ * @brief Returns the number of iterations completed, from the progress
+ *        counter if the model reports it, else the iteration of the latest
+ *        step.
+ * @return          Iterations completed.
+ */
+int BinaryHandler::getIteration()
+{
+    if (m_progress == NULL ||
+        tmring_load32_(&m_progress->state) == TMPROGRESS_NONE) {
+        return currentIter;
+    }
+    uint64_t iter = std::min( tmring_load_(&m_progress->iter), (uint64_t)nIter );
+    return std::max( currentIter, (int)iter );
+}
+
+
+
+/**
+ * @brief Saves the model state at the end of the next run.
+ * @param file      State file.
+ */
+void BinaryHandler::setSaveState( const QString& file )
+{
+    m_saveState = file;
+}
+
+
+
+/**
+ * @brief Starts the next run from a saved state.
+ * @param file      State file saved by setSaveState(), empty for a full run.
+ * @param iter      Iteration of the state.
+ */
+void BinaryHandler::setBranchState( const QString& file, int iter )
+{
+    m_branchState = file;
+    m_branchIter = file.isEmpty() ? 0 : iter;
+}
+
+
+
 /**
  * @brief Apply output parsers, return the next expected model output file name(s).
  * @param step          Step number to search the files for.
- * @param test_only     If true, only tests if the expected output file exists.
+ * @param tooth         Object for the in-process parsers; if NULL, only tests
+ *                      if the expected output file exists.
  * @return              Vector containing the output file name(s).
  */
-std::vector<std::string> BinaryHandler::getDataFilenames_( int step,
-                                                           bool test_only )
+std::vector<std::string> BinaryHandler::getDataFilenames_( int step, Tooth* tooth )
 {
     std::vector<std::string> output_files;
-    QString run_id = QString::number( m_toothLife->getID() );
+    QString run_id = QString::number( m_id );
     QString run_path = systemTempPath + "/" + run_id + "/";
-    QDir qdir(run_path);
 
     std::string ext = "";
     if (outputStyle == "PLY" || outputStyle == "")
@@ -243,20 +442,21 @@ std::vector<std::string> BinaryHandler::getDataFilenames_( int step,
     // TODO: Imnplement control of output file names.
     //
 
-    // Note: allowing for some room in the input file name:
+    // Parsers write their output under the fixed name below; it is not
+    // parsed again if there are other files for the step.
     int iter = step*stepSize;
-    QString target = QString::number(iter) + "*" + run_id + "*"
-                     + QString(ext.c_str());
-    QStringList filter;
-    filter << target;
-    QFileInfoList files = qdir.entryInfoList( filter, QDir::Files );
+    QString outfile = QString::number(iter) + "_" + run_id + QString(ext.c_str());
+    QStringList files = getStepFiles_( step, ext );
+    if (files.size() > 1) {
+        files.removeAll( outfile );
+    }
 
     if (files.size() == 0)
         return output_files;
 
-    if (test_only) {
+    if (tooth == NULL) {
         for (auto file : files) {
-            output_files.push_back( file.fileName().toStdString() );
+            output_files.push_back( file.toStdString() );
         }
         return output_files;
     }
@@ -264,24 +464,35 @@ std::vector<std::string> BinaryHandler::getDataFilenames_( int step,
 /*
     std::cout << std::endl;
     std::cout << "** Running parsers in " << run_path.toStdString() << std::endl;
-    std::cout << "** Parser target " << target.toStdString() << std::endl;
     std::cout << "** Number of files to be parsed: " << files.size() << std::endl;
 */
 
     // Apply parsers
     for (int i=0; i<files.size(); i++) {
-        QString file = files.at(i).fileName();
-
-        for (auto& parser : outputParsers) {
-            QString path_style = "..\bin\\";
-            #if defined(__linux__) || defined(__APPLE__)
-            path_style = "../bin/";
-            #endif
-            QString parser_out = "parser_tmp_" + run_id + ".txt";
-            QString cmd = path_style + parser + " " + file + " "
+        QString file = files.at(i);
+
+        for (uint32_t k=0; k<outputParsers.size(); k++) {
+            const QString& parser = outputParsers.at(k);
+
+            // In-process parsers work on the object, not on the files.
+            if (k < m_parsers.size() && m_parsers.at(k) != NULL) {
+                std::string path = (run_path + file).toStdString();
+                if (m_parsers.at(k)->parse( path, *tooth )) {
+                    qDebug() << "Error: Parser" << parser << "failed on file"
+                             << file << ". Skipping.";
+                }
+                continue;
+            }
+
+            QString parser_bin = QDir::toNativeSeparators(systemTempPath
+                                                          + "/bin/" + parser);
+            QString parser_out = "parser_tmp_" + run_id + "_"
+                                 + QString::number(iter) + ".txt";
+            QString cmd = "\"" + parser_bin + "\" " + file + " "
                           + parser_out;
 
             QProcess process;
+            process.setWorkingDirectory(run_path);
             process.start(cmd);
             if(!process.waitForFinished( PARSER_TIMEOUT )) {
                 // TODO: Add checks for other errors, e.g., does the parser exist.
@@ -291,17 +502,16 @@ std::vector<std::string> BinaryHandler::getDataFilenames_( int step,
             }
 
             // Replace the input file with the parser output if applicable.
-            if (QFile::exists(parser_out)) {
-                QFile::remove(file);
-                QFile::copy(parser_out, file);
-                QFile::remove(parser_out);
+            if (QFile::exists(run_path + parser_out)) {
+                QFile::remove(run_path + file);
+                QFile::copy(run_path + parser_out, run_path + file);
+                QFile::remove(run_path + parser_out);
             }
         }
     }
 
     // Assuming a fixed output file name for now.
-    std::string outfile = std::to_string(iter) + "_" + run_id.toStdString() + ext;
-    output_files.push_back( outfile );
+    output_files.push_back( (run_path + outfile).toStdString() );
 
     return output_files;
 }
@@ -309,67 +519,289 @@ std::vector<std::string> BinaryHandler::getDataFilenames_( int step,
 
 
 /**
- * @brief Adds an object to toothLife.
- *        Called from run() when a new step available.
- * @param stepTest
- * @return      0 if success (no error handling).
+ * @brief Returns the extensions of the output files of a single step.
+ * @return      Extensions, empty if the output style is unknown.
+ */
+std::vector<std::string> BinaryHandler::getDataExtensions_()
+{
+    if (outputStyle == "PLY" || outputStyle == "")
+        return { ".ply" };
+    if (outputStyle == "Matrix")
+        return { ".txt" };
+    if (outputStyle == "Humppa")
+        return { ".off", ".dad" };
+    return {};
+}
+
+
+
+/**
+ * @brief Returns the step of a model output file name.
+ *
+ * Output files are named <iter>_<id><ext>, where the separator may be padded
+ * with further underscores (Humppa).
+ *
+ * @param name      File name.
+ * @param ext       Expected extension.
+ * @return          Step, or -1 if name isn't an output file of this run.
+ */
+int BinaryHandler::getOutputStep_( const std::string& name,
+                                   const std::string& ext )
+{
+    if (name.size() <= ext.size() ||
+        name.compare( name.size()-ext.size(), ext.size(), ext )) {
+        return -1;
+    }
+    size_t end = name.size() - ext.size();
+
+    size_t i = 0;
+    long iter = 0;
+    while (i < end && isdigit(name[i]) && iter < MAX_ITER) {
+        iter = iter*10 + (name[i++]-'0');
+    }
+    if (i == 0 || i == end || name[i] != '_') {
+        return -1;
+    }
+    while (i < end && name[i] == '_') {
+        i++;
+    }
+
+    std::string id = std::to_string(m_id);
+    if (name.compare( i, id.size(), id ) || i+id.size() > end) {
+        return -1;
+    }
+    for (i += id.size(); i < end; i++) {
+        if (name[i] != '_') {
+            return -1;
+        }
+    }
+
+    if (stepSize <= 0 || iter % stepSize) {
+        return -1;
+    }
+    return iter / stepSize;
+}
+
+
+
+/**
+ * @brief Returns the output files of a step with an extension, i.e. those
+ *        whose step is given by getOutputStep_().
+ * @param step      Step.
+ * @param ext       Extension.
+ * @return          File names in the run folder.
+ */
+QStringList BinaryHandler::getStepFiles_( int step, const std::string& ext )
+{
+    QString run_path = systemTempPath + "/" + QString::number(m_id) + "/";
+    QStringList filter( QString::number(step*stepSize) + "_*" + QString(ext.c_str()) );
+
+    QStringList files;
+    for (auto& name : QDir(run_path).entryList( filter, QDir::Files )) {
+        if (getOutputStep_( name.toStdString(), ext ) == step) {
+            files << name;
+        }
+    }
+    return files;
+}
+
+
+
+/**
+ * @brief Event-driven tracker loop. Adds each step as soon as all its output
+ *        files have been closed after writing, i.e. without waiting for the
+ *        next step to appear.
+ * @param step      Next step to be added; updated.
+ * @return          0 if all output was processed, -1 if events were lost and
+ *                  the run folder must be polled from step on.
+ */
+int BinaryHandler::watchOutput_( int& step )
+{
+    std::vector<std::string> exts = getDataExtensions_();
+    if (exts.empty()) {
+        return -1;
+    }
+    const unsigned int all = (1u << exts.size()) - 1;
+
+    std::map<int, unsigned int> written;    // step -> bit per written file
+    std::vector<std::string> files;
+    bool restart = false;
+
+    while (1) {
+        // Test before waiting; after the binary has exited all its output is
+        // in the event queue.
+        bool finished = m_process.state() != QProcess::Running;
+
+        files.clear();
+        if (m_watcher.wait( files, finished ? 0 : OUTPUT_WAIT_TIMEOUT ) < 0) {
+            return -1;
+        }
+        for (auto& file : files) {
+            for (size_t k=0; k<exts.size(); k++) {
+                int s = getOutputStep_( file, exts.at(k) );
+                if (s >= step) {
+                    written[s] |= 1u << k;
+                }
+            }
+        }
+
+        // Files are closed when a crashed model exits, including those of a
+        // step it was still writing; after a crash the last steps are left
+        // to the restarted model, which writes them again.
+        restart = finished && restartPending_();
+        while (!restart && written.count(step) && written[step] == all) {
+            written.erase(step);
+            m_pipeline.push(step);
+            step++;
+        }
+
+        if (finished) {
+            break;
+        }
+    }
+
+    // Output without events, e.g. closed before the folder was watched.
+    while (!restart && getDataFilenames_( step, NULL ).size() > 0) {
+        m_pipeline.push(step);
+        step++;
+    }
+
+    return 0;
+}
+
+
+
+/**
+ * @brief Stream tracker loop. Adds the steps in the order the model publishes
+ *        them, until the model has exited and all its steps have been read.
+ */
+void BinaryHandler::streamOutput_()
+{
+    int wait = 1;
+    Tooth* tooth = NULL;
+
+    while (1) {
+        // Test before reading; after the binary has exited all its steps are
+        // in the ring.
+        bool finished = m_process.state() != QProcess::Running;
+
+        int s = 0, rv = 0;
+        do {
+            if (tooth == NULL) {
+                tooth = m_toothLife->newTooth( renderMode );
+            }
+            rv = m_stream.read( s, *tooth );
+            if (rv > 0 && s < m_nextStep) {
+                // Published again after a restart from a checkpoint.
+                m_toothLife->discardTooth(tooth);
+                tooth = NULL;
+            }
+            else if (rv > 0) {
+                m_toothLife->addTooth(tooth);
+                currentIter = s*stepSize;
+                m_nextStep = s+1;
+                tooth = NULL;
+            }
+            else if (rv < 0) {
+                qDebug() << "Error: Invalid step" << s << "in stream. Skipping.";
+            }
+            if (rv != 0) {
+                wait = 1;
+            }
+        } while (rv != 0);
+
+        if (finished) {
+            break;
+        }
+
+        // Back off while the model computes the next step.
+        msleep(wait);
+        wait = std::min( 2*wait, UPDATE_INTERVAL );
+    }
+
+    if (tooth != NULL) {
+        m_toothLife->discardTooth(tooth);
+    }
+    m_stream.close();
+}
+
+
+
+/**
+ * @brief Reads the object of a step. Called by the parser workers, possibly
+ *        for several steps at once.
+ * @param step_test     Step.
+ * @return              Object, NULL if the output can't be read.
  */
-int BinaryHandler::addTooth_(const int step_test)
+Tooth* BinaryHandler::readTooth_(const int step_test)
 {
-    Tooth *tooth = new Tooth( renderMode );
+    Tooth *tooth = m_toothLife->newTooth( renderMode );
 
     // Get the output file names, apply parsers:
-    auto output_files = getDataFilenames_( step_test, false );
+    auto output_files = getDataFilenames_( step_test, tooth );
     if (output_files.size() == 0) {
-        m_toothLife->addTooth(tooth);
-        return 0;
+        return tooth;
     }
     std::string fname = output_files.at(0);     // Yes, this is on purpose...
 
+    // In-process output parsers may have read the object already.
+    bool parsed = !tooth->get_mesh().get_vertices().empty() ||
+                  !tooth->get_cell_data().empty();
+
     // Incomplete data files are not considered fatal errors, but the won't get
     // added to ToothLife. This may cause the object indices to be incorrectly
     // assigned if the model skips over result files.
     if (outputStyle == "PLY" || outputStyle == "") {
-        if (morphomaker::Read_PLY_file( fname, *tooth )) {
-            return -1;
+        if (!parsed && morphomaker::Read_PLY_file( fname, *tooth )) {
+            m_toothLife->discardTooth(tooth);
+            return NULL;
         }
     }
     else if (outputStyle == "Matrix") {
-        if (morphomaker::Read_BIN_matrix( fname, *tooth )) {
-            return -1;
+        if (!parsed && morphomaker::Read_BIN_matrix( fname, *tooth )) {
+            m_toothLife->discardTooth(tooth);
+            return NULL;
         }
     }
     else if (outputStyle == "Humppa") {
-        morphomaker::Read_OFF_file( fname, *tooth );
-        if (morphomaker::Read_Humppa_DAD_file( step_test, stepSize, m_id, *tooth )) {
-            return -1;
+        if (!parsed) {
+            morphomaker::Read_OFF_file( fname, *tooth );
+        }
+
+        // Cell shapes and concentrations are in the .dad file of the same
+        // step; the dad_to_polygons parser reads them with the neighbours.
+        if (tooth->get_cell_data().empty()) {
+            QString run_path = systemTempPath + "/" + QString::number(m_id) + "/";
+            QStringList dad_files = getStepFiles_( step_test, ".dad" );
+            if (dad_files.size() == 0 ||
+                morphomaker::Read_Humppa_DAD_file( (run_path + dad_files.at(0)).toStdString(),
+                                                   *tooth )) {
+                m_toothLife->discardTooth(tooth);
+                return NULL;
+            }
         }
     }
     else {}
 
-    m_toothLife->addTooth(tooth);
-
-    return 0;
+    return tooth;
 }
 
 
 
 /**
- * @brief Copies model binary to the temporary folder.
+ * @brief Stages the model binaries into the temporary folder.
  * @param temp_path     System temporary folder.
- * @return              0 if success.
+ * @return              0 if success, else -1.
  */
 int BinaryHandler::setTempEnv_(const QString& temp_path)
 {
-    QDir qdir;
-    qdir.setCurrent(temp_path);
+    QDir qdir(temp_path);
 
     // Set up a bin directory where to move the model binaries.
     if (!qdir.exists("bin")) {
         qdir.mkdir("bin");
     }
     QString temp_bin_path = temp_path + "/bin";
-    qdir.setCurrent(temp_bin_path);
 
     // Assuming the model binaries reside under ../Resources/bin/ relative
     // to the app. dir.
@@ -382,17 +814,44 @@ int BinaryHandler::setTempEnv_(const QString& temp_path)
                 resources.path().toStdString().c_str());
         fprintf(stderr, "Application directory: %s\n",
                 QCoreApplication::applicationDirPath().toStdString().c_str());
-        fprintf(stderr, "Current directory: '%s'\n",
-                qdir.currentPath().toStdString().c_str());
+        fprintf(stderr, "Binary directory: '%s'\n",
+                temp_bin_path.toStdString().c_str());
     }
 
+    // Files are staged once per process and restaged only if the source has
+    // changed; the staged files are replaced only if their content differs.
+    QElapsedTimer timer;
+    timer.start();
+    int n = 0;
+
+    std::lock_guard<std::mutex> lock(staged_mtx_);
     QStringList files = resources.entryList(QDir::Files);
     for (auto& f : files) {
-        auto dest = temp_bin_path+"/"+f;
-        if (QFile::exists(dest)) {
-            QFile::remove(dest);
+        QFileInfo source(resources.path()+"/"+f);
+        QString dest = temp_bin_path+"/"+f;
+
+        auto it = staged_files_.find(dest);
+        if (it != staged_files_.end() && it->second.size == source.size() &&
+            it->second.modified == source.lastModified() && QFile::exists(dest)) {
+            continue;
         }
-        QFile::copy(resources.path()+"/"+f, dest);
+
+        QByteArray hash = file_hash_(source.filePath());
+        if (!QFile::exists(dest) || file_hash_(dest) != hash) {
+            if (stage_file_(source.filePath(), dest)) {
+                fprintf(stderr, "Error: Couldn't stage '%s' into '%s'.\n",
+                        source.filePath().toStdString().c_str(),
+                        temp_bin_path.toStdString().c_str());
+                return -1;
+            }
+            n++;
+        }
+        staged_files_[dest] = { source.size(), source.lastModified() };
+    }
+
+    if (n) {
+        std::cout << "Staged " << n << " model files in " << timer.elapsed()
+                  << " ms." << std::endl;
     }
 
     return 0;
@@ -410,16 +869,8 @@ int BinaryHandler::setTempEnv_(const QString& temp_path)
 int BinaryHandler::setBinSettings_(const QString& parfile, const int num_iter,
                                      const int step_size)
 {
-    QString fname = "progress_" + QString::number(m_id) + ".txt";
-    if (outputStyle == "Humppa") {
-        fname = QString::number(m_id) + "______progressbar.txt";
-    }
-    m_progressFile.setFileName(fname);
-
-    QString path_style = "..\bin\\";
-    #if defined(__linux__) || defined(__APPLE__)
-    path_style = "../bin/";
-    #endif
+    // The staged binary is referred to directly.
+    QString binary = QDir::toNativeSeparators(systemTempPath + "/bin/" + m_binary);
 
     m_cmd = "";
     QTextStream str;
@@ -432,7 +883,7 @@ int BinaryHandler::setBinSettings_(const QString& parfile, const int num_iter,
         str << "python ";
     }
 
-    str << path_style << m_binary << " ";
+    str << "\"" << binary << "\" ";
     if (inputStyle == "MorphoMaker" || inputStyle == "") {
         str << "--param " << parfile << " --id " << m_id << " --step "
             << step_size << " --niter " << num_iter;
@@ -455,32 +906,180 @@ int BinaryHandler::setBinSettings_(const QString& parfile, const int num_iter,
 
 
 /**
- * @brief Returns the last number in a file with numbers running from 1 to n
- *        based on the file size.
- * @param size              File size in bytes.
- * @param cat               Progress file sizes per category (see run() for details).
- * @param trail_size        Number of extra white spaces on a progress file line.
- * @return                  Last number.
+ * @brief Creates the progress counter file and maps it to memory.
+ * @param path      File path.
+ * @return          0 if success, else -1.
  */
-int BinaryHandler::calcProgress_( int size, std::vector<long>& cat,
-                                   int trail_size )
+int BinaryHandler::openProgress_(const QString& path)
 {
-    // Find the correct category.
-    uint pos = 0;
-    for (auto& i : cat) {
-        if (size > i) {
-            pos++;
+    closeProgress_();
+
+    m_progressFile.setFileName(path);
+    uchar* map = NULL;
+    if (!m_progressFile.open(QIODevice::ReadWrite | QIODevice::Truncate) ||
+        !m_progressFile.resize(TMPROGRESS_SIZE) ||
+        !(map = m_progressFile.map(0, TMPROGRESS_SIZE))) {
+        if (m_progressFile.isOpen()) {
+            m_progressFile.close();
+            m_progressFile.remove();
         }
+        return -1;
     }
-    if (pos >= cat.size()) {
+
+    m_progress = reinterpret_cast<tmprogress_header*>(map);
+    memset(m_progress, 0, TMPROGRESS_SIZE);
+    m_progress->version = TMPROGRESS_VERSION;
+    m_progress->state = TMPROGRESS_NONE;
+    m_progress->magic = TMPROGRESS_MAGIC;
+
+    return 0;
+}
+
+
+
+/**
+ * @brief Keeps the last reported iteration, unmaps and removes the progress
+ *        counter file.
+ */
+void BinaryHandler::closeProgress_()
+{
+    if (m_progress == NULL) {
+        return;
+    }
+    currentIter = getIteration();
+    m_progressFile.unmap(reinterpret_cast<uchar*>(m_progress));
+    m_progress = NULL;
+    m_progressFile.close();
+    m_progressFile.remove();
+}
+
+
+
+/**
+ * @brief Returns the latest complete checkpoint of the model.
+ * @return          File name in the checkpoint folder, empty if none.
+ */
+QString BinaryHandler::latestCheckpoint_()
+{
+    QDir qdir(systemTempPath + "/" + QString::number(m_id) + "/checkpoint");
+    QStringList files = qdir.entryList( QStringList("*" TMCHECKPOINT_EXT),
+                                        QDir::Files );
+
+    // Named <iter>.ckpt; partial checkpoints have a further extension.
+    QString latest;
+    qlonglong latest_iter = -1;
+    for (auto& f : files) {
+        bool ok = false;
+        qlonglong iter = f.left( f.size()-strlen(TMCHECKPOINT_EXT) ).toLongLong(&ok);
+        if (ok && iter > latest_iter) {
+            latest = f;
+            latest_iter = iter;
+        }
+    }
+
+    return latest;
+}
+
+
+
+/**
+ * @brief Returns true if the model has exited and is to be restarted from a
+ *        checkpoint, i.e. it crashed or exited with an error and there is a
+ *        checkpoint or branch state to restart from. Not done if stopped by
+ *        the user or the time limit, or after CHECKPOINT_RESTARTS restarts.
+ */
+bool BinaryHandler::restartPending_()
+{
+    if (m_process.state() != QProcess::NotRunning ||
+        m_killedByUser || m_restarts >= CHECKPOINT_RESTARTS ||
+        (m_process.exitStatus() == QProcess::NormalExit &&
+         m_process.exitCode() == 0)) {
+        return false;
+    }
+    // A branched run without checkpoints of its own is branched again.
+    return !latestCheckpoint_().isEmpty() || !branchArgs_().isEmpty();
+}
+
+
+
+/**
+ * @brief Restarts the model from its latest checkpoint if it crashed or
+ *        exited with an error; see restartPending_().
+ * @return          True if the model was restarted.
+ */
+bool BinaryHandler::restartFromCheckpoint_()
+{
+    if (!restartPending_()) {
+        return false;
+    }
+    QString checkpoint = latestCheckpoint_();
+    QString args = branchArgs_();
+    if (!checkpoint.isEmpty()) {
+        args = " " TMCHECKPOINT_RESUME " \"checkpoint/" + checkpoint + "\"";
+    }
+
+    QString run_path = systemTempPath + "/" + QString::number(m_id);
+    if (outputStyle == "Stream" &&
+        m_stream.create( run_path + "/" + QString::number(m_id) + ".tmring" )) {
+        return false;
+    }
+    m_restarts++;
+
+    QString iter = checkpoint.isEmpty() ? QString::number(m_branchIter)
+                                        : checkpoint.section('.', 0, 0);
+    m_resumeStep = stepSize > 0 ? iter.toInt()/stepSize : -1;
+    std::string msg = "Restarting " + m_binary.toStdString() + " from iteration "
+                      + iter.toStdString() + ".";
+    qDebug() << msg.c_str();
+    emit msgStatusBar(msg);
+
+    // The run folder is the working directory; the argument is kept short.
+    retval = 0;
+    m_watcher.watch( run_path.toStdString() );
+    m_process.start( m_cmd + args );
+
+    return true;
+}
+
+
+
+/**
+ * @brief Returns the command line arguments for starting a branched run.
+ * @return          Arguments, empty if the run is not branched.
+ */
+QString BinaryHandler::branchArgs_()
+{
+    if (m_branchState.isEmpty()) {
+        return QString();
+    }
+    // The run folder is the working directory.
+    return " " TMCHECKPOINT_BRANCH " \"checkpoint/" BRANCH_STATE "\"";
+}
+
+
+
+/**
+ * @brief Moves the final checkpoint of a successful run into the file given
+ *        by setSaveState().
+ * @return          0 if success, else -1.
+ */
+int BinaryHandler::saveState_()
+{
+    QString checkpoint = latestCheckpoint_();
+    if (retval || m_process.exitStatus() != QProcess::NormalExit ||
+        m_process.exitCode() != 0 || checkpoint.isEmpty() ||
+        checkpoint.section('.', 0, 0).toInt() != nIter) {
         return -1;
     }
 
-    // The last number in the file is given by the distance to the next size category.
-    long l = cat.at(pos) - size;
-    int last_num = (int)pow(10,pos) - (double)l/(pos+trail_size+1) - 1;
+    QString source = systemTempPath + "/" + QString::number(m_id)
+                     + "/checkpoint/" + checkpoint;
+    QFile::remove(m_saveState);
+    if (!QFile::rename(source, m_saveState) && !QFile::copy(source, m_saveState)) {
+        return -1;
+    }
 
-    return last_num;
+    return 0;
 }
 
 
@@ -495,7 +1094,20 @@ int BinaryHandler::calcProgress_( int size, std::vector<long>& cat,
 void BinaryHandler::binaryFinished_()
 {
     // Wait till run() has returned, which means exec() has returned.
+    m_watcher.wake();
     wait();
+    if (restartFromCheckpoint_()) {
+        return;
+    }
+    if (!m_saveState.isEmpty() && saveState_()) {
+        qDebug() << "Model state was not saved.";
+    }
+    m_saveState.clear();
+    m_branchState.clear();
+    m_branchIter = 0;
+    closeProgress_();
+    QDir(systemTempPath + "/" + QString::number(m_id) + "/checkpoint")
+        .removeRecursively();
     emit finished();
 }
 
@@ -542,27 +1154,38 @@ void BinaryHandler::binaryError_(QProcess::ProcessError err)
  */
 void BinaryHandler::run()
 {
+    if (outputStyle == "Stream") {
+        streamOutput_();
+        return;
+    }
 
-    // Per-iteration progress tracking disabled; causes issues with Humppa's
-    // various incarnations which write the progress file differently.
-/*
-    // Pre-calculate the file size categories for calcProgress_.
-    // Category n indicates the size of the progress files containing integers
-    // in range [1, (10^n)-1].
-    // NOTE: This assumes the newline character is 1 byte in size. Windows?
-    int trail_size = 0;
-    if (outputStyle == "Humppa") {
-        trail_size = 1;     // Humppa adds an extra white space to every line in progress file.
-    }
-    long l = 0;
-    std::vector<long> cat = {l};
-    for (int i=0; i<10; i++) {      // 10 is just a number 'large enough'.
-        l = l + (9 * pow(10,i) * (i+trail_size+2));
-        cat.push_back(l);
+    int step = m_nextStep;  // simulation step currently being processed
+
+    // Steps are parsed in parallel and added to toothLife in order.
+    int nworkers = std::min( (int)std::thread::hardware_concurrency(), PARSE_WORKERS );
+    m_pipeline.start( nworkers,
+                      [this](int s) { return readTooth_(s); },
+                      [this](int s, Tooth* tooth) {
+                          if (tooth != NULL) {
+                              m_toothLife->addTooth(tooth);
+                          }
+                          currentIter = s*stepSize;
+                      } );
+
+    // After a restart the steps up to the checkpoint are complete on disk, but
+    // not all of them were added; they won't be written again.
+    while (step <= m_resumeStep && getDataFilenames_( step, NULL ).size() > 0) {
+        m_pipeline.push(step);
+        step++;
     }
-*/
 
-    int step = 0;   // simulation step currently being processed
+    // Event-driven tracking; continues polling from the current step if events
+    // are not supported or were lost.
+    if (m_watcher.good() && watchOutput_(step) == 0) {
+        m_pipeline.finish();
+        m_nextStep = step;
+        return;
+    }
 
     // Process tracking loop.
     while (m_process.state()==QProcess::Running) {
@@ -571,30 +1194,23 @@ void BinaryHandler::run()
         // Testing for the presence of the next step here, and then reading the
         // current step only if the next already available. This to avoid reading
         // files that are still being written.
-        auto output_files = getDataFilenames_( step+1, true );
+        auto output_files = getDataFilenames_( step+1, NULL );
         if (output_files.size() > 0) {
-            addTooth_(step);
+            m_pipeline.push(step);
             step++;
         }
-
-        // Per-step progress tracking:
-        currentIter = (step == 0) ? 0 : (step-1)*stepSize;
-        // Per-iteration progress tracking (see above):
-        // currentIter = calcProgress_(m_progressFile.size(), cat, trail_size);
     }
 
-    // Get the rest of the result files still in the sequence.
-    while (1) {
-        msleep(UPDATE_INTERVAL);
-
-        addTooth_(step);
-        // Again, just testing if the files exist; addTooth_() actually reads.
-        auto output_files = getDataFilenames_( step+1, true );
-        if (output_files.size() > 0) {
-            step++;
-        }
-        else {
-            break;
-        }
+    // Get the rest of the result files still in the sequence. The binary has
+    // exited normally, so they are complete; a missing step is not added, as
+    // a restart from a checkpoint may still write it. After a crash the
+    // restarted model writes the last steps again.
+    bool restart = restartPending_();
+    while (!restart && getDataFilenames_( step, NULL ).size() > 0) {
+        m_pipeline.push(step);
+        step++;
     }
+
+    m_pipeline.finish();
+    m_nextStep = step;
 }
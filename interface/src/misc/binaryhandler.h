@@ -5,8 +5,18 @@
 #include <QFile>
 #include <QTimer>
 #include "model.h"
+#include "outputparser.h"
+#include "misc/outputwatcher.h"
+#include "misc/parsepipeline.h"
+#include "misc/stepstream.h"
+#include "tmprogress.h"
+#include "tmcheckpoint.h"
 
 #define DEFAULT_TOOTH_COL 0.5   // Default tooth color. 0.5 means middle gray.
+#define OUTPUT_WAIT_TIMEOUT 1000    // Max. time in ms to wait for output events.
+#define CHECKPOINT_STEPS 10         // Steps between model checkpoints.
+#define CHECKPOINT_RESTARTS 2       // Max. number of restarts from a checkpoint per run.
+#define BRANCH_STATE "branch"       // Branch state file name in the checkpoint folder.
 
 class BinaryHandler : public Model
 {
@@ -20,21 +30,46 @@ public:
     int start_model();
     void stop_model();
     Mesh& fill_mesh(Tooth&);
+    int getIteration();
+    void setSaveState(const QString&);
+    void setBranchState(const QString&, int);
 
 
 private:
-    std::vector<std::string> getDataFilenames_(int, bool);
-    int addTooth_(const int);
+    std::vector<std::string> getDataFilenames_(int, Tooth*);
+    std::vector<std::string> getDataExtensions_();
+    int getOutputStep_(const std::string&, const std::string&);
+    QStringList getStepFiles_(int, const std::string&);
+    int watchOutput_(int&);
+    void streamOutput_();
+    Tooth* readTooth_(const int);
     int setTempEnv_(const QString&);
     int setBinSettings_(const QString&, const int, const int);
-    int calcProgress_(int, std::vector<long>&, int);
+    int openProgress_(const QString&);
+    void closeProgress_();
+    QString latestCheckpoint_();
+    bool restartPending_();
+    bool restartFromCheckpoint_();
+    QString branchArgs_();
+    int saveState_();
 
     QProcess m_process;             // model binary process
     QTimer m_killTimer;             // timer for killing the binary after a user-defined limit
-    QFile m_progressFile;           // model progress tracking file
+    QFile m_progressFile;           // model progress counter file
+    tmprogress_header* m_progress;  // mapped progress counter, NULL if none
+    OutputWatcher m_watcher;        // output file events, if supported
+    ParsePipeline m_pipeline;       // parses the detected steps
+    StepStream m_stream;            // steps published by the model (output style Stream)
     QString m_binary;               // model binary name
     QString m_cmd;                  // command line string to execute
+    std::vector<OutputParser*> m_parsers;   // in-process output parsers, NULL if executable
     bool m_killedByUser;
+    int m_nextStep;                 // next step to add; earlier steps are not read again after a restart
+    int m_restarts;                 // restarts from a checkpoint during this run
+    int m_resumeStep;               // step of the checkpoint restarted from, -1 if none
+    QString m_saveState;            // file to save the final state of the run into, if any
+    QString m_branchState;          // state to start the run from, if any
+    int m_branchIter;               // iteration of m_branchState
 
     int m_timeLimit;                // time in ms after which the binary is killed if still running
     int m_id;                       // simulation run ID
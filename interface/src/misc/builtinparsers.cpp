@@ -0,0 +1,271 @@
+/**
+ * @file builtinparsers.cpp
+ * @brief In-process versions of the output parsers shipped with the models.
+ *
+ */
+
+#include <algorithm>
+#include <array>
+
+#include "misc/builtinparsers.h"
+#include "readdata.h"
+#include "writemesh.h"
+
+#define TOOTH_COLOR 0.5         // Default tooth color.
+#define TOOTH_WHITE 1.0         // Color for differentiated cells & knots.
+
+
+namespace {
+
+typedef std::vector<std::vector<uint32_t>> nlist_;
+typedef std::array<uint32_t,3> tri_;
+typedef std::array<uint32_t,4> quad_;
+
+
+/**
+ * @brief Returns the intersection of two index lists, sorted.
+ * @param a         Sorted list.
+ * @param b         Sorted list.
+ */
+std::vector<uint32_t> intersect_( const std::vector<uint32_t>& a,
+                                  const std::vector<uint32_t>& b )
+{
+    std::vector<uint32_t> c;
+    std::set_intersection( a.begin(), a.end(), b.begin(), b.end(),
+                           std::back_inserter(c) );
+    return c;
+}
+
+
+/**
+ * @brief Returns std::set_difference of two index lists as given. The lists
+ *        are in .dad order, so this is not the set difference in general;
+ *        kept as in dad_to_polygons, whose quads depend on it.
+ */
+std::vector<uint32_t> diff_( const std::vector<uint32_t>& a,
+                             const std::vector<uint32_t>& b )
+{
+    std::vector<uint32_t> c;
+    std::set_difference( a.begin(), a.end(), b.begin(), b.end(),
+                         std::back_inserter(c) );
+    return c;
+}
+
+
+/**
+ * @brief Constructs triangles and quads from cell connections data.
+ *
+ * Follows dad_to_polygons step by step: the neighbours are walked in .dad
+ * order, which decides the diagonal along which each quad is split.
+ *
+ * @param nlist     Neighbour indices of each cell in .dad order.
+ * @param tris      Triangles.
+ * @param quads     Quads.
+ */
+void construct_triangles_quads_( const nlist_& nlist, std::vector<tri_>& tris,
+                                 std::vector<quad_>& quads )
+{
+    // Sorted copies for the intersections.
+    nlist_ sorted( nlist );
+    for (auto& list : sorted) {
+        std::sort( list.begin(), list.end() );
+    }
+
+    for (uint32_t i=0; i<nlist.size(); i++) {
+        const auto& ni = nlist[i];
+
+        // triangles
+        for (auto j : ni) {
+            for (auto k : intersect_( sorted[j], sorted[i] )) {
+                tris.push_back( {{i, j, k}} );
+            }
+        }
+
+        // quads
+        for (auto j : ni) {
+            for (auto k : diff_( nlist[j], ni )) {
+                if (k == i) continue;
+
+                for (auto w : intersect_( sorted[k], sorted[i] )) {
+                    if (w == j) continue;
+
+                    // w is our candidate fourth node for a quad.
+                    // Make sure the quad is not crossed by triangles:
+                    auto c = intersect_( sorted[w], sorted[j] );
+                    if (diff_( c, { i, k } ).size() > 0)
+                        continue;
+                    if (std::binary_search( sorted[j].begin(), sorted[j].end(), w ))
+                        continue;
+
+                    quads.push_back( {{i, j, k, w}} );
+                }
+            }
+        }
+    }
+}
+
+
+/**
+ * @brief Removes duplicate rows and sorts the rest. Two rows are considered
+ *        equal if they are equal sets.
+ *
+ * Which of the equal rows is kept depends on the order std::sort leaves them
+ * in, as in dad_to_polygons: the rows are sorted by their sorted copies only,
+ * which makes std::sort take the same steps as there.
+ */
+template <size_t N>
+void unique_rows_( std::vector<std::array<uint32_t,N>>& rows )
+{
+    typedef std::pair<std::array<uint32_t,N>, std::array<uint32_t,N>> keyed;
+    std::vector<keyed> keys( rows.size() );
+    for (size_t i=0; i<rows.size(); i++) {
+        keys[i].first = rows[i];
+        std::sort( keys[i].first.begin(), keys[i].first.end() );
+        keys[i].second = rows[i];
+    }
+    std::sort( keys.begin(), keys.end(),
+               [](const keyed& a, const keyed& b){ return a.first < b.first; } );
+
+    std::vector<std::array<uint32_t,N>> unique;
+    for (size_t i=0; i<keys.size(); i++) {
+        if (i == 0 || keys[i].first != keys[i-1].first) {
+            unique.push_back( keys[i].second );
+        }
+    }
+    std::sort( unique.begin(), unique.end() );
+    rows.swap( unique );
+}
+
+
+/**
+ * @brief Returns the name dad_to_polygons writes its output to, i.e.
+ *        [path]/xyz__zyx__.off as [path]/xyz_zyx.off.
+ * @param fname     Humppa .off file.
+ * @return          Output file name, empty if fname is not of that form.
+ */
+std::string output_name_( const std::string& fname )
+{
+    size_t idx = fname.find_last_of("/");
+    idx = idx == std::string::npos ? 0 : idx+1;
+
+    std::vector<std::string> pieces;
+    for (size_t i=idx, j; i<fname.size(); i=j+1) {
+        j = std::min( fname.find('_', i), fname.size() );
+        if (j > i) {
+            pieces.push_back( fname.substr(i, j-i) );
+        }
+    }
+    if (pieces.size() != 3) {
+        return "";
+    }
+    return fname.substr(0, idx) + pieces[0] + "_" + pieces[1] + pieces[2];
+}
+
+}
+
+
+
+/**
+ * @brief Reads the vertices from Humppa's .off file and constructs the
+ *        triangles from the cell connections in the .dad file of the same
+ *        name.
+ *
+ * Each triangle is stored with both orientations, as we don't have the
+ * surface orientation information. Vertices are colored by the
+ * differentiation state given as the alpha value of the .off vertex colors.
+ * The rest of the .dad file is read into the tooth in the same pass. The
+ * mesh is written to [iter]_[id].off as by dad_to_polygons, so that it is
+ * exported with the other output files.
+ *
+ * @param fname     Humppa .off file.
+ * @param tooth     Tooth object to store the mesh.
+ * @return          0 if success, else -1.
+ */
+int DadToPolygons::parse( const std::string& fname, Tooth& tooth )
+{
+    size_t idx = fname.find_last_of(".");
+    if (idx == std::string::npos || fname.compare(idx, std::string::npos, ".off")) {
+        return -1;
+    }
+    std::string dad = fname.substr(0, idx) + ".dad";
+    std::string out = output_name_( fname );
+    if (out.empty()) {
+        return -1;
+    }
+
+    nlist_ nlist;
+    if (morphomaker::Read_OFF_vertices( fname, tooth ) ||
+        morphomaker::Read_Humppa_DAD_file( dad, tooth, &nlist )) {
+        return -1;
+    }
+    Mesh& mesh = tooth.get_mesh();
+
+    std::vector<tri_> tris;
+    std::vector<quad_> quads;
+    construct_triangles_quads_( nlist, tris, quads );
+
+    unique_rows_(tris);
+    unique_rows_(quads);
+    for (auto& q : quads) {
+        tris.push_back( {{q[0], q[1], q[2]}} );
+        tris.push_back( {{q[0], q[2], q[3]}} );
+    }
+    unique_rows_(tris);
+
+    std::vector<uint32_t> sizes( 2*tris.size(), 3 );
+    std::vector<uint32_t> indices;
+    indices.reserve( 6*tris.size() );
+    for (auto& t : tris) {
+        indices.insert( indices.end(), { t[0], t[1], t[2], t[0], t[2], t[1] } );
+    }
+    mesh.set_polygons( sizes, indices );
+
+    mesh::color_array colors( mesh.get_vertex_colors() );
+    for (auto& c : colors) {
+        if (c.a < 0.6) {            // Differentiated
+            c = { TOOTH_WHITE, TOOTH_WHITE, TOOTH_WHITE, 1.0 };
+        }
+        else if (c.a > 0.999) {     // Knot
+            c = { 1.0, 1.0, 0.0, 1.0 };
+        }
+        else {
+            c = { TOOTH_COLOR, TOOTH_COLOR, TOOTH_COLOR, 1.0 };
+        }
+    }
+    mesh.set_vertex_colors( colors );
+    mesh.set_alt_colors( mesh.get_vertex_colors() );
+
+    return morphomaker::Write_OFF_file( out, mesh, "Generated by dad_to_polygons. "
+                                       "Vertex data from Humppa's .off file, "
+                                       "polygons parsed from .dad file." ) ? -1 : 0;
+}
+
+
+
+/**
+ * @brief Does nothing; the output readers skip empty lines.
+ * @return          0.
+ */
+int NoEmptyLines::parse( const std::string& fname, Tooth& tooth )
+{
+    (void)fname;
+    (void)tooth;
+    return 0;
+}
+
+
+
+/**
+ * @brief Returns a built-in output parser.
+ * @param name      Parser name as in the model interface.
+ * @return          Parser, nullptr if there's no built-in parser of the name.
+ */
+OutputParser* morphomaker::Builtin_output_parser( const std::string& name )
+{
+    static DadToPolygons dad_to_polygons;
+    static NoEmptyLines no_empty_lines;
+
+    if (name == "dad_to_polygons") return &dad_to_polygons;
+    if (name == "no_empty_lines") return &no_empty_lines;
+    return nullptr;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+/**
+ * @file builtinparsers.h
+ * @brief In-process versions of the output parsers shipped with the models
+ *        (models/utils).
+ */
+
+#include "outputparser.h"
+
+
+
+// Constructs the triangle mesh of Humppa output from the cell neighbours in
+// the .dad file, as the dad_to_polygons executable.
+class DadToPolygons : public OutputParser
+{
+public:
+    int parse( const std::string& fname, Tooth& tooth );
+};
+
+
+
+// The output readers skip empty lines, so there is nothing to do in memory;
+// stands in for the no_empty_lines executable.
+class NoEmptyLines : public OutputParser
+{
+public:
+    int parse( const std::string& fname, Tooth& tooth );
+};
+
+
+
+namespace morphomaker {
+
+OutputParser* Builtin_output_parser( const std::string& );
+
+}
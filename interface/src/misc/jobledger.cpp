@@ -0,0 +1,247 @@
+/**
+ * @class JobLedger
+ * @brief Append-only record of the states of the jobs of a parameter scan.
+ *
+ * Used by CMDAppCore to resume interrupted scans (--resume).
+ *
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "misc/jobledger.h"
+
+#define LEDGER_HEADER "# scan ledger, jobs %ld, scan %s\n"
+
+namespace {
+
+const char stateChars_[] = "PRDF";
+
+/**
+ * @brief Writes a whole buffer.
+ * @return          0 if success, else -1.
+ */
+int writeAll_( int fd, const char* buf, size_t len )
+{
+    while (len > 0) {
+        ssize_t n = write( fd, buf, len );
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/**
+ * @brief Syncs the folder of a file so that a new file survives a crash.
+ */
+void syncFolder_( const std::string& file )
+{
+    size_t i = file.find_last_of('/');
+    std::string dir = i == std::string::npos ? "." : file.substr(0, i+1);
+    int fd = ::open( dir.c_str(), O_RDONLY );
+    if (fd >= 0) {
+        fsync(fd);
+        ::close(fd);
+    }
+}
+
+}
+
+
+
+JobLedger::JobLedger() : m_fd(-1)
+{
+}
+
+
+
+JobLedger::~JobLedger()
+{
+    close();
+}
+
+
+
+/**
+ * @brief Opens the ledger of a scan for appending.
+ * @param file      Ledger file.
+ * @param njobs     Number of jobs in the scan.
+ * @param scanId    Identifies the scan (no white space); a ledger of another
+ *                  scan is not resumed.
+ * @param resume    If true, reads the job states of an existing ledger and
+ *                  appends to it, else starts a new ledger.
+ * @return          0 if success, else -1.
+ */
+int JobLedger::open( const std::string& file, long njobs,
+                     const std::string& scanId, bool resume )
+{
+    close();
+    m_file = file;
+    m_states.assign( njobs > 0 ? njobs : 0, PENDING );
+
+    bool exists = access( file.c_str(), F_OK ) == 0;
+    if (resume && exists && read_(scanId)) {
+        return -1;
+    }
+
+    int flags = O_WRONLY | O_CREAT | O_APPEND;
+    if (!resume || !exists) {
+        flags |= O_TRUNC;
+    }
+    m_fd = ::open( file.c_str(), flags, 0644 );
+    if (m_fd < 0) {
+        fprintf(stderr, "Error: Can't open file '%s' for writing.\n", file.c_str());
+        return -1;
+    }
+
+    if (!resume || !exists) {
+        char header[256];
+        int len = snprintf(header, sizeof(header), LEDGER_HEADER, njobs,
+                           scanId.c_str());
+        if (writeAll_(m_fd, header, len) || fsync(m_fd)) {
+            fprintf(stderr, "Error: Can't write file '%s'.\n", file.c_str());
+            close();
+            return -1;
+        }
+        syncFolder_(file);
+    }
+
+    return 0;
+}
+
+
+
+/**
+ * @brief Closes the ledger file.
+ */
+void JobLedger::close()
+{
+    if (m_fd >= 0) {
+        ::close( m_fd );
+    }
+    m_fd = -1;
+}
+
+
+
+/**
+ * @brief Reads the job states of the ledger file; a partial last line left
+ *        by a crash is cut off.
+ * @param scanId    Scan ID the ledger must have.
+ * @return          0 if success, else -1.
+ */
+int JobLedger::read_( const std::string& scanId )
+{
+    FILE* f = fopen( m_file.c_str(), "rb" );
+    if (f == NULL) {
+        fprintf(stderr, "Error: Can't open file '%s' for reading.\n", m_file.c_str());
+        return -1;
+    }
+    std::string buf;
+    char chunk[1<<16];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+        buf.append(chunk, n);
+    }
+    fclose(f);
+
+    char header[256];
+    snprintf(header, sizeof(header), LEDGER_HEADER, (long)m_states.size(),
+             scanId.c_str());
+    if (buf.compare(0, strlen(header), header)) {
+        fprintf(stderr, "Error: '%s' is the ledger of another scan.\n",
+                m_file.c_str());
+        return -1;
+    }
+
+    size_t end = buf.find_last_of('\n') + 1;
+    if (end < buf.size() && truncate( m_file.c_str(), end )) {
+        fprintf(stderr, "Error: Can't truncate file '%s'.\n", m_file.c_str());
+        return -1;
+    }
+
+    // Records are '<index> <state> <location>'; the location isn't needed.
+    const char* p = buf.c_str() + strlen(header);
+    const char* stop = buf.c_str() + end;
+    while (p < stop) {
+        char* q;
+        long k = strtol(p, &q, 10);
+        if (q != p && *q == ' ' && k >= 0 && k < (long)m_states.size()) {
+            const char* s = strchr(stateChars_, q[1]);
+            if (q[1] != '\0' && s != NULL) {
+                m_states[k] = (char)(s - stateChars_);
+            }
+        }
+        p = (const char*)memchr(p, '\n', stop-p) + 1;
+    }
+
+    return 0;
+}
+
+
+
+/**
+ * @brief Appends a state change of a job; returns when it is on disk.
+ * @param k         Job index.
+ * @param state     New state.
+ * @param location  Output folder of the job, may be empty.
+ * @return          0 if success, else -1.
+ */
+int JobLedger::setState( long k, State state, const std::string& location )
+{
+    if (k < 0 || k >= (long)m_states.size()) {
+        return -1;
+    }
+    m_states[k] = state;
+    if (m_fd < 0) {
+        return -1;
+    }
+
+    std::string line = std::to_string(k) + " " + stateChars_[state] + " "
+                       + location + "\n";
+    if (writeAll_(m_fd, line.c_str(), line.size()) || fsync(m_fd)) {
+        fprintf(stderr, "Error: Can't write file '%s'.\n", m_file.c_str());
+        return -1;
+    }
+
+    return 0;
+}
+
+
+
+/**
+ * @brief Returns the state of a job.
+ * @param k         Job index.
+ * @return          State; PENDING if not recorded.
+ */
+JobLedger::State JobLedger::getState( long k ) const
+{
+    if (k < 0 || k >= (long)m_states.size()) {
+        return PENDING;
+    }
+    return (State)m_states[k];
+}
+
+
+
+/**
+ * @brief Returns the number of jobs in a state.
+ */
+long JobLedger::count( State state ) const
+{
+    long n = 0;
+    for (char s : m_states) {
+        n += s == state;
+    }
+    return n;
+}
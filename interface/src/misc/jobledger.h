@@ -0,0 +1,48 @@
+#pragma once
+
+/**
+ * @class JobLedger
+ * @brief Append-only record of the states of the jobs of a parameter scan.
+ *
+ * One line per state change, '<job index> <state> <output location>', after
+ * a header line identifying the scan. Each line is written with a single
+ * write() and synced before returning, so after a crash the ledger holds
+ * every state change made before it, at most followed by a partial last line
+ * which is dropped when the ledger is reopened. The last line of a job gives
+ * its state; jobs without lines are pending.
+ */
+
+#include <string>
+#include <vector>
+
+
+
+class JobLedger
+{
+public:
+    enum State { PENDING = 0, RUNNING, DONE, FAILED };
+
+    JobLedger();
+    ~JobLedger();
+
+    // Opens the ledger file of a scan of njobs jobs; see open().
+    int open( const std::string& file, long njobs, const std::string& scanId,
+              bool resume );
+    void close();
+
+    // Appends a state change of job k.
+    int setState( long k, State state, const std::string& location );
+
+    // Returns the state of job k.
+    State getState( long k ) const;
+
+    // Returns the number of jobs in state.
+    long count( State state ) const;
+
+private:
+    int read_( const std::string& scanId );
+
+    std::string m_file;
+    int m_fd;                       // ledger file, -1 if not open
+    std::vector<char> m_states;     // State per job index
+};
@@ -0,0 +1,423 @@
+/**
+ * @class LeaseQueue
+ * @brief Shares the jobs of a parameter scan between processes through a
+ *        folder.
+ *
+ * Used by CMDAppCore (--shared).
+ *
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <utime.h>
+#include <sys/stat.h>
+
+#include "misc/leasequeue.h"
+
+namespace {
+
+/**
+ * @brief Writes a string into a new file; fails if the file exists.
+ * @return          0 if success, else -1.
+ */
+int writeNew_( const std::string& file, const std::string& text )
+{
+    int fd = open( file.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644 );
+    if (fd < 0) {
+        return -1;
+    }
+    bool ok = write( fd, text.c_str(), text.size() ) == (ssize_t)text.size();
+    ok = fsync(fd) == 0 && ok;
+    if (::close(fd) || !ok) {
+        unlink( file.c_str() );
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Reads a small file.
+ * @return          Contents, empty if failed.
+ */
+std::string read_( const std::string& file )
+{
+    std::string text;
+    FILE* f = fopen( file.c_str(), "r" );
+    if (f != NULL) {
+        char buf[256];
+        size_t n = fread( buf, 1, sizeof(buf), f );
+        text.assign( buf, n );
+        fclose(f);
+    }
+    return text;
+}
+
+}
+
+
+
+LeaseQueue::LeaseQueue() : m_nJobs(0), m_next(0)
+{
+}
+
+
+
+LeaseQueue::~LeaseQueue()
+{
+    close();
+}
+
+
+
+/**
+ * @brief Joins the queue of a scan in a folder, creating the queue if needed.
+ * @param dir       Queue folder, shared by the workers.
+ * @param njobs     Number of jobs in the scan.
+ * @param scanId    Identifies the scan (one line).
+ * @return          0 if success, else -1.
+ */
+int LeaseQueue::open( const std::string& dir, long njobs, const std::string& scanId )
+{
+    close();
+
+    char host[256] = "";
+    gethostname( host, sizeof(host)-1 );
+    m_worker = std::string(host) + "_" + std::to_string(getpid()) + "_"
+               + std::to_string(time(NULL));
+
+    for (auto sub : { "", "/lease", "/done", "/workers" }) {
+        std::string path = dir + sub;
+        if (mkdir( path.c_str(), 0755 ) && errno != EEXIST) {
+            fprintf(stderr, "Error: Can't create folder '%s'.\n", path.c_str());
+            return -1;
+        }
+    }
+
+    // The scan file is linked into place complete, by one worker only.
+    std::string scan = dir + "/scan";
+    std::string part = scan + "." + m_worker;
+    std::string text = scanId + "\n";
+    if (writeNew_( part, text )) {
+        fprintf(stderr, "Error: Can't write file '%s'.\n", part.c_str());
+        return -1;
+    }
+    if (link( part.c_str(), scan.c_str() ) && errno != EEXIST) {
+        unlink( part.c_str() );
+        fprintf(stderr, "Error: Can't write file '%s'.\n", scan.c_str());
+        return -1;
+    }
+    unlink( part.c_str() );
+    if (read_(scan) != text) {
+        fprintf(stderr, "Error: '%s' is the queue of another scan.\n", dir.c_str());
+        return -1;
+    }
+
+    m_dir = dir;
+    m_nJobs = njobs > 0 ? njobs : 0;
+    m_next = 0;
+    long now;
+    if (touch_(now) || readDone_()) {
+        close();
+        return -1;
+    }
+
+    return 0;
+}
+
+
+
+/**
+ * @brief Leaves the queue; leases still held expire.
+ */
+void LeaseQueue::close()
+{
+    if (!m_dir.empty()) {
+        unlink( (m_dir + "/workers/" + m_worker).c_str() );
+    }
+    m_dir.clear();
+    m_done.clear();
+    m_leases.clear();
+}
+
+
+
+/**
+ * @brief Touches the worker file.
+ * @param now       Time stamp of the file system, s.
+ * @return          0 if success, else -1.
+ */
+int LeaseQueue::touch_( long& now )
+{
+    std::string file = m_dir + "/workers/" + m_worker;
+    int fd = ::open( file.c_str(), O_WRONLY | O_CREAT, 0644 );
+    if (fd >= 0) {
+        ::close(fd);
+    }
+
+    // No time given: set by the file server.
+    struct stat st;
+    if (utime( file.c_str(), NULL ) || stat( file.c_str(), &st )) {
+        fprintf(stderr, "Error: Can't update file '%s'.\n", file.c_str());
+        return -1;
+    }
+    now = st.st_mtime;
+
+    return 0;
+}
+
+
+
+/**
+ * @brief Reads the list of jobs done.
+ * @return          0 if success, else -1.
+ */
+int LeaseQueue::readDone_()
+{
+    m_done.assign( m_nJobs, 0 );
+
+    std::string path = m_dir + "/done";
+    DIR* dir = opendir( path.c_str() );
+    if (dir == NULL) {
+        fprintf(stderr, "Error: Can't read folder '%s'.\n", path.c_str());
+        return -1;
+    }
+    struct dirent* e;
+    while ((e = readdir(dir)) != NULL) {
+        char* end;
+        long k = strtol( e->d_name, &end, 10 );
+        if (end != e->d_name && *end == '\0' && k >= 0 && k < m_nJobs) {
+            m_done[k] = 1;
+        }
+    }
+    closedir(dir);
+
+    return 0;
+}
+
+
+
+std::string LeaseQueue::leaseFile_( long k )
+{
+    return m_dir + "/lease/" + std::to_string(k);
+}
+
+
+
+std::string LeaseQueue::doneFile_( long k )
+{
+    return m_dir + "/done/" + std::to_string(k);
+}
+
+
+
+/**
+ * @brief Takes over the lease of a job if it has expired.
+ * @param k         Job index.
+ * @param now       Time stamp of the file system, s.
+ * @return          True if the lease is now held by this worker.
+ */
+bool LeaseQueue::reclaim_( long k, long now )
+{
+    std::string lease = leaseFile_(k);
+    struct stat st;
+    if (stat( lease.c_str(), &st ) || now - st.st_mtime <= LEASE_TIMEOUT) {
+        return false;
+    }
+
+    // Only one worker can rename the expired lease away.
+    std::string stale = lease + ".stale." + m_worker;
+    if (rename( lease.c_str(), stale.c_str() )) {
+        return false;
+    }
+
+    // Another worker may have taken the lease over between the stat and the
+    // rename; its fresh lease is put back, unless a new one was created
+    // meanwhile.
+    if (stat( stale.c_str(), &st ) == 0 && now - st.st_mtime <= LEASE_TIMEOUT) {
+        if (link( stale.c_str(), lease.c_str() ) && errno != EEXIST) {
+            rename( stale.c_str(), lease.c_str() );
+        }
+        unlink( stale.c_str() );
+        return false;
+    }
+    unlink( stale.c_str() );
+
+    return writeNew_( lease, m_worker + "\n" ) == 0;
+}
+
+
+
+/**
+ * @brief Claims the next job that is neither done nor leased, or whose lease
+ *        has expired.
+ * @return          Job index, -1 if none.
+ */
+long LeaseQueue::claim()
+{
+    long now;
+    if (!good() || touch_(now)) {
+        return -1;
+    }
+
+    for (; m_next < m_nJobs; m_next++) {
+        long k = m_next;
+        if (m_done[k]) {
+            continue;
+        }
+        if (writeNew_( leaseFile_(k), m_worker + "\n" ) && !reclaim_(k, now)) {
+            continue;
+        }
+
+        // Finished by another worker after the list was read.
+        if (access( doneFile_(k).c_str(), F_OK ) == 0) {
+            unlink( leaseFile_(k).c_str() );
+            m_done[k] = 1;
+            continue;
+        }
+
+        m_leases.insert(k);
+        m_next++;
+        return k;
+    }
+
+    // Leases of workers gone since.
+    std::string path = m_dir + "/lease";
+    DIR* dir = opendir( path.c_str() );
+    if (dir == NULL) {
+        return -1;
+    }
+    long k = -1;
+    struct dirent* e;
+    while (k < 0 && (e = readdir(dir)) != NULL) {
+        char* end;
+        long i = strtol( e->d_name, &end, 10 );
+        if (end == e->d_name || *end != '\0' || i < 0 || i >= m_nJobs ||
+            m_leases.count(i)) {
+            continue;
+        }
+        if (!reclaim_(i, now)) {
+            continue;
+        }
+        if (access( doneFile_(i).c_str(), F_OK ) == 0) {
+            unlink( leaseFile_(i).c_str() );
+            m_done[i] = 1;
+            continue;
+        }
+        k = i;
+    }
+    closedir(dir);
+
+    if (k >= 0) {
+        m_leases.insert(k);
+    }
+    return k;
+}
+
+
+
+/**
+ * @brief Renews the leases held by this worker.
+ * @param lost      Jobs whose lease was taken over by another worker.
+ * @return          0 if success, else -1.
+ */
+int LeaseQueue::renew( std::vector<long>& lost )
+{
+    lost.clear();
+    long now;
+    if (!good() || touch_(now)) {
+        return -1;
+    }
+
+    std::string owner = m_worker + "\n";
+    for (auto it = m_leases.begin(); it != m_leases.end();) {
+        std::string lease = leaseFile_(*it);
+        if (read_(lease) != owner || utime( lease.c_str(), NULL )) {
+            lost.push_back(*it);
+            it = m_leases.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+
+    return 0;
+}
+
+
+
+/**
+ * @brief Marks a job done and releases its lease.
+ * @param k         Job index.
+ * @param failed    True if the job failed; it is not run again either.
+ * @param location  Output folder of the job.
+ * @return          0 if success, else -1.
+ */
+int LeaseQueue::finish( long k, bool failed, const std::string& location )
+{
+    if (!good() || !m_leases.count(k)) {
+        return -1;
+    }
+    m_leases.erase(k);
+
+    std::string done = doneFile_(k);
+    std::string part = done + "." + m_worker;
+    std::string text = std::string(failed ? "F " : "D ") + location + "\n";
+    unlink( part.c_str() );
+    if (writeNew_( part, text ) || rename( part.c_str(), done.c_str() )) {
+        fprintf(stderr, "Error: Can't write file '%s'.\n", done.c_str());
+        unlink( part.c_str() );
+        return -1;
+    }
+    m_done[k] = 1;
+
+    if (read_(leaseFile_(k)) == m_worker + "\n") {
+        unlink( leaseFile_(k).c_str() );
+    }
+
+    return 0;
+}
+
+
+
+/**
+ * @brief Returns true when all jobs are done. Jobs left without a lease or a
+ *        marker by a worker that crashed are claimed again.
+ */
+bool LeaseQueue::drained()
+{
+    if (!good() || m_next < m_nJobs || !m_leases.empty()) {
+        return false;
+    }
+
+    std::string path = m_dir + "/lease";
+    DIR* dir = opendir( path.c_str() );
+    if (dir == NULL) {
+        return false;
+    }
+    bool leased = false;
+    struct dirent* e;
+    while (!leased && (e = readdir(dir)) != NULL) {
+        char* end;
+        strtol( e->d_name, &end, 10 );
+        leased = end != e->d_name && *end == '\0';
+    }
+    closedir(dir);
+    if (leased || readDone_()) {
+        return false;
+    }
+
+    for (long k=0; k<m_nJobs; k++) {
+        if (!m_done[k]) {
+            m_next = k;
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+/**
+ * @class LeaseQueue
+ * @brief Shares the jobs of a parameter scan between processes through a
+ *        folder, e.g. on a file system mounted on several nodes.
+ *
+ * There is no coordinator; each process (worker) claims a job by creating the
+ * lease file 'lease/<job index>' with O_EXCL, and renews its leases by
+ * touching them every LEASE_HEARTBEAT s. A lease not renewed for LEASE_TIMEOUT
+ * s is expired: another worker renames it away and claims the job for itself.
+ * A finished job gets the marker 'done/<job index>', written under another
+ * name and renamed into place, before its lease is removed.
+ *
+ * Lease ages are measured against the time stamp of the worker file
+ * 'workers/<worker>' touched just before, so the clocks of the nodes need not
+ * agree. The file 'scan' holds the scan ID; workers of another scan are
+ * refused.
+ */
+
+#include <string>
+#include <vector>
+#include <set>
+
+#define LEASE_HEARTBEAT 10      // Interval in s for renewing the leases.
+#define LEASE_TIMEOUT   120     // Age in s after which a lease is expired.
+
+
+
+class LeaseQueue
+{
+public:
+    LeaseQueue();
+    ~LeaseQueue();
+
+    // Joins the queue in folder dir of a scan of njobs jobs.
+    int open( const std::string& dir, long njobs, const std::string& scanId );
+    void close();
+
+    // Returns true if joined.
+    bool good() const                   { return !m_dir.empty(); }
+
+    // Claims a job; returns its index, -1 if none can be claimed now.
+    long claim();
+
+    // Renews the leases held; lost gets the jobs claimed by others meanwhile.
+    int renew( std::vector<long>& lost );
+
+    // Marks a claimed job done, or failed, and releases its lease.
+    int finish( long k, bool failed, const std::string& location );
+
+    // Returns true when all jobs are done.
+    bool drained();
+
+private:
+    int touch_( long& now );
+    int readDone_();
+    bool reclaim_( long k, long now );
+    std::string leaseFile_( long k );
+    std::string doneFile_( long k );
+
+    std::string m_dir;
+    std::string m_worker;           // worker ID: host, PID and start time
+    long m_nJobs;
+    long m_next;                    // next job to try to claim
+    std::vector<char> m_done;       // 1 if the job is known done
+    std::set<long> m_leases;        // jobs claimed by this worker
+};
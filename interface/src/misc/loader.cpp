@@ -7,10 +7,13 @@
  */
 
 #include <iostream>
+#include <map>
+#include <mutex>
 #include <QDir>
 #include <QLibrary>
 
 #include "misc/binaryhandler.h"
+#include "misc/builtinparsers.h"
 #include "misc/loader.h"
 #include "utils/readxml.h"
 
@@ -43,61 +46,138 @@ std::vector<QString> _get_model_interfaces()
 
 
 /**
- * @brief Returns the list of available models.
- * @param models        Vector of model objects.
+ * @brief Creates a model object from its interface XML.
+ * @param xml       Interface XML file name.
+ * @return          New model object, nullptr if the model can't be loaded.
  */
-void morphomaker::Load_models( std::vector<Model*> &models )
+Model* morphomaker::Create_model( const QString& xml )
 {
     QDir qdir(QCoreApplication::applicationDirPath());
     qdir.cd(RESOURCES);
     qdir.cd("bin");
 
-    std::vector<QString> xmls = _get_model_interfaces();
     Model model, *modelp;
     typedef Model* create_m();
 
+    // Just getting the model binary file name here; assigning the binary
+    // info later.
+    morphomaker::Read_binary_definitions(xml, model);
+    auto name = model.getBinaryName();
+
+    // Load library models.
+    if (QLibrary::isLibrary(name)) {
+        QString path = qdir.path() + "/" + name;
+        QLibrary library(path);
+        if (!library.load()) {
+            std::cerr << library.errorString().toStdString() << std::endl;
+            return nullptr;
+        }
+
+        create_m* mm = (create_m*)library.resolve(LOAD_NAME);
+        if (!mm) {
+            if (DEBUG_MODE) std::cerr << "Cannot load '" << path.toStdString()
+                                      << "': Unknown error."<< std::endl;
+            return nullptr;
+        }
+        modelp = mm();
+    }
+
+    // Load binary models.
+    else {
+        modelp = new BinaryHandler();
+        if (modelp==NULL) {
+            return nullptr;
+        }
+    }
+
+    morphomaker::Read_binary_definitions( xml, *modelp );
+    modelp->setInterfaceXML(xml);
+
+    return modelp;
+}
+
+
+
+/**
+ * @brief Returns the list of available models.
+ * @param models        Vector of model objects.
+ */
+void morphomaker::Load_models( std::vector<Model*> &models )
+{
+    std::vector<QString> xmls = _get_model_interfaces();
+
     std::cout << "Looking for available models..." << std::endl;
 
     for (auto& f : xmls) {
-        // Just getting the model binary file name here; assigning the binary
-        // info later.
-        morphomaker::Read_binary_definitions(f, model);
-        auto name = model.getBinaryName();
+        Model* modelp = Create_model(f);
+        if (modelp == nullptr) {
+            continue;
+        }
 
-        // Load library models.
+        auto name = modelp->getBinaryName();
         if (QLibrary::isLibrary(name)) {
-            QString path = qdir.path() + "/" + name;
-            QLibrary library(path);
-            if (!library.load()) {
-                std::cerr << library.errorString().toStdString() << std::endl;
-                continue;
-            }
-
-            create_m* mm = (create_m*)library.resolve(LOAD_NAME);
-            if (!mm) {
-                if (DEBUG_MODE) std::cerr << "Cannot load '" << path.toStdString()
-                                          << "': Unknown error."<< std::endl;
-                continue;
-            }
-            modelp = mm();
             std::cout << " * Library '" << name.toStdString() << "' loaded ("
                       << f.toStdString() << ")." << std::endl;
         }
-
-        // Load binary models.
         else {
-            modelp = new BinaryHandler();
-            if (modelp==NULL) {
-                continue;
-            }
             std::cout << " * Binary '" << name.toStdString() << "' loaded ("
                       << f.toStdString() << ")." << std::endl;
         }
 
         models.push_back(modelp);
-        morphomaker::Read_binary_definitions( f, *modelp );
-        modelp->setInterfaceXML(f);
     }
 
 }
 
+
+
+/**
+ * @brief Returns an in-process output parser: a built-in parser, or a parser
+ *        library in the model binary folder. Libraries are loaded once and
+ *        kept loaded.
+ * @param name      Parser name as in the model interface.
+ * @return          Parser, nullptr if the parser must be run as an executable.
+ */
+OutputParser* morphomaker::Load_output_parser( const QString& name )
+{
+    static std::map<QString, OutputParser*> parsers;
+    static std::mutex mtx;
+    std::lock_guard<std::mutex> lock(mtx);
+
+    auto it = parsers.find(name);
+    if (it != parsers.end()) {
+        return it->second;
+    }
+
+    OutputParser* parser = Builtin_output_parser( name.toStdString() );
+
+    if (parser == nullptr) {
+        QDir qdir(QCoreApplication::applicationDirPath());
+        qdir.cd(RESOURCES);
+        qdir.cd("bin");
+
+        typedef OutputParser* create_p();
+
+        // Only actual libraries are tried; the executables share the name.
+        for (auto& f : qdir.entryInfoList( QDir::Files )) {
+            if (!QLibrary::isLibrary(f.fileName()) ||
+                (f.baseName() != name && f.baseName() != "lib" + name)) {
+                continue;
+            }
+            QLibrary library(f.absoluteFilePath());
+            if (!library.load()) {
+                std::cerr << library.errorString().toStdString() << std::endl;
+                continue;
+            }
+            create_p* cp = (create_p*)library.resolve(PARSER_LOAD_NAME);
+            if (cp) {
+                parser = cp();
+                break;
+            }
+        }
+    }
+
+    parsers[name] = parser;
+
+    return parser;
+}
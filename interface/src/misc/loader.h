@@ -2,11 +2,17 @@
 
 #include <vector>
 #include "model.h"
+#include "outputparser.h"
 
 #define LOAD_NAME "create_model"
+#define PARSER_LOAD_NAME "create_parser"
 
 namespace morphomaker {
 
 void Load_models( std::vector<Model*>& );
 
+Model* Create_model( const QString& );
+
+OutputParser* Load_output_parser( const QString& );
+
 }
@@ -0,0 +1,152 @@
+/**
+ * @class OutputWatcher
+ * @brief Reports files completely written into a folder.
+ *
+ */
+
+#include "misc/outputwatcher.h"
+
+#if defined(__linux__)
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#endif
+
+
+
+OutputWatcher::OutputWatcher() : m_fd(-1), m_wd(-1)
+{
+    m_wake[0] = m_wake[1] = -1;
+}
+
+
+
+OutputWatcher::~OutputWatcher()
+{
+    close();
+}
+
+
+
+/**
+ * @brief Starts watching a folder. Files must be created only after this call
+ *        to be reported.
+ * @param dir       Folder.
+ * @return          0 if success, -1 if not supported or failed.
+ */
+int OutputWatcher::watch( const std::string& dir )
+{
+    close();
+
+#if defined(__linux__)
+    m_fd = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+    if (m_fd < 0) {
+        return -1;
+    }
+    m_wd = inotify_add_watch( m_fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO |
+                                                 IN_DELETE_SELF | IN_MOVE_SELF );
+    if (m_wd < 0 || pipe2( m_wake, O_NONBLOCK | O_CLOEXEC )) {
+        close();
+        return -1;
+    }
+    return 0;
+#else
+    (void)dir;
+    return -1;
+#endif
+}
+
+
+
+/**
+ * @brief Stops watching and releases the descriptors.
+ */
+void OutputWatcher::close()
+{
+#if defined(__linux__)
+    if (m_fd >= 0) {
+        ::close( m_fd );
+    }
+    for (int i=0; i<2; i++) {
+        if (m_wake[i] >= 0) {
+            ::close( m_wake[i] );
+        }
+    }
+#endif
+    m_fd = m_wd = -1;
+    m_wake[0] = m_wake[1] = -1;
+}
+
+
+
+/**
+ * @brief Collects the names of files written since the last call.
+ * @param files     Names are appended here.
+ * @param timeout   Maximum time to wait in ms, -1 for no limit.
+ * @return          Number of names added, -1 if events were lost or not
+ *                  watching.
+ */
+int OutputWatcher::wait( std::vector<std::string>& files, int timeout )
+{
+#if defined(__linux__)
+    if (m_fd < 0) {
+        return -1;
+    }
+
+    struct pollfd fds[2] = { { m_fd, POLLIN, 0 }, { m_wake[0], POLLIN, 0 } };
+    int rv = poll( fds, 2, timeout );
+    if (rv < 0 && errno != EINTR) {
+        return -1;
+    }
+
+    // Drain the wake-up pipe.
+    char c[64];
+    while (read( m_wake[0], c, sizeof(c) ) > 0) {}
+
+    int n = 0;
+    bool lost = false;
+    alignas(struct inotify_event) char buf[4096];
+    while (1) {
+        ssize_t len = read( m_fd, buf, sizeof(buf) );
+        if (len <= 0) {
+            break;
+        }
+        for (char* p = buf; p < buf+len; ) {
+            struct inotify_event* e = reinterpret_cast<struct inotify_event*>(p);
+            if (e->mask & (IN_Q_OVERFLOW | IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)) {
+                lost = true;
+            }
+            else if (e->len > 0) {
+                files.push_back( std::string(e->name) );
+                n++;
+            }
+            p += sizeof(struct inotify_event) + e->len;
+        }
+    }
+
+    return lost ? -1 : n;
+#else
+    (void)files;
+    (void)timeout;
+    return -1;
+#endif
+}
+
+
+
+/**
+ * @brief Makes a wait() in another thread return. Safe to call from any
+ *        thread while watching.
+ */
+void OutputWatcher::wake()
+{
+#if defined(__linux__)
+    if (m_wake[1] >= 0) {
+        char c = 0;
+        ssize_t rv = write( m_wake[1], &c, 1 );
+        (void)rv;
+    }
+#endif
+}
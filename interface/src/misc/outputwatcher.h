@@ -0,0 +1,48 @@
+#pragma once
+
+/**
+ * @class OutputWatcher
+ * @brief Reports files completely written into a folder.
+ *
+ * Uses inotify on Linux: a file is reported when it is closed after writing
+ * or moved into the folder. Elsewhere watch() fails and the caller is expected
+ * to fall back to polling the folder.
+ *
+ * wait() blocks without polling until files are reported, the timeout expires
+ * or wake() is called from another thread.
+ */
+
+#include <string>
+#include <vector>
+
+
+
+class OutputWatcher
+{
+public:
+    OutputWatcher();
+    ~OutputWatcher();
+
+    // Start watching folder dir; 0 if success, else -1 (no event support).
+    int watch( const std::string& dir );
+
+    // Stop watching.
+    void close();
+
+    // Returns true if watching.
+    bool good()                             { return m_fd >= 0; }
+
+    // Appends the names of files written since the last call to files, waiting
+    // at most timeout ms (-1 for no limit) if there are none. Returns the
+    // number of names added, or -1 if events were lost (queue overflow, folder
+    // removed); the folder must then be scanned.
+    int wait( std::vector<std::string>& files, int timeout );
+
+    // Makes a blocked wait() return.
+    void wake();
+
+private:
+    int m_fd;                       // inotify instance
+    int m_wd;                       // watch descriptor
+    int m_wake[2];                  // self-pipe for wake()
+};
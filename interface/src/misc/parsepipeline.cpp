@@ -0,0 +1,121 @@
+/**
+ * @class ParsePipeline
+ * @brief Parses model output steps in a pool of worker threads and commits
+ *        them in step order.
+ *
+ */
+
+#include "misc/parsepipeline.h"
+
+
+
+ParsePipeline::ParsePipeline() : m_pushed(0), m_committed(0), m_closed(false)
+{
+}
+
+
+
+ParsePipeline::~ParsePipeline()
+{
+    finish();
+}
+
+
+
+/**
+ * @brief Starts the worker threads.
+ * @param nworkers      Number of workers, at least one is started.
+ * @param parse         Builds the object of a step; called in the workers.
+ * @param commit        Takes the objects in step order.
+ */
+void ParsePipeline::start( int nworkers, parse_func parse, commit_func commit )
+{
+    finish();
+
+    m_parse = parse;
+    m_commit = commit;
+    m_pushed = m_committed = 0;
+    m_closed = false;
+
+    for (int i=0; i<(nworkers > 1 ? nworkers : 1); i++) {
+        m_workers.push_back( std::thread( &ParsePipeline::work_, this ) );
+    }
+}
+
+
+
+/**
+ * @brief Queues a step for parsing. Blocks while PARSE_IN_FLIGHT steps are
+ *        waiting to be parsed or committed.
+ * @param step      Step number.
+ */
+void ParsePipeline::push( int step )
+{
+    std::unique_lock<std::mutex> lock(m_mtx);
+    m_cvSpace.wait( lock, [this]{ return m_pushed - m_committed < PARSE_IN_FLIGHT; } );
+    m_queue.push_back( std::make_pair(m_pushed++, step) );
+    m_cvWork.notify_one();
+}
+
+
+
+/**
+ * @brief Lets the workers finish the queued steps and joins them.
+ */
+void ParsePipeline::finish()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_closed = true;
+    }
+    m_cvWork.notify_all();
+
+    for (auto& worker : m_workers) {
+        worker.join();
+    }
+    m_workers.clear();
+}
+
+
+
+/**
+ * @brief Worker loop: parses queued steps, then commits every step that is
+ *        next in order, including those parsed by other workers.
+ */
+void ParsePipeline::work_()
+{
+    while (1) {
+        std::pair<long,int> item;
+        {
+            std::unique_lock<std::mutex> lock(m_mtx);
+            m_cvWork.wait( lock, [this]{ return !m_queue.empty() || m_closed; } );
+            if (m_queue.empty()) {
+                return;
+            }
+            item = m_queue.front();
+            m_queue.pop_front();
+        }
+
+        Tooth* tooth = m_parse( item.second );
+
+        // Steps are collected and committed under the commit lock, so that
+        // commits by different workers never interleave out of order.
+        std::lock_guard<std::mutex> commit_lock(m_commitMtx);
+        std::vector<std::pair<int,Tooth*>> ready;
+        {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            m_done[item.first] = std::make_pair( item.second, tooth );
+            while (!m_done.empty() && m_done.begin()->first == m_committed) {
+                ready.push_back( m_done.begin()->second );
+                m_done.erase( m_done.begin() );
+                m_committed++;
+            }
+        }
+        for (auto& r : ready) {
+            m_commit( r.first, r.second );
+        }
+        if (!ready.empty()) {
+            m_cvSpace.notify_all();
+        }
+    }
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+/**
+ * @class ParsePipeline
+ * @brief Parses model output steps in a pool of worker threads and commits
+ *        them in step order.
+ *
+ * The thread detecting the output (watcher stage) push()es step numbers into
+ * a bounded queue. Workers pop steps and build the Tooth objects in parallel;
+ * the finished steps are committed strictly in the order they were pushed,
+ * whichever worker finishes them, so a slow step never blocks detection of
+ * the next ones. Push blocks while the maximum number of steps is in flight
+ * (queued, being parsed or waiting for commit).
+ */
+
+#include <vector>
+#include <deque>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+#include "tooth.h"
+
+#define PARSE_WORKERS 4         // Max. number of parser threads per model run.
+#define PARSE_IN_FLIGHT 16      // Max. number of steps pushed but not committed.
+
+
+
+class ParsePipeline
+{
+public:
+    // Builds the object of a step; NULL if failed.
+    typedef std::function<Tooth*(int)> parse_func;
+    // Takes the object of a step (NULL if failed); called in step order.
+    typedef std::function<void(int, Tooth*)> commit_func;
+
+    ParsePipeline();
+    ~ParsePipeline();
+
+    // Starts nworkers threads.
+    void start( int nworkers, parse_func parse, commit_func commit );
+
+    // Queues a step; blocks while PARSE_IN_FLIGHT steps are in flight.
+    void push( int step );
+
+    // Waits until all pushed steps are committed and stops the workers.
+    void finish();
+
+private:
+    void work_();
+
+    parse_func m_parse;
+    commit_func m_commit;
+    std::vector<std::thread> m_workers;
+
+    std::deque<std::pair<long,int>> m_queue;    // (sequence no., step)
+    std::map<long, std::pair<int,Tooth*>> m_done;   // parsed, not committed
+    long m_pushed;                  // sequence no. of the next pushed step
+    long m_committed;               // sequence no. of the next step to commit
+    bool m_closed;
+
+    std::mutex m_mtx;               // guards the queue and counters
+    std::mutex m_commitMtx;         // serializes commits
+    std::condition_variable m_cvWork;
+    std::condition_variable m_cvSpace;
+};
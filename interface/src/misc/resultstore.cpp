@@ -0,0 +1,190 @@
+/**
+ * @class ResultStore
+ * @brief Stores the output of completed model runs by run key.
+ *
+ * Used by both Hampu (GUI) and CMDAppCore (CLI).
+ *
+ */
+
+#include <utime.h>
+#include <QDir>
+#include <QDateTime>
+#include <QCoreApplication>
+
+#include "misc/resultstore.h"
+
+#define STORE_PART_AGE 3600     // Age in s after which unfinished entries are removed.
+#define STORE_LOW_WATER 0.9     // Eviction frees the store down to this fraction of the limit.
+
+
+
+ResultStore::ResultStore() : m_maxBytes(0), m_bytes(-1)
+{
+}
+
+
+
+/**
+ * @brief Sets the store folder, creating it if needed.
+ * @param path      Store folder.
+ * @param maxBytes  Size limit of the entries in bytes; 0 disables the store.
+ */
+void ResultStore::open( const QString& path, qint64 maxBytes )
+{
+    std::lock_guard<std::mutex> lock(m_mtx);
+    m_maxBytes = maxBytes;
+    m_bytes = -1;
+    m_path = "";
+    if (maxBytes > 0 && QDir().mkpath(path)) {
+        m_path = path;
+        removeParts_();
+    }
+}
+
+
+
+/**
+ * @brief Copies a stored run into a run folder and marks it used.
+ * @param key           Run key.
+ * @param folder        Run folder; left as it was if not restored.
+ * @param stepCache     Target file of the step cache.
+ * @return              0 if restored, -1 if not stored or failed.
+ */
+int ResultStore::restore( const std::string& key, const QString& folder,
+                          const QString& stepCache )
+{
+    std::lock_guard<std::mutex> lock(m_mtx);
+    if (m_path.isEmpty()) {
+        return -1;
+    }
+
+    QString entry = m_path + "/" + QString::fromStdString(key);
+    QDir qdir(entry);
+    if (!qdir.exists(STORE_STEPS)) {
+        return -1;
+    }
+
+    // Another process may remove the entry while it is copied.
+    QStringList copied;
+    for (auto& file : qdir.entryInfoList( QDir::Files )) {
+        QString target = folder + "/" + file.fileName();
+        if (file.fileName() == STORE_STEPS) {
+            target = stepCache;
+        }
+        if (!QFile::copy(file.absoluteFilePath(), target)) {
+            for (auto& f : copied) {
+                QFile::remove(f);
+            }
+            return -1;
+        }
+        copied << target;
+    }
+    utime( entry.toStdString().c_str(), NULL );
+
+    return 0;
+}
+
+
+
+/**
+ * @brief Stores the output files of a completed run, then removes the least
+ *        recently used entries over the size limit.
+ * @param key       Run key.
+ * @param folder    Run folder with the output files and one step cache.
+ * @return          0 if stored, else -1.
+ */
+int ResultStore::store( const std::string& key, const QString& folder )
+{
+    std::lock_guard<std::mutex> lock(m_mtx);
+    if (m_path.isEmpty()) {
+        return -1;
+    }
+
+    QString entry = m_path + "/" + QString::fromStdString(key);
+    QDir qdir;
+    if (qdir.exists(entry)) {
+        utime( entry.toStdString().c_str(), NULL );
+        return 0;
+    }
+
+    // Hidden until complete.
+    QString part = m_path + "/." + QString::fromStdString(key) + "."
+                   + QString::number( QCoreApplication::applicationPid() );
+    QDir(part).removeRecursively();
+    bool ok = qdir.mkpath(part), steps = false;
+    qint64 size = 0;
+    for (auto& file : QDir(folder).entryInfoList( QDir::Files )) {
+        QString name = file.fileName();
+        if (name.endsWith(STEPCACHE_EXT)) {
+            name = STORE_STEPS;
+            steps = true;
+        }
+        ok = ok && QFile::copy(file.absoluteFilePath(), part + "/" + name);
+        size += file.size();
+    }
+    if (!ok || !steps || !qdir.rename(part, entry)) {
+        QDir(part).removeRecursively();
+        return -1;
+    }
+
+    // The entries are only listed when the running total is over the limit.
+    if (m_bytes >= 0) {
+        m_bytes += size;
+    }
+    if (m_bytes < 0 || m_bytes > m_maxBytes) {
+        evict_();
+    }
+
+    return 0;
+}
+
+
+
+/**
+ * @brief Counts the size of the entries and removes the least recently used
+ *        ones if over the size limit, down to STORE_LOW_WATER of the limit.
+ */
+void ResultStore::evict_()
+{
+    removeParts_();
+
+    // Oldest first.
+    QDir root(m_path);
+    QFileInfoList entries = root.entryInfoList( QDir::Dirs | QDir::NoDotAndDotDot,
+                                                QDir::Time | QDir::Reversed );
+    std::vector<qint64> sizes;
+    qint64 bytes = 0;
+    for (auto& dir : entries) {
+        qint64 size = 0;
+        for (auto& file : QDir(dir.absoluteFilePath()).entryInfoList( QDir::Files )) {
+            size += file.size();
+        }
+        sizes.push_back(size);
+        bytes += size;
+    }
+
+    if (bytes > m_maxBytes) {
+        for (int i=0; i<entries.size() && bytes > STORE_LOW_WATER*m_maxBytes; i++) {
+            QDir(entries.at(i).absoluteFilePath()).removeRecursively();
+            bytes -= sizes.at(i);
+        }
+    }
+    m_bytes = bytes;
+}
+
+
+
+/**
+ * @brief Removes unfinished entries left by crashed processes.
+ */
+void ResultStore::removeParts_()
+{
+    QDir root(m_path);
+    QDateTime now = QDateTime::currentDateTime();
+    for (auto& dir : root.entryInfoList( QDir::Dirs | QDir::Hidden | QDir::NoDotAndDotDot )) {
+        if (dir.fileName().startsWith(".") &&
+            dir.lastModified().secsTo(now) > STORE_PART_AGE) {
+            QDir(dir.absoluteFilePath()).removeRecursively();
+        }
+    }
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+/**
+ * @class ResultStore
+ * @brief Stores the output of completed model runs by run key, so that a run
+ *        with the same key can be loaded instead of run again.
+ *
+ * An entry is the folder '<root>/<run key>' (see Model::getRunKey()) with the
+ * output files of a run folder, the step cache renamed to STORE_STEPS. Entries
+ * are written into a temporary folder and renamed into place, so they are
+ * always complete; the modification time of an entry folder is the time it
+ * was last used. When the entries exceed the size limit, the least recently
+ * used ones are removed down to STORE_LOW_WATER of the limit. The size of the
+ * entries is kept as a running total and only recounted when evicting, so
+ * entries added by other processes sharing the store are noticed then.
+ */
+
+#include <QString>
+#include <mutex>
+#include <string>
+
+#include "stepcache.h"
+
+#define STORE_STEPS "steps" STEPCACHE_EXT
+
+
+
+class ResultStore
+{
+public:
+    ResultStore();
+
+    // Uses the store at path with a size limit in bytes; 0 disables it.
+    void open( const QString& path, qint64 maxBytes );
+
+    // Copies the entry of key into a run folder, the step cache as stepCache.
+    int restore( const std::string& key, const QString& folder,
+                 const QString& stepCache );
+
+    // Stores the files of a run folder as the entry of key.
+    int store( const std::string& key, const QString& folder );
+
+private:
+    void evict_();
+    void removeParts_();
+
+    QString m_path;                 // store root, empty if disabled
+    qint64 m_maxBytes;              // size limit of the entries
+    qint64 m_bytes;                 // size of the entries, -1 if not counted
+    std::mutex m_mtx;               // serializes store() and restore()
+};
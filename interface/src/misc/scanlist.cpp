@@ -4,14 +4,119 @@
  */
 
 #include <iostream>
+#include <climits>
+#include <cstdint>
+#include <algorithm>
 #include "misc/scanlist.h"
 
+namespace {
+
+// Primitive polynomials and initial direction numbers of the Sobol sequence
+// for the scan items after the first (Joe & Kuo, new-joe-kuo-6.21201).
+struct sobol_poly {
+    uint32_t s;         // degree
+    uint32_t a;         // inner coefficients
+    uint32_t m[8];      // initial direction numbers
+};
+
+const sobol_poly SOBOL_POLYS[] = {
+    { 1,  0, { 1 } },
+    { 2,  1, { 1, 3 } },
+    { 3,  1, { 1, 3, 1 } },
+    { 3,  2, { 1, 1, 1 } },
+    { 4,  1, { 1, 1, 3, 3 } },
+    { 4,  4, { 1, 3, 5, 13 } },
+    { 5,  2, { 1, 1, 5, 5, 17 } },
+    { 5,  4, { 1, 1, 5, 5, 5 } },
+    { 5,  7, { 1, 1, 7, 11, 19 } },
+    { 5, 11, { 1, 1, 5, 1, 1 } },
+    { 5, 13, { 1, 1, 1, 3, 11 } },
+    { 5, 14, { 1, 3, 5, 5, 31 } },
+    { 6,  1, { 1, 3, 3, 9, 7, 49 } },
+    { 6, 13, { 1, 1, 1, 15, 21, 21 } },
+    { 6, 16, { 1, 3, 1, 13, 27, 49 } },
+    { 6, 19, { 1, 1, 1, 15, 7, 5 } },
+    { 6, 22, { 1, 3, 1, 15, 13, 25 } },
+    { 6, 25, { 1, 1, 5, 5, 19, 61 } },
+    { 7,  1, { 1, 3, 7, 11, 23, 15, 103 } },
+    { 7,  4, { 1, 3, 7, 13, 13, 15, 69 } },
+};
+
+const uint32_t SOBOL_ITEMS = 1 + sizeof(SOBOL_POLYS)/sizeof(SOBOL_POLYS[0]);
+
+/**
+ * @brief Mixes the bits of a 64-bit integer (splitmix64).
+ */
+uint64_t mix_( uint64_t z )
+{
+    z += 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+/**
+ * @brief Returns a pseudo-random number given a seed and two indices. Unlike
+ *        the engines & distributions of <random>, the same on all platforms,
+ *        so that every process of a scan gets the same jobs.
+ */
+uint64_t random_( uint64_t seed, uint64_t k, uint64_t i )
+{
+    return mix_( mix_( mix_(seed) ^ k ) ^ i );
+}
+
+/**
+ * @brief Maps a pseudo-random number to [0,1).
+ */
+double unit_( uint64_t r )
+{
+    return (r >> 11) * (1.0/9007199254740992.0);
+}
+
+/**
+ * @brief Returns the i-th prime, from 2.
+ */
+uint32_t prime_( uint32_t i )
+{
+    uint32_t p = 1;
+    for (uint32_t n=0; n<=i;) {
+        p++;
+        bool prime = true;
+        for (uint32_t d=2; d*d<=p && prime; d++) {
+            prime = p % d != 0;
+        }
+        n += prime;
+    }
+    return p;
+}
+
+/**
+ * @brief Reflects the digits of k in a base about the radix point.
+ */
+double radicalInverse_( uint64_t k, uint32_t base )
+{
+    double u = 0.0;
+    double f = 1.0/base;
+    for (; k > 0; k /= base, f /= base) {
+        u += (k % base) * f;
+    }
+    return u;
+}
+
+}
+
 
 ScanList::ScanList()
 {
     currentScanItem = 0;
+    nJobs = 0;
+    calcPerm = 1;
     viewMode = 0;
+    branchIteration = 0;
     baseParameters = NULL;
+    sampling = SAMPLE_GRID;
+    nSamples = 0;
+    sampleSeed = 0;
 }
 
 
@@ -22,7 +127,11 @@ ScanList::ScanList()
 void ScanList::resetScanQueue()
 {
     currentScanItem=0;
-    scanQueue.clear();
+    nJobs = 0;
+    itemSizes.clear();
+    strata.clear();
+    directions.clear();
+    jobList = "";
 }
 
 
@@ -42,7 +151,11 @@ void ScanList::reset()
         baseParameters = NULL;
     }
     viewMode = 0;
+    branchIteration = 0;
     orientations.clear();
+    sampling = SAMPLE_GRID;
+    nSamples = 0;
+    sampleSeed = 0;
 }
 
 
@@ -79,65 +192,270 @@ void ScanList::removeScanItem(std::string parName)
 
 
 /**
- * @brief Gets a set of parameters by index from scan queue.
- * @param i     Item index.
- * @return      Parameters object.
+ * @brief Gets the parameters of a job in the scan queue.
+ *
+ * Jobs are not stored; the scan item values of job k are decoded from k as a
+ * mixed-radix number whose digits are the value indices of the scan items,
+ * the first item being the least significant. When scanning one item at a
+ * time, the jobs of each item follow those of the previous items and the
+ * other items keep their base values. Sampled jobs take the value of each
+ * item nearest below their sample point (see sample_()).
+ *
+ * @param k     Job index.
+ * @return      New parameters object owned by the caller, NULL if k is not in
+ *              the queue.
  */
-Parameters *ScanList::getScanItem(int i)
+Parameters *ScanList::getScanJob(long k)
 {
-    if (scanQueue.size() <= (unsigned int)i) return NULL;
-    return scanQueue.at(i);
+    std::vector<int> steps;
+    if (!decodeJob_(k, steps)) {
+        return NULL;
+    }
+
+    std::stringstream id;
+    Parameters *par = new Parameters(baseParameters);
+    for (uint32_t j=0; j<scanItems.size(); j++) {
+        if (steps.at(j)==-1) {
+            id << "X";
+            continue;
+        }
+        id << steps.at(j);
+
+        ScanItem* item = scanItems.at(j);
+        double value = steps.at(j)*item->getStep() + item->getMinValue();
+        par->setParameterValue( item->getParName(), value );
+    }
+    par->setID(id.str());
+
+    return par;
 }
 
 
 
 /**
- * @brief Gets a set of parameters next in the scan queue.
- * @return      Parameters object.
+ * @brief Gets the parameters of the next job in the scan queue.
+ * @return      New parameters object owned by the caller, NULL if the queue
+ *              is done.
  */
 Parameters *ScanList::getNextScanJob()
 {
-    if (scanQueue.size() <= (unsigned int)currentScanItem) return NULL;
-    currentScanItem++;
-    return scanQueue.at(currentScanItem-1);
+    Parameters *par = getScanJob(currentScanItem);
+    if (par != NULL) {
+        currentScanItem++;
+    }
+    return par;
 }
 
 
 
 /**
- * @brief Gives the next permutation of a set of numbers defined by their max. values.
- * @param curr      Current permutation.
- * @param max       Sizes of sets.
- * @param calcPerm  If 1 calculates all permutations.
+ * @brief Appends the scan item values of a job to the job list file, in the
+ *        order the jobs are run.
+ * @param k     Job index.
+ * @param file  File to append to instead of the job list file.
+ * @return      0 if success, else -1.
  */
-void ScanList::updatePerm(std::vector<int> *curr, std::vector<int> *max, int calcPerm)
+int ScanList::writeScanJob(long k, const std::string& file)
 {
-    if (calcPerm) {
-        for (uint32_t i=0; i<curr->size(); i++) {
-            if (curr->at(i) < max->at(i)-1) {
-                curr->at(i)++;
-                auto j = i;
-                while (j > 0) {
-                    curr->at(j-1) = 0;
-                    j--;
-                }
-                break;
+    std::string target = file.empty() ? jobList : file;
+    std::vector<int> steps;
+    if (target.empty() || !decodeJob_(k, steps)) {
+        return -1;
+    }
+
+    FILE* output = fopen(target.c_str(), "a");
+    if (output==NULL) {
+        return -1;
+    }
+
+    fprintf(output, "i:%ld --- ", k);
+    for (uint32_t j=0; j<steps.size(); j++) {
+        if (steps.at(j)==-1) {
+            fprintf(output, "X ");
+        }
+        else {
+            fprintf(output, "%d ", steps.at(j));
+        }
+    }
+    fprintf(output, "\n");
+    for (uint32_t j=0; j<steps.size(); j++) {
+        if (steps.at(j)==-1) {
+            continue;
+        }
+        ScanItem* item = scanItems.at(j);
+        double value = steps.at(j)*item->getStep() + item->getMinValue();
+        fprintf( output, "par: %s, val: %f\n", item->getParName().c_str(), value );
+    }
+    fprintf(output, "\n");
+    fclose(output);
+
+    return 0;
+}
+
+
+
+/**
+ * @brief Returns the number of values of a scan item.
+ * @param i     Scan item index.
+ */
+long ScanList::itemSize_(uint32_t i)
+{
+    ScanItem* item = scanItems.at(i);
+    auto div = item->getStep();
+    if (div==0.0) {
+        div=1.0;
+    }
+    return lround((item->getMaxValue() - item->getMinValue())/div + 1.0);
+}
+
+
+
+/**
+ * @brief Decodes the scan item value indices of a job.
+ * @param k         Job index.
+ * @param steps     Value index of each scan item, -1 for the base value.
+ * @return          False if k is not in the scan queue.
+ */
+bool ScanList::decodeJob_(long k, std::vector<int>& steps)
+{
+    if (k < 0 || k >= nJobs || itemSizes.size() != scanItems.size()) {
+        return false;
+    }
+
+    steps.assign(itemSizes.size(), -1);
+    if (sampling != SAMPLE_GRID) {
+        for (uint32_t i=0; i<itemSizes.size(); i++) {
+            long n = itemSizes.at(i);
+            steps.at(i) = std::min( n-1, (long)(sample_(k, i)*n) );
+        }
+        return true;
+    }
+
+    for (uint32_t i=0; i<itemSizes.size(); i++) {
+        if (calcPerm) {
+            steps.at(i) = k % itemSizes.at(i);
+            k /= itemSizes.at(i);
+        }
+        else if (k < itemSizes.at(i)) {
+            steps.at(i) = k;
+            break;
+        }
+        else {
+            k -= itemSizes.at(i);
+        }
+    }
+
+    return true;
+}
+
+
+
+/**
+ * @brief Sets up the sampling of the jobs.
+ * @return          0 if success, else -1.
+ */
+int ScanList::initSampling_()
+{
+    if (sampling < SAMPLE_RANDOM || sampling > SAMPLE_SOBOL) {
+        fprintf(stderr, "Error: Unknown sampling mode %d.\n", sampling);
+        return -1;
+    }
+    // Sobol points are 32-bit; the same limit for all modes.
+    if (nSamples < 1 || (unsigned long)nSamples >= UINT32_MAX) {
+        fprintf(stderr, "Error: The number of samples must be 1 to %u.\n",
+                UINT32_MAX-1);
+        return -1;
+    }
+
+    if (sampling == SAMPLE_LHS) {
+        // Each item takes each of its nSamples strata once, in a random
+        // order (Fisher-Yates shuffle).
+        strata.resize(scanItems.size());
+        for (uint32_t i=0; i<scanItems.size(); i++) {
+            std::vector<uint32_t>& s = strata.at(i);
+            s.resize(nSamples);
+            for (uint32_t k=0; k<s.size(); k++) {
+                s.at(k) = k;
+            }
+            for (uint32_t k=s.size()-1; k>0; k--) {
+                std::swap( s.at(k), s.at(random_(sampleSeed, k, 2*i+1) % (k+1)) );
             }
         }
     }
 
-    else {
-        for (uint32_t i=0; i<curr->size(); i++) {
-            if (curr->at(i)==max->at(i)-1 && i<curr->size()-1) {
-                curr->at(i)=-1;
-                curr->at(i+1)=0;
-                break;
+    if (sampling == SAMPLE_SOBOL) {
+        if (scanItems.size() > SOBOL_ITEMS) {
+            fprintf(stderr, "Error: Sobol sampling supports up to %u scan items.\n",
+                    SOBOL_ITEMS);
+            return -1;
+        }
+        directions.assign( scanItems.size(), std::vector<uint32_t>(32) );
+        for (uint32_t b=0; b<32; b++) {
+            directions.at(0).at(b) = 1u << (31-b);
+        }
+        for (uint32_t i=1; i<scanItems.size(); i++) {
+            const sobol_poly& p = SOBOL_POLYS[i-1];
+            std::vector<uint32_t>& v = directions.at(i);
+            for (uint32_t b=0; b<32; b++) {
+                if (b < p.s) {
+                    v.at(b) = p.m[b] << (31-b);
+                    continue;
+                }
+                v.at(b) = v.at(b-p.s) ^ (v.at(b-p.s) >> p.s);
+                for (uint32_t j=1; j<p.s; j++) {
+                    if ((p.a >> (p.s-1-j)) & 1) {
+                        v.at(b) ^= v.at(b-j);
+                    }
+                }
             }
-            if (curr->at(i)>-1) {
-                curr->at(i)++;
-                break;
+        }
+    }
+
+    return 0;
+}
+
+
+
+/**
+ * @brief Returns the coordinate of a scan item in the sample point of a job.
+ *
+ * Random and Latin hypercube samples depend on the seed. The Halton & Sobol
+ * sequences skip their first point, the origin, and are shifted at random if
+ * seeded. Halton points of many items are correlated early in the sequence;
+ * Sobol points are evenly spread in all dimensions in the first 2^m points.
+ *
+ * @param k     Job index.
+ * @param i     Scan item index.
+ * @return      Coordinate in [0,1).
+ */
+double ScanList::sample_(long k, uint32_t i)
+{
+    switch (sampling) {
+    case SAMPLE_LHS: {
+        // Uniform within the stratum of the item.
+        double u = unit_( random_(sampleSeed, k, 2*i) );
+        return (strata.at(i).at(k) + u)/nSamples;
+    }
+    case SAMPLE_HALTON: {
+        double u = radicalInverse_( k+1, prime_(i) );
+        if (sampleSeed) {
+            u += unit_( random_(sampleSeed, 0, 2*i+1) );
+            u -= u >= 1.0 ? 1.0 : 0.0;
+        }
+        return u;
+    }
+    case SAMPLE_SOBOL: {
+        uint32_t x = sampleSeed ? random_(sampleSeed, 0, 2*i+1) : 0;
+        uint32_t b = 0;
+        for (uint64_t n=k+1; n>0; n>>=1, b++) {
+            if (n & 1) {
+                x ^= directions.at(i).at(b);
             }
         }
+        return x * (1.0/4294967296.0);
+    }
+    default:
+        return unit_( random_(sampleSeed, k, 2*i) );
     }
 }
 
@@ -159,12 +477,7 @@ unsigned long ScanList::getNofJobs(int comb)
     }
 
     for (uint32_t i=0; i<scanItems.size(); i++) {
-        ScanItem* item = scanItems.at(i);
-        auto div = item->getStep();
-        if (div==0.0) {
-            div=1.0;
-        }
-        auto n = lround((item->getMaxValue() - item->getMinValue())/div + 1.0);
+        auto n = itemSize_(i);
         if (comb==1) {
             nperm = nperm*n;
         }
@@ -178,91 +491,79 @@ unsigned long ScanList::getNofJobs(int comb)
 
 
 /**
- * @brief Populates the scan queue based on a user-defined scan list.
- * - Linear and permutation scanning are treated separately.
+ * @brief Sets up the scan queue based on a user-defined scan list.
+ * - Linear and permutation scanning are treated separately; sampled scans
+ *   have the number of jobs set by setSampleCount().
+ * - The jobs are generated on demand by getScanJob(); the job list file gets
+ *   the scan items, and each job when written by writeScanJob().
  *
  * @param parlist   File to write queue/scanning info.
- * @param calcPerm  If 1 calculates all parameter combinations.
+ * @param perm      If 1 calculates all parameter combinations.
+ * @param append    If 1 appends to the file, e.g. when resuming a scan.
  */
-int ScanList::populateScanQueue(std::string parlist, int calcPerm)
+int ScanList::populateScanQueue(std::string parlist, int perm, int append)
 {
-    FILE* output = fopen(parlist.c_str(), "w");
+    FILE* output = fopen(parlist.c_str(), append ? "a" : "w");
     if (output==NULL) {
         fprintf(stderr, "Error: Can't open file '%s' for writing. Aborting.\n",
                 parlist.c_str());
         return -1;
     }
 
-    if (scanItems.size() == 0)
+    resetScanQueue();
+    calcPerm = perm;
+    if (scanItems.size() == 0) {
+        fclose(output);
         return 0;
+    }
 
-    std::vector<int> nSteps;
-    std::vector<int> currSteps;
-
-    // Init the step list. For non-permutations -1 indicates base value.
+    // Job indices must fit in a long.
+    long nperm = calcPerm ? 1 : 0;
     for (uint32_t i=0; i<scanItems.size(); i++) {
-        ScanItem* item = scanItems.at(i);
-        auto n = lround((item->getMaxValue() - item->getMinValue())/item->getStep() + 1.0);
-        nSteps.push_back(n);
-        if (calcPerm) {
-            currSteps.push_back(0);
-        }
-        else {
-            currSteps.push_back(-1);
+        long n = itemSize_(i);
+        bool grid = sampling == SAMPLE_GRID;
+        if (n < 1 || (grid && calcPerm && nperm > LONG_MAX/n) ||
+            (grid && !calcPerm && nperm > LONG_MAX-n)) {
+            fprintf(stderr, "Error: Too many jobs in the scan list.\n");
+            fclose(output);
+            return -1;
         }
+        nperm = calcPerm ? nperm*n : nperm+n;
+        itemSizes.push_back(n);
     }
-    if (!calcPerm) {
-        currSteps.at(0)=0;
+    if (sampling != SAMPLE_GRID) {
+        if (initSampling_()) {
+            fclose(output);
+            return -1;
+        }
+        nperm = nSamples;
     }
 
-    long nperm = getNofJobs(calcPerm);
     fprintf(stderr, "Number of jobs generated: %ld\n", nperm);
     if (nperm>100000) {
         fprintf(stderr, "Congratulations! Chances are you'll be waiting for an eternity while I work on these!\n");
     }
 
-    long done=0;
-
-    while (done<nperm) {
-        fprintf(output, "i:%ld --- ", done);
-        std::stringstream id;
-
-        for (uint32_t i=0; i<currSteps.size(); i++) {
-            if (currSteps.at(i)==-1) {
-                fprintf(output, "X ");
-                id << "X";
-            }
-            else {
-                fprintf(output, "%d ", currSteps.at(i));
-                id << currSteps.at(i);
-            }
-        }
-        fprintf(output, "\n");
-        Parameters *par = new Parameters(baseParameters);
-        par->setID(id.str());
-        for (uint32_t j=0; j<scanItems.size(); j++) {
-            if (!calcPerm && currSteps.at(j)==-1) {
-                continue;
-            }
-            ScanItem* item = scanItems.at(j);
-
-            std::string name = item->getParName();
-            double value = currSteps.at(j)*item->getStep() + item->getMinValue();
-            fprintf( output, "par: %s, val: %f\n", name.c_str(), value );
-            par->setParameterValue( name, value );
-
-            if (!calcPerm && currSteps.at(j)>-1) {
-                break;
-            }
-        }
-        scanQueue.push_back(par);
-
-        updatePerm(&currSteps, &nSteps, calcPerm);
-        fprintf(output, "\n");
-        done++;
+    const char* modes[] = { "", "random", "Latin hypercube", "Halton", "Sobol" };
+    if (sampling != SAMPLE_GRID) {
+        fprintf(output, "# jobs: %ld, %s samples, seed %lu\n", nperm,
+                modes[sampling], sampleSeed);
+    }
+    else {
+        fprintf(output, "# jobs: %ld, %s\n", nperm,
+                calcPerm ? "all combinations" : "one item at a time");
+    }
+    for (uint32_t i=0; i<scanItems.size(); i++) {
+        ScanItem* item = scanItems.at(i);
+        fprintf(output, "# item %d: %s, %f:%f:%f, %ld values\n", i,
+                item->getParName().c_str(), item->getMinValue(), item->getStep(),
+                item->getMaxValue(), itemSizes.at(i));
     }
     fprintf(output, "\n");
     fclose(output);
 
+    nJobs = nperm;
+    jobList = parlist;
+
     return 0;
 }
@@ -9,6 +9,13 @@
 #include "parameters.h"
 #include "morphomaker.h"
 
+// Ways of choosing the jobs from the values of the scan items.
+#define SAMPLE_GRID     0   // all combinations, or one item at a time
+#define SAMPLE_RANDOM   1   // independent uniform random points
+#define SAMPLE_LHS      2   // Latin hypercube
+#define SAMPLE_HALTON   3   // Halton sequence
+#define SAMPLE_SOBOL    4   // Sobol sequence
+
 
 
 class ScanItem;
@@ -24,20 +31,19 @@ class ScanList
         // Full reset of the scanner.
         void reset();
 
-        // Adds, removes, gets a scan item.
+        // Adds, removes a scan item.
         void addScanItem( ScanItem* item );
         void removeScanItem( std::string parName );
-        Parameters *getScanItem( int i );
 
-        // Returns the index of the current scan item.
-        int getCurrentScanItem()                    { return currentScanItem; }
+        // Returns the index of the next job in the scan queue.
+        long getCurrentScanItem()                   { return currentScanItem; }
 
         // Set model view mode.
         void setViewMode( int mode )                { viewMode = mode; }
         int getViewMode()                           { return viewMode; }
 
-        // Returns the number of scan items in the queue.
-        int getScanQueueSize()                      { return scanQueue.size(); }
+        // Returns the number of jobs in the scan queue.
+        long getScanQueueSize()                     { return nJobs; }
 
         // Add a model view orientation for rendering output.
         void addOrientation( std::string name )     { orientations.push_back(name); }
@@ -46,29 +52,60 @@ class ScanList
         // Sets the base model parameters that are varied during scanning.
         void setBaseParameters( Parameters *par )   { baseParameters = new Parameters(par); }
 
-        // Gets a set of parameters next in the scan queue.
+        // Iteration at which the scan items branch from a shared run of the
+        // base parameters; 0 if each item is run from the start.
+        void setBranchIteration( int iter )         { branchIteration = iter; }
+        int getBranchIteration()                    { return branchIteration; }
+
+        // Samples a budget of jobs from the values of the scan items instead
+        // of scanning the grid. Set before populateScanQueue().
+        void setSampling( int mode )                { sampling = mode; }
+        void setSampleCount( long n )               { nSamples = n; }
+        void setSampleSeed( unsigned long s )       { sampleSeed = s; }
+        int getSampling()                           { return sampling; }
+
+        // Gets the parameters of job k of the scan queue, or of the next job.
+        // The object is created on demand and owned by the caller.
+        Parameters *getScanJob( long k );
         Parameters *getNextScanJob();
 
-        // Gives the next permutation of a set of numbers defined by their max. values.
-        void updatePerm(std::vector<int> *, std::vector<int> *, int calcPerm=1);
+        // Appends the parameter values of job k to the job list file, or to
+        // file if given.
+        int writeScanJob( long k, const std::string& file = "" );
 
         // Returns the number of jobs given the current scan items.
         unsigned long getNofJobs(int);
 
         // Populates the scan queue based on a user-defined scan list.
-        int populateScanQueue(std::string, int calcPerm=1);
+        int populateScanQueue(std::string, int calcPerm=1, int append=0);
 
 
 
     private:
+        long itemSize_( uint32_t i );
+        bool decodeJob_( long k, std::vector<int>& steps );
+        int initSampling_();
+        double sample_( long k, uint32_t i );
+
         std::vector<ScanItem*> scanItems;
         std::vector<std::string> itemNames;
         std::vector<double> itemValues;
-        std::vector<Parameters*> scanQueue;
-        int currentScanItem;
+        std::vector<long> itemSizes;        // number of values per scan item
+        std::string jobList;                // job list file
+        long nJobs;                         // number of jobs in the scan queue
+        int calcPerm;                       // 1 if all combinations, else one item at a time
+        long currentScanItem;
         Parameters *baseParameters;
         int viewMode;
+        int branchIteration;
         std::vector<std::string> orientations;
+
+        // Sampling (see setSampling()).
+        int sampling;                       // SAMPLE_GRID etc.
+        long nSamples;                      // number of jobs sampled
+        unsigned long sampleSeed;           // 0 for the plain Halton & Sobol sequences
+        std::vector<std::vector<uint32_t>> strata;      // Latin hypercube strata per item
+        std::vector<std::vector<uint32_t>> directions;  // Sobol direction numbers per item
 };
 
 
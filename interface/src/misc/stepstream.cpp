@@ -0,0 +1,186 @@
+/**
+ * @class StepStream
+ * @brief Consumer end of the step streaming ring buffer.
+ *
+ * Used by BinaryHandler for models with output style 'Stream'; the protocol
+ * is documented in tmring.h.
+ *
+ */
+
+#include <cstring>
+
+#include "misc/stepstream.h"
+
+
+
+StepStream::StepStream() : m_map(NULL), m_header(NULL)
+{
+}
+
+
+
+StepStream::~StepStream()
+{
+    close();
+}
+
+
+
+/**
+ * @brief Creates the ring file and maps it to memory.
+ * @param path          File path.
+ * @param slots         Number of slots.
+ * @param slot_size     Slot size in bytes.
+ * @return              0 if success, else -1.
+ */
+int StepStream::create( const QString& path, uint32_t slots, uint64_t slot_size )
+{
+    close();
+
+    // The file is sparse; pages are allocated as the slots are written.
+    qint64 size = TMRING_HEADER_SIZE + (qint64)slots*slot_size;
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::ReadWrite | QIODevice::Truncate) ||
+        !m_file.resize(size) || !(m_map = m_file.map(0, size))) {
+        close();
+        return -1;
+    }
+
+    m_header = reinterpret_cast<tmring_header*>(m_map);
+    memset(m_header, 0, sizeof(tmring_header));
+    m_header->version = TMRING_VERSION;
+    m_header->slot_count = slots;
+    m_header->slot_size = slot_size;
+    m_header->head = 0;
+    m_header->tail = 0;
+    m_header->producer = TMRING_DETACHED;
+    m_header->consumer_closed = 0;
+    // Magic last; the header is complete before the model is started anyway.
+    m_header->magic = TMRING_MAGIC;
+
+    return 0;
+}
+
+
+
+/**
+ * @brief Reads the next published step. The arrays are copied from the slot
+ *        directly into the object storage.
+ * @param step      Step number of the read step.
+ * @param tooth     Object to fill.
+ * @return          1 if a step was read, 0 if there's no new step, -1 if the
+ *                  step was invalid and skipped.
+ */
+int StepStream::read( int& step, Tooth& tooth )
+{
+    if (m_header == NULL) {
+        return 0;
+    }
+
+    uint64_t tail = m_header->tail;
+    if (tmring_load_(&m_header->head) == tail) {
+        return 0;
+    }
+
+    const uchar* slot = m_map + TMRING_HEADER_SIZE
+                        + (tail % m_header->slot_count)*m_header->slot_size;
+    tmring_record rec;
+    memcpy(&rec, slot, sizeof(rec));
+    step = rec.step;
+
+    uint64_t bytes = tmring_record_bytes_(rec.nvert, rec.ncolor, rec.npoly,
+                                          rec.nindex, rec.ncell, rec.ndata);
+    if (rec.bytes != bytes || bytes > m_header->slot_size ||
+        (rec.ncolor != 0 && rec.ncolor != rec.nvert)) {
+        tmring_store_(&m_header->tail, tail+1);
+        return -1;
+    }
+
+    const uchar* p = slot + sizeof(rec);
+
+    mesh::vertex_array vertices(rec.nvert);
+    memcpy(static_cast<void*>(vertices.data()), p, 12*(size_t)rec.nvert);
+    p += 12*(size_t)rec.nvert;
+
+    mesh::color_array colors(rec.nvert, {0.0, 0.0, 0.0, 1.0});
+    memcpy(colors.data(), p, 16*(size_t)rec.ncolor);
+    p += 16*(size_t)rec.ncolor;
+
+    std::vector<uint32_t> sizes(rec.npoly);
+    memcpy(sizes.data(), p, 4*(size_t)rec.npoly);
+    p += 4*(size_t)rec.npoly;
+
+    std::vector<uint32_t> indices(rec.nindex);
+    memcpy(indices.data(), p, 4*(size_t)rec.nindex);
+    p += 4*(size_t)rec.nindex;
+
+    // Polygons must be within the vertices and the index array.
+    uint64_t n = 0;
+    bool valid = true;
+    for (auto s : sizes) {
+        valid = valid && s >= 3 && s <= 4;
+        n += s;
+    }
+    for (auto i : indices) {
+        valid = valid && i < rec.nvert;
+    }
+    if (!valid || n != rec.nindex) {
+        tmring_store_(&m_header->tail, tail+1);
+        return -1;
+    }
+
+    for (uint32_t i=0; i<rec.ncell; i++) {
+        std::vector<float> data(rec.ndata);
+        memcpy(data.data(), p, 4*(size_t)rec.ndata);
+        p += 4*(size_t)rec.ndata;
+        tooth.add_cell_data(std::move(data));
+    }
+
+    // The slot is free once everything has been copied.
+    tmring_store_(&m_header->tail, tail+1);
+
+    Mesh mesh;
+    mesh.set_vectices( vertices );
+    mesh.set_vertex_colors( colors );
+
+    // Store a copy of current object colors to avoid losing them later when
+    // manipulating vertex colors from the interface.
+    mesh.set_alt_colors( mesh.get_vertex_colors() );
+
+    mesh.set_polygons( sizes, indices );
+    tooth.add_mesh( mesh );
+
+    return 1;
+}
+
+
+
+/**
+ * @brief Returns true if the model has published all its steps.
+ */
+bool StepStream::producerDone()
+{
+    return m_header != NULL &&
+           tmring_load32_(&m_header->producer) == TMRING_DONE;
+}
+
+
+
+/**
+ * @brief Tells the model to stop publishing, unmaps and removes the file.
+ */
+void StepStream::close()
+{
+    if (m_header != NULL) {
+        tmring_store32_(&m_header->consumer_closed, 1);
+    }
+    if (m_map != NULL) {
+        m_file.unmap(m_map);
+    }
+    m_map = NULL;
+    m_header = NULL;
+    if (m_file.isOpen()) {
+        m_file.close();
+        m_file.remove();
+    }
+}
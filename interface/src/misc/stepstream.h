@@ -0,0 +1,50 @@
+#pragma once
+
+/**
+ * @class StepStream
+ * @brief Consumer end of the step streaming ring buffer (see tmring.h).
+ *
+ * Creates the ring file into the run folder before the model starts and
+ * reads the published steps straight from the mapped slots into Tooth
+ * objects, without intermediate files or text parsing.
+ */
+
+#include <QFile>
+#include <QString>
+
+#include "tmring.h"
+#include "tooth.h"
+
+#define STREAM_SLOTS 8                  // Number of ring slots.
+#define STREAM_SLOT_BYTES (4 << 20)     // Slot size in bytes, max. size of a step.
+
+
+
+class StepStream
+{
+public:
+    StepStream();
+    ~StepStream();
+
+    // Creates and maps the ring file; returns 0 if success, else -1.
+    int create( const QString& path, uint32_t slots=STREAM_SLOTS,
+                uint64_t slot_size=STREAM_SLOT_BYTES );
+
+    // Reads the next step into tooth; returns 1 if read, 0 if none available,
+    // -1 if the step is invalid (it's skipped).
+    int read( int& step, Tooth& tooth );
+
+    // Returns true if the model has published all its steps.
+    bool producerDone();
+
+    // Tells the model to stop publishing, unmaps and removes the ring file.
+    void close();
+
+    // Ring file path, empty if not created.
+    QString path() const        { return m_file.isOpen() ? m_file.fileName() : QString(); }
+
+private:
+    QFile m_file;
+    uchar* m_map;
+    tmring_header* m_header;
+};
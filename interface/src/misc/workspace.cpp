@@ -0,0 +1,118 @@
+/**
+ * @class Workspace
+ * @brief Allocates run IDs and run folders under the temporary folder.
+ *
+ * Used by both Hampu (GUI) and CMDAppCore (CLI).
+ *
+ */
+
+#include <ctime>
+#include <QDir>
+#include <QCoreApplication>
+
+#include "misc/workspace.h"
+#include "morphomaker.h"
+
+
+
+/**
+ * @brief Creates the workspace root into the system temporary folder.
+ */
+Workspace::Workspace() : m_runs(0), m_nSpares(0)
+{
+    m_firstId = (int)time(NULL);
+    int pid = (int)QCoreApplication::applicationPid();
+
+    m_path = QDir::tempPath() + "/" + PROGRAM_NAME + "_" + QString::number(pid)
+             + "_" + QString::number(m_firstId);
+    if (!QDir().mkpath(m_path)) {
+        m_path = "";
+    }
+}
+
+
+
+/**
+ * @brief Deletes the workspace root and everything in it.
+ */
+Workspace::~Workspace()
+{
+    if (!PRESERVE_MODEL_TEMP && !m_path.isEmpty()) {
+        QDir(m_path).removeRecursively();
+    }
+}
+
+
+
+/**
+ * @brief Returns the run folder of a run.
+ * @param id        Run ID.
+ * @return          Folder path.
+ */
+QString Workspace::runFolder( int id ) const
+{
+    return m_path + "/" + QString::number(id);
+}
+
+
+
+/**
+ * @brief Creates an empty run folder, reusing a released folder if available.
+ * @param id        Run ID.
+ * @return          Folder path.
+ */
+QString Workspace::acquireRunFolder( int id )
+{
+    QString folder = runFolder(id);
+    QDir qdir;
+
+    std::unique_lock<std::mutex> lock(m_mtx);
+    while (!m_spares.empty()) {
+        QString spare = m_spares.back();
+        m_spares.pop_back();
+        if (qdir.rename(spare, folder)) {
+            return folder;
+        }
+        QDir(spare).removeRecursively();
+    }
+    lock.unlock();
+
+    qdir.mkpath(folder);
+    return folder;
+}
+
+
+
+/**
+ * @brief Removes the contents of a run folder. The folder is kept for reuse if
+ *        there are less than WORKSPACE_SPARES spare folders.
+ * @param id        Run ID.
+ */
+void Workspace::releaseRunFolder( int id )
+{
+    QDir qdir(runFolder(id));
+    if (PRESERVE_MODEL_TEMP || !qdir.exists()) {
+        return;
+    }
+
+    auto entries = qdir.entryInfoList( QDir::AllEntries | QDir::Hidden | QDir::System
+                                       | QDir::NoDotAndDotDot );
+    for (auto& e : entries) {
+        if (e.isDir() && !e.isSymLink()) {
+            QDir(e.filePath()).removeRecursively();
+        }
+        else {
+            qdir.remove(e.fileName());
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(m_mtx);
+    if (m_spares.size() < WORKSPACE_SPARES) {
+        QString spare = m_path + "/.spare" + QString::number(m_nSpares++);
+        if (qdir.rename(qdir.path(), spare)) {
+            m_spares.push_back(spare);
+            return;
+        }
+    }
+    qdir.removeRecursively();
+}
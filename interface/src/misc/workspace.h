@@ -0,0 +1,54 @@
+#pragma once
+
+/**
+ * @class Workspace
+ * @brief Allocates run IDs and run folders under the temporary folder.
+ *
+ * The workspace root is '<temp>/<PROGRAM_NAME>_<pid>_<start time>', so that
+ * processes never share run folders, not even if a PID is reused. Within the
+ * process run IDs start from the start time (s) and are incremented by one
+ * per run, so they are monotonic and never collide no matter how fast runs
+ * are started; the run folder of run ID is '<root>/<run ID>'.
+ *
+ * Released run folders are emptied and kept as spares, which are renamed to
+ * the next acquired run folders instead of creating new ones.
+ */
+
+#include <QString>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#define WORKSPACE_SPARES 8      // Max. number of emptied run folders kept for reuse.
+
+
+
+class Workspace
+{
+public:
+    Workspace();
+    ~Workspace();
+
+    // Returns the workspace root; empty if it couldn't be created.
+    const QString& path() const             { return m_path; }
+
+    // Returns a new run ID.
+    int newRunId()                          { return m_firstId + m_runs++; }
+
+    // Returns the run folder of run ID id.
+    QString runFolder( int id ) const;
+
+    // Creates an empty run folder for run ID id; returns the path.
+    QString acquireRunFolder( int id );
+
+    // Empties the run folder of run ID id and keeps it for reuse.
+    void releaseRunFolder( int id );
+
+private:
+    QString m_path;                 // workspace root
+    int m_firstId;                  // start time, the first run ID
+    std::atomic<int> m_runs;        // number of run IDs given
+    std::vector<QString> m_spares;  // emptied run folders
+    int m_nSpares;                  // number of spare folders ever created
+    std::mutex m_mtx;               // guards m_spares
+};
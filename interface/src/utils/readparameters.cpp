@@ -120,6 +120,47 @@ ScanList* morphomaker::Read_scanlist(std::string file)
                 scanList->setViewMode(0);
             }
         }
+        else if (!list[0].toLower().compare("branch")) {
+            // Scan items share the run of the base parameters up to this
+            // iteration.
+            scanList->setBranchIteration( list[1].trimmed().toInt() );
+        }
+        else if (!list[0].toLower().compare("sampling")) {
+            // A budget of jobs (samples==N) is sampled from the values of
+            // the scan items instead of running all of them.
+            QString mode = list[1].trimmed().toLower();
+            if (!mode.compare("grid")) {
+                scanList->setSampling(SAMPLE_GRID);
+            }
+            else if (!mode.compare("random")) {
+                scanList->setSampling(SAMPLE_RANDOM);
+            }
+            else if (!mode.compare("lhs")) {
+                scanList->setSampling(SAMPLE_LHS);
+            }
+            else if (!mode.compare("halton")) {
+                scanList->setSampling(SAMPLE_HALTON);
+            }
+            else if (!mode.compare("sobol")) {
+                scanList->setSampling(SAMPLE_SOBOL);
+            }
+            else {
+                fprintf(stderr, "%s(): Unknown sampling '%s'. Aborted.\n",
+                        __FUNCTION__, mode.toStdString().c_str());
+                #if defined(__linux__)
+                setlocale(LC_ALL, oldloc);
+                #endif
+                delete scanList;
+                fclose(input);
+                return NULL;
+            }
+        }
+        else if (!list[0].toLower().compare("samples")) {
+            scanList->setSampleCount( list[1].trimmed().toLong() );
+        }
+        else if (!list[0].toLower().compare("seed")) {
+            scanList->setSampleSeed( list[1].trimmed().toULong() );
+        }
         else if (!list[0].toLower().compare("orientation")) {
             QStringList orientations = list[1].split(",");
             orientations.removeDuplicates();
@@ -97,13 +97,12 @@ int *get_cells_with_node_(Tooth& tooth, int nodeCell, int vertIndex)
     }
 
     int nVertices = tooth.get_mesh().get_vertices().size();
-    auto& shapes = tooth.get_cell_shapes();
 
     int cellsFound = 0;
-    auto& node_shape = shapes.at( nodeCell );
+    auto node_shape = tooth.get_cell_shape( nodeCell );
 
     for (int i=0; i<nVertices; i++) {
-        auto& shape = shapes.at(i);
+        auto shape = tooth.get_cell_shape(i);
 
         for (size_t j=0; j<shape.size(); j++) {
             if (fabs(shape.at(j).x - node_shape.at(vertIndex).x) < epsilon &&
@@ -131,9 +130,9 @@ int *get_cells_with_node_(Tooth& tooth, int nodeCell, int vertIndex)
  */
 int is_border_cell_(Tooth& tooth, int i)
 {
-    auto& shapes = tooth.get_cell_shapes();
+    auto shape = tooth.get_cell_shape(i);
 
-    for (uint16_t j=0; j<shapes.at(i).size(); j++) {
+    for (uint16_t j=0; j<shape.size(); j++) {
         int *cellsWithNode = get_cells_with_node_(tooth, i,j);
         if (cellsWithNode[2]==-1) {
             free(cellsWithNode);
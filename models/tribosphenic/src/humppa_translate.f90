@@ -101,7 +101,7 @@ integer, public :: pin,pina ! var a pillar act,inh,fgf,ect,p
 integer, public :: submenuid
 integer, public :: nivell,kko !nivell al que fem el tall
 integer, public :: iti,iteraciototal
-character*31, public ::  nfpro
+integer, public :: upro !unitat del comptador de progres (-1 si no n'hi ha)
 
 !constants
 !real(kind=gldouble), public, parameter ::  pi = 3.141592653589793_gldouble
@@ -1704,9 +1704,11 @@ subroutine iteracio(tbu)
     call afegircel
     call calculmarges
     temps=temps+1
-    open(1,file=nfpro,access='append')
-    write (1,*) iteraciototal*(iti-1)+temps
-    close(1)
+    !progress counter updated in place (see common/tmprogress.h in ToothMaker)
+    if (upro>0) then
+      write (upro,pos=17) int(iteraciototal*(iti-1)+temps,8)
+      flush(upro)
+    end if
 end do
 !print *,temps
 
@@ -2239,6 +2241,47 @@ endif
 
 end subroutine get_rainbow
 
+!checkpoint of the whole model state after step itidone, for resuming the run
+!with --resume (see common/tmcheckpoint.h in ToothMaker)
+subroutine guardacheckpoint(fitxer,itidone)
+  character(len=*) fitxer
+  integer itidone
+  open(12,file=fitxer,access='stream',form='unformatted',status='replace')
+  write (12) itidone,temps,npas,ncels,ncals,ncz,radi,maxcels
+  write (12) ud,us,tacre,tahor,acac,acec,acaca,ihac,ih,elas,tadi,crema,bip,bia,bil,bib,ampl,mu,tazmax, &
+             radibi,radibii,fac,ina,umgr,condme,tadif,umelas
+  write (12) nca,icentre,centre,ncils,focus,x,y,xx,yy,csu,ssu,csd,ssd,cst,sst,csq,ssq,csc,ssc,css,sss
+  write (12) nnous,nmaa,nmap,i,j,k,ii,jj,kk,iii,jjj,kkk,iiii,jjjj,kkkk,iiiii,jjjjj,kkkkk
+  write (12) a,b,c,d,e,f,g,h,aa,bb,cc,dd,ee,ff,gg,hh,aaa,bbb,ccc,ddd,eee,fff,ggg,hhh,panic
+  write (12) vlinies,vrender,vmarges,vvec,vvecx,vveck,vex,vn,nc,pin,pina,submenuid,nivell,kko
+  write (12) size(malla,1),size(q3d,2),size(mmaa),size(mmap)
+  write (12) malla,marge,vei,knots,nveins,q2d,q3d,difq3d,difq2d,hmalla,hvmalla,px,py,pz,mmaa,mmap
+  write (12) parap(:,1),nom,map,fora,pass,passs,maptotal,is,maxll,vamax,vamin
+  close(12)
+end subroutine guardacheckpoint
+
+subroutine llegircheckpoint(fitxer,itidone)
+  character(len=*) fitxer
+  integer itidone,n,nz,na,np
+  open(12,file=fitxer,access='stream',form='unformatted',status='old')
+  read (12) itidone,temps,npas,ncels,ncals,ncz,radi,maxcels
+  read (12) ud,us,tacre,tahor,acac,acec,acaca,ihac,ih,elas,tadi,crema,bip,bia,bil,bib,ampl,mu,tazmax, &
+            radibi,radibii,fac,ina,umgr,condme,tadif,umelas
+  read (12) nca,icentre,centre,ncils,focus,x,y,xx,yy,csu,ssu,csd,ssd,cst,sst,csq,ssq,csc,ssc,css,sss
+  read (12) nnous,nmaa,nmap,i,j,k,ii,jj,kk,iii,jjj,kkk,iiii,jjjj,kkkk,iiiii,jjjjj,kkkkk
+  read (12) a,b,c,d,e,f,g,h,aa,bb,cc,dd,ee,ff,gg,hh,aaa,bbb,ccc,ddd,eee,fff,ggg,hhh,panic
+  read (12) vlinies,vrender,vmarges,vvec,vvecx,vveck,vex,vn,nc,pin,pina,submenuid,nivell,kko
+  read (12) n,nz,na,np
+  if (allocated(malla)) call refercid
+  allocate(malla(n,3)) ; allocate(marge(n,nvmax,8)) ; allocate(vei(n,nvmax)) ; allocate(knots(n))
+  allocate(nveins(n)) ; allocate(q2d(n,ngg)) ; allocate(q3d(n,nz,ng)) ; allocate(hmalla(n,3))
+  allocate(hvmalla(n,3)) ; allocate(px(n)) ; allocate(py(n)) ; allocate(pz(n))
+  allocate(mmaa(na)) ; allocate(mmap(np))
+  read (12) malla,marge,vei,knots,nveins,q2d,q3d,difq3d,difq2d,hmalla,hvmalla,px,py,pz,mmaa,mmap
+  read (12) parap(:,1),nom,map,fora,pass,passs,maptotal,is,maxll,vamax,vamin
+  close(12)
+end subroutine llegircheckpoint
+
 end module esclec
 
 
@@ -2275,6 +2318,10 @@ character*6 chs
 character*8 chv
 character*2 di
 character*1 diu
+character*256 cpro
+character*256 cckpt,ckfile,ckprev
+integer itini,ickpt,lastck,ickfin
+real*8    parabr(32)
 integer paras(19)
 integer sis,siss
 integer ancels
@@ -2325,7 +2372,49 @@ call dime
   
   call initact  ! Sets initial activation concentration (Ina).
   
-  do iti=1,sstep 
+  !progress counter given by ToothMaker: total iterations at byte 24, state
+  !(1 running, 2 done) at byte 12, iterations completed at byte 16
+  upro=-1
+  call get_environment_variable("TOOTHMAKER_PROGRESS",cpro,status=nom)
+  if (nom==0) then
+    open(11,file=trim(cpro),access='stream',form='unformatted',status='old',action='readwrite',iostat=nom)
+    if (nom==0) then
+      upro=11
+      write (upro,pos=25) int(iteraciototal*sstep,8)
+      write (upro,pos=13) int(1,4)
+      flush(upro)
+    end if
+  end if
+
+  !resuming from a checkpoint (--resume file as arguments 5 and 6) continues
+  !after the saved step; --branch does the same with the parameters of this
+  !run. Checkpoints are written every ickpt iterations, and after the last one
+  !if ickfin=1, into the folder given by ToothMaker (see common/tmcheckpoint.h)
+  itini=1
+  call getarg(5,cckpt)
+  call getarg(6,ckfile)
+  if (trim(cckpt)=="--resume".or.trim(cckpt)=="--branch") then
+    parabr=parap(:,1)
+    call llegircheckpoint(trim(ckfile),itini)
+    itini=itini+1
+    if (trim(cckpt)=="--branch") then
+      ancels=ncels
+      parap(:,1)=parabr
+      call posarparap(1)
+      ncels=ancels
+    end if
+  end if
+  ickpt=0 ; ickfin=0 ; lastck=itini-1 ; ckprev=""
+  call get_environment_variable("TOOTHMAKER_CHECKPOINT",cckpt,status=nom)
+  if (nom==0) then
+    call get_environment_variable("TOOTHMAKER_CHECKPOINT_FINAL",ckfile,status=nom)
+    if (nom==0.and.trim(ckfile)=="1") ickfin=1
+    call get_environment_variable("TOOTHMAKER_CHECKPOINT_EVERY",ckfile,status=nom)
+    if (nom==0) read (ckfile,*,iostat=nom) ickpt
+    if (nom/=0) ickpt=0
+  end if
+
+  do iti=itini,sstep 
     ii=0
     write (ct,*) (idi+ii)*sis
     write (cq,*) iti*iteraciototal
@@ -2343,16 +2432,10 @@ call dime
       if (nff(i:i)==" ") nff(i:i)="_"
     end do
 
-    nfpro=cau
-    do i=1,len(nfpro)
-      if (nfpro(i:i)==" ") nfpro(i:i)="_"
-    end do
-
 
     nf=nff(1:26)//"_"//".dad"
     nfoff=nff(1:26)//"_"//".off"
     nfes=nff(1:26)//"_"//".txt"
-    nfpro=nfpro(1:15)//"_progressbar"//".txt"
 
 !    call referci
 
@@ -2382,10 +2465,29 @@ call dime
     open(2,file=nfes,iostat=nom)
     call posarparap(1)
     call escriuparatxt
+
+    if ((ickpt>0.and.(iti-lastck)*iteraciototal>=ickpt.and.iti<sstep).or. &
+        (ickfin==1.and.iti==sstep)) then
+      close(2)
+      write (ckfile,*) iti*iteraciototal
+      ckfile=trim(cckpt)//"/"//trim(adjustl(ckfile))//".ckpt"
+      call guardacheckpoint(trim(ckfile)//".part",iti)
+      call rename(trim(ckfile)//".part",trim(ckfile))
+      if (len_trim(ckprev)>0) then
+        open(12,file=trim(ckprev),status='old',iostat=nom)
+        if (nom==0) close(12,status='delete')
+      end if
+      ckprev=ckfile ; lastck=iti
+    end if
   end do
 !end do
 !end do
 
+if (upro>0) then
+  write (upro,pos=13) int(2,4)
+  close(upro)
+end if
+
 parap(:,1)=parapo
 call posarparap(1)
 
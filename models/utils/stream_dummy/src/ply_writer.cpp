@@ -0,0 +1,41 @@
+/**
+ * @file ply_writer.cpp
+ * @brief Builds a Mesh from model arrays and writes it with Write_PLY_file().
+ */
+
+#include <cstdlib>
+
+#include "mesh.h"
+#include "writemesh.h"
+#include "ply_writer.h"
+
+
+
+int write_ply_quads( const char* fname, int nvert, const float* xyz,
+                     const float* rgba, int nquad, const int* indices )
+{
+    if (nvert < 0 || nquad < 0) {
+        return -1;
+    }
+
+    mesh::vertex_array vertices( nvert );
+    mesh::color_array colors( nvert );
+    for (int i=0; i<nvert; i++) {
+        vertices[i] = { xyz[3*i], xyz[3*i+1], xyz[3*i+2] };
+        colors[i] = { rgba[4*i], rgba[4*i+1], rgba[4*i+2], rgba[4*i+3] };
+    }
+
+    std::vector<uint32_t> sizes( nquad, 4 );
+    std::vector<uint32_t> ind( indices, indices + 4*nquad );
+
+    Mesh mesh;
+    mesh.set_vectices( vertices );
+    mesh.set_vertex_colors( colors );
+    mesh.set_polygons( sizes, ind );
+
+    if (morphomaker::Write_PLY_file( fname, mesh ) != EXIT_SUCCESS) {
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,23 @@
+#ifndef PLY_WRITER_H
+#define PLY_WRITER_H
+
+/**
+ * @file ply_writer.h
+ * @brief C interface to the ToothMaker PLY writer (common/writemesh.h), so
+ *        that models write the files ToothMaker reads fastest.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Writes a quad mesh as a binary PLY file. rgba holds colors in range [0,1],
+   indices 4 0-based vertex indices per quad. Returns 0, or -1 on error. */
+int write_ply_quads( const char* fname, int nvert, const float* xyz,
+                     const float* rgba, int nquad, const int* indices );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,251 @@
+/**
+ * Test model for the step streaming channel (common/tmring.h), the progress
+ * counter (common/tmprogress.h) and checkpoints (common/tmcheckpoint.h).
+ *
+ * Grows a ripple on a square grid and publishes every step to ToothMaker
+ * through the ring buffer, reporting progress per iteration. Takes MorphoMaker style arguments:
+ *
+ *   stream_dummy --param [file] --id [run ID] --step [step size] --niter [iterations]
+ *                [--resume|--branch checkpoint]
+ *
+ * Parameters (name==value lines in the parameter file):
+ *   Size   grid size in vertices per side (default 64)
+ *   Rate   ripple speed per iteration (default 0.001)
+ *   Amp    ripple amplitude (default 0.2)
+ *   Delay  ms to sleep per iteration, to imitate computation (default 0)
+ *   Arc    1 to write each step also as <iter>_<id>.ply (binary) for archival
+ *          (default 0)
+ *   Crash  iteration at which to abort unless resumed or branched, to test
+ *          restarts (default 0, never)
+ *
+ * Steps are written as files only if Arc is set or ToothMaker isn't
+ * listening, so the model also works with output style PLY.
+ *
+ * To use in ToothMaker, copy the files in data/ into the Resources folder;
+ * the binary is copied by 'make resources'.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "tmring_client.h"
+#include "tmprogress_client.h"
+#include "tmcheckpoint.h"
+#include "ply_writer.h"
+
+
+typedef struct {
+    int size;
+    float rate, amp;
+    int delay, arc, crash;
+} params_;
+
+
+
+/**
+ * @brief Reads the known parameters from a parameter file.
+ * @param fname     Parameter file.
+ * @param p         Parameters; unchanged if not in the file.
+ * @return          0 if ok, else -1.
+ */
+static int read_params_( const char* fname, params_* p )
+{
+    FILE* f = fopen(fname, "r");
+    if (f == NULL) {
+        fprintf(stderr, "Error: Cannot open file '%s' for reading.\n", fname);
+        return -1;
+    }
+
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        char* sep = strstr(line, "==");
+        if (line[0] == '#' || sep == NULL) {
+            continue;
+        }
+        *sep = '\0';
+        double v = atof(sep+2);
+        if (!strcmp(line, "Size"))       p->size = (int)v;
+        else if (!strcmp(line, "Rate"))  p->rate = v;
+        else if (!strcmp(line, "Amp"))   p->amp = v;
+        else if (!strcmp(line, "Delay")) p->delay = (int)v;
+        else if (!strcmp(line, "Arc"))   p->arc = (int)v;
+        else if (!strcmp(line, "Crash")) p->crash = (int)v;
+    }
+    fclose(f);
+
+    return 0;
+}
+
+
+
+/**
+ * @brief Saves a checkpoint after an iteration. The model state is just the
+ *        iteration.
+ * @param dir       Checkpoint folder.
+ * @param iter      Iteration.
+ * @return          0 if ok, else -1.
+ */
+static int write_checkpoint_( const char* dir, int iter )
+{
+    char fname[1024], part[1040];
+    snprintf(fname, sizeof(fname), "%s/%d" TMCHECKPOINT_EXT, dir, iter);
+    snprintf(part, sizeof(part), "%s.part", fname);
+
+    FILE* f = fopen(part, "w");
+    if (f == NULL) {
+        return -1;
+    }
+    int rv = fprintf(f, "%d\n", iter) < 0;
+    rv |= fclose(f);
+    if (rv || rename(part, fname)) {
+        remove(part);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+
+int main( int argc, char* argv[] )
+{
+    const char* parfile = NULL;
+    const char* resume = NULL;
+    int id = 0, step_size = 1, niter = 0;
+    for (int i=1; i+1<argc; i+=2) {
+        if (!strcmp(argv[i], "--param"))      parfile = argv[i+1];
+        else if (!strcmp(argv[i], "--id"))    id = atoi(argv[i+1]);
+        else if (!strcmp(argv[i], "--step"))  step_size = atoi(argv[i+1]);
+        else if (!strcmp(argv[i], "--niter")) niter = atoi(argv[i+1]);
+        else if (!strcmp(argv[i], TMCHECKPOINT_RESUME)) resume = argv[i+1];
+        else if (!strcmp(argv[i], TMCHECKPOINT_BRANCH)) resume = argv[i+1];
+    }
+    if (parfile == NULL || step_size <= 0) {
+        printf("Usage: stream_dummy --param [file] --id [run ID] --step "
+               "[step size] --niter [iterations]\n");
+        return 0;
+    }
+
+    params_ p = { 64, 0.001, 0.2, 0, 0, 0 };
+    if (read_params_(parfile, &p) || p.size < 2) {
+        return -1;
+    }
+
+    const int n = p.size;
+    const int nvert = n*n, nquad = (n-1)*(n-1);
+    float* xyz = malloc(3*sizeof(float)*nvert);
+    float* rgba = malloc(4*sizeof(float)*nvert);
+    float* data = malloc(2*sizeof(float)*nvert);
+    int* sizes = malloc(sizeof(int)*nquad);
+    int* indices = malloc(4*sizeof(int)*nquad);
+    if (!xyz || !rgba || !data || !sizes || !indices) {
+        return -1;
+    }
+
+    for (int i=0, k=0; i<n-1; i++) {
+        for (int j=0; j<n-1; j++, k++) {
+            sizes[k] = 4;
+            indices[4*k] = i*n+j;
+            indices[4*k+1] = i*n+j+1;
+            indices[4*k+2] = (i+1)*n+j+1;
+            indices[4*k+3] = (i+1)*n+j;
+        }
+    }
+
+    // Continue after the iteration of the checkpoint; the parameters of a
+    // branch are read from the parameter file anyway.
+    int first = 0;
+    if (resume != NULL) {
+        FILE* f = fopen(resume, "r");
+        int iter = 0;
+        if (f == NULL || fscanf(f, "%d", &iter) != 1) {
+            fprintf(stderr, "Error: Cannot read checkpoint '%s'.\n", resume);
+            return -1;
+        }
+        fclose(f);
+        first = iter/step_size + 1;
+    }
+
+    const char* ckdir = getenv(TMCHECKPOINT_ENV);
+    const char* every = getenv(TMCHECKPOINT_EVERY_ENV);
+    const char* final = getenv(TMCHECKPOINT_FINAL_ENV);
+    int ckpt_every = ckdir && every ? atoi(every) : 0;
+    int ckpt_final = ckdir && final && !strcmp(final, "1");
+    int ckpt_last = first > 0 ? (first-1)*step_size : 0;
+
+    int streaming = tmring_open() == 0;
+    tmprogress_open(niter);
+
+    for (int step=first; step*step_size<=niter; step++) {
+        int iter = step*step_size;
+        float front = p.rate*iter;
+
+        for (int v=0; v<nvert; v++) {
+            float x = (float)(v%n)/(n-1) - 0.5f;
+            float y = (float)(v/n)/(n-1) - 0.5f;
+            float r = sqrtf(x*x + y*y);
+            float z = r < front ? p.amp*cosf(20.0f*(r-front))*(front-r) : 0.0f;
+            xyz[3*v] = x;
+            xyz[3*v+1] = y;
+            xyz[3*v+2] = z;
+
+            // Differentiated behind the front, knot at the center.
+            float a = r < front ? 0.3f : 0.0f;
+            if (r < 0.05f && front > 0.05f) {
+                a = 1.0f;
+            }
+            rgba[4*v] = 1.0f;
+            rgba[4*v+1] = 1.0f;
+            rgba[4*v+2] = 0.0f;
+            rgba[4*v+3] = a;
+
+            data[2*v] = z > 0.0f ? z/p.amp : 0.0f;
+            data[2*v+1] = z < 0.0f ? -z/p.amp : 0.0f;
+        }
+
+        // Iterations between the steps.
+        for (int i=iter-step_size+1; i<=iter && i>0; i++) {
+            if (p.delay > 0) {
+                usleep(1000*p.delay);
+            }
+            tmprogress_set(i);
+            if (p.crash > 0 && i == p.crash && resume == NULL) {
+                fprintf(stderr, "stream_dummy: Crashing at iteration %d.\n", i);
+                abort();
+            }
+        }
+
+        if (streaming && tmring_publish(step, nvert, xyz, nvert, rgba, nquad,
+                                        sizes, 4*nquad, indices, nvert, 2, data)) {
+            fprintf(stderr, "stream_dummy: Can't publish step %d, writing "
+                    "files.\n", step);
+            streaming = 0;
+        }
+        if (!streaming || p.arc) {
+            char fname[64];
+            sprintf(fname, "%d_%d.ply", iter, id);
+            if (write_ply_quads(fname, nvert, xyz, rgba, nquad, indices)) {
+                break;
+            }
+        }
+
+        if ((ckpt_every > 0 && iter-ckpt_last >= ckpt_every && iter < niter) ||
+            (ckpt_final && (step+1)*step_size > niter)) {
+            write_checkpoint_(ckdir, iter);
+            ckpt_last = iter;
+        }
+    }
+
+    tmring_close();
+    tmprogress_close();
+    free(xyz);
+    free(rgba);
+    free(data);
+    free(sizes);
+    free(indices);
+
+    return 0;
+}
@@ -0,0 +1,32 @@
+TEMPLATE = app
+CONFIG -= app_bundle
+QT -= core gui
+INCLUDEPATH += src/ ../tmring/src/ ../../../common/
+
+# Remove arguments GCC doesnt recognize.
+QMAKE_CXXFLAGS_X86_64 -= -arch x86_64 -Xarch_x86_64
+QMAKE_CFLAGS_X86_64 -= -arch x86_64 -Xarch_x86_64
+QMAKE_LFLAGS_X86_64 -= -arch x86_64 -Xarch_x86_64
+
+QMAKE_CFLAGS_RELEASE -= -O2
+QMAKE_CFLAGS_RELEASE += -O3 -std=gnu99
+QMAKE_CFLAGS_DEBUG += -std=gnu99
+QMAKE_CXXFLAGS_RELEASE -= -O2
+QMAKE_CXXFLAGS_RELEASE += -O3 -std=c++11
+QMAKE_CXXFLAGS_DEBUG += -std=c++11
+
+equals(OSX, "10.6") {
+    include(../../../gcc-macports.pri)
+    QMAKE_LFLAGS += -static-libstdc++ -static-libgcc
+} else {
+    mac: include(../../../clang-macports.pri)
+}
+
+# Client library built in ../tmring.
+LIBS += -L../tmring -ltmring -lm
+PRE_TARGETDEPS += ../tmring/libtmring.a
+
+INCLUDEPATH +=
+HEADERS += src/ply_writer.h ../../../common/writemesh.h ../../../common/mesh.h
+SOURCES += src/stream_dummy.c src/ply_writer.cpp ../../../common/writemesh.cpp
+TARGET = stream_dummy
@@ -0,0 +1,83 @@
+/**
+ * @file tmprogress_client.c
+ * @brief Client library for reporting model progress to ToothMaker through
+ *        the mapped progress counter (see common/tmprogress.h).
+ */
+
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "tmprogress.h"
+#include "tmprogress_client.h"
+
+
+static tmprogress_header* progress_ = NULL;
+
+
+
+/**
+ * @brief Attaches to the counter named by the TMPROGRESS_ENV environment
+ *        variable.
+ * @param total     Total number of iterations, 0 if unknown.
+ * @return          0 if attached, -1 if there is no valid counter.
+ */
+int tmprogress_open( long total )
+{
+    const char* path = getenv(TMPROGRESS_ENV);
+    if (progress_ != NULL || path == NULL) {
+        return progress_ != NULL ? 0 : -1;
+    }
+
+    int fd = open(path, O_RDWR);
+    if (fd < 0) {
+        return -1;
+    }
+    void* p = mmap(NULL, TMPROGRESS_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        return -1;
+    }
+
+    tmprogress_header* h = (tmprogress_header*)p;
+    if (h->magic != TMPROGRESS_MAGIC || h->version != TMPROGRESS_VERSION) {
+        munmap(p, TMPROGRESS_SIZE);
+        return -1;
+    }
+
+    progress_ = h;
+    tmring_store_(&progress_->total, total > 0 ? total : 0);
+    tmring_store_(&progress_->iter, 0);
+    tmring_store32_(&progress_->state, TMPROGRESS_RUNNING);
+
+    return 0;
+}
+
+
+
+/**
+ * @brief Sets the number of iterations completed.
+ */
+void tmprogress_set( long iter )
+{
+    if (progress_ != NULL && iter >= 0) {
+        tmring_store_(&progress_->iter, iter);
+    }
+}
+
+
+
+/**
+ * @brief Marks the model finished and unmaps the counter.
+ */
+void tmprogress_close( void )
+{
+    if (progress_ == NULL) {
+        return;
+    }
+    tmring_store32_(&progress_->state, TMPROGRESS_DONE);
+    munmap(progress_, TMPROGRESS_SIZE);
+    progress_ = NULL;
+}
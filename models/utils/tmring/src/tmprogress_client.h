@@ -0,0 +1,34 @@
+#ifndef TMPROGRESS_CLIENT_H
+#define TMPROGRESS_CLIENT_H
+
+/**
+ * @file tmprogress_client.h
+ * @brief Client library for reporting model progress to ToothMaker through
+ *        the mapped progress counter (see common/tmprogress.h).
+ *
+ *   tmprogress_open(niter);        once at start-up
+ *   tmprogress_set(iter);          after each iteration; no system calls
+ *   tmprogress_close();            at exit
+ *
+ * Without ToothMaker (no counter file) the calls do nothing.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Attaches to the counter given by ToothMaker; total is the number of
+   iterations, 0 if unknown. Returns 0, or -1 if there is no counter. */
+int tmprogress_open( long total );
+
+/* Sets the number of iterations completed. */
+void tmprogress_set( long iter );
+
+/* Marks the model finished and detaches. */
+void tmprogress_close( void );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,54 @@
+! Fortran interface to the ToothMaker client library: step streaming
+! (tmring_client.h) and progress reporting (tmprogress_client.h).
+!
+!   use tmring
+!   if (tmring_open() == 0) ...
+!   rv = tmring_publish(step, nvert, xyz, ncolor, rgba, npoly, sizes, &
+!                       nindex, indices, ncell, ndata, dat)
+!   call tmring_close()
+!
+! xyz(3,nvert), rgba(4,nvert), dat(ndata,ncell) are real(c_float) arrays,
+! sizes and indices (0-based) integer(c_int) arrays. Pass any array as rgba
+! when ncolor is 0, and as dat when ncell or ndata is 0.
+!
+!   rv = tmprogress_open(int(niter, c_long))
+!   call tmprogress_set(int(iter, c_long))
+!   call tmprogress_close()
+
+module tmring
+  use iso_c_binding
+  implicit none
+
+  interface
+    integer(c_int) function tmring_open() bind(C, name="tmring_open")
+      import :: c_int
+    end function tmring_open
+
+    integer(c_int) function tmring_publish(step, nvert, xyz, ncolor, rgba, &
+                                           npoly, sizes, nindex, indices, &
+                                           ncell, ndata, dat) &
+                                           bind(C, name="tmring_publish")
+      import :: c_int, c_float
+      integer(c_int), value :: step, nvert, ncolor, npoly, nindex, ncell, ndata
+      real(c_float), intent(in) :: xyz(*), rgba(*), dat(*)
+      integer(c_int), intent(in) :: sizes(*), indices(*)
+    end function tmring_publish
+
+    subroutine tmring_close() bind(C, name="tmring_close")
+    end subroutine tmring_close
+
+    integer(c_int) function tmprogress_open(total) bind(C, name="tmprogress_open")
+      import :: c_int, c_long
+      integer(c_long), value :: total
+    end function tmprogress_open
+
+    subroutine tmprogress_set(iter) bind(C, name="tmprogress_set")
+      import :: c_long
+      integer(c_long), value :: iter
+    end subroutine tmprogress_set
+
+    subroutine tmprogress_close() bind(C, name="tmprogress_close")
+    end subroutine tmprogress_close
+  end interface
+
+end module tmring
@@ -0,0 +1,155 @@
+/**
+ * @file tmring_client.c
+ * @brief Client library for publishing model steps to ToothMaker through
+ *        the shared-memory ring buffer (see common/tmring.h).
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "tmring.h"
+#include "tmring_client.h"
+
+#define TMRING_TIMEOUT_US 60000000  /* Max. wait for a free slot. */
+
+
+static tmring_header* ring_ = NULL;
+static size_t ring_size_ = 0;
+
+
+
+/**
+ * @brief Attaches to the ring named by the TMRING_ENV environment variable.
+ * @return      0 if attached, -1 if there is no valid ring.
+ */
+int tmring_open( void )
+{
+    const char* path = getenv(TMRING_ENV);
+    if (ring_ != NULL || path == NULL) {
+        return ring_ != NULL ? 0 : -1;
+    }
+
+    int fd = open(path, O_RDWR);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) || st.st_size < TMRING_HEADER_SIZE) {
+        close(fd);
+        return -1;
+    }
+    void* p = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        return -1;
+    }
+
+    tmring_header* h = (tmring_header*)p;
+    if (h->magic != TMRING_MAGIC || h->version != TMRING_VERSION ||
+        h->slot_count == 0 || (uint64_t)st.st_size <
+        TMRING_HEADER_SIZE + (uint64_t)h->slot_count*h->slot_size) {
+        munmap(p, st.st_size);
+        return -1;
+    }
+
+    ring_ = h;
+    ring_size_ = st.st_size;
+    tmring_store32_(&ring_->producer, TMRING_ATTACHED);
+
+    return 0;
+}
+
+
+
+/**
+ * @brief Copies n 4-byte values to p, returns the position after them.
+ */
+static char* put_( char* p, const void* src, uint64_t n )
+{
+    if (n > 0) {
+        memcpy(p, src, 4*n);
+    }
+    return p + 4*n;
+}
+
+
+
+/**
+ * @brief Publishes a step. Waits while the ring is full.
+ * @return      0 if published, else -1.
+ */
+int tmring_publish( int step, int nvert, const float* xyz,
+                    int ncolor, const float* rgba,
+                    int npoly, const int* sizes, int nindex, const int* indices,
+                    int ncell, int ndata, const float* data )
+{
+    if (ring_ == NULL || nvert < 0 || npoly < 0 || nindex < 0 || ncell < 0 ||
+        ndata < 0 || (ncolor != 0 && ncolor != nvert)) {
+        return -1;
+    }
+
+    uint64_t bytes = tmring_record_bytes_(nvert, ncolor, npoly, nindex,
+                                          ncell, ndata);
+    if (bytes > ring_->slot_size) {
+        return -1;
+    }
+
+    // Wait for a free slot.
+    uint64_t head = ring_->head;
+    long waited = 0, wait = 100;
+    while (head - tmring_load_(&ring_->tail) >= ring_->slot_count) {
+        if (tmring_load32_(&ring_->consumer_closed) || waited > TMRING_TIMEOUT_US) {
+            return -1;
+        }
+        usleep(wait);
+        waited += wait;
+        if (wait < 10000) {
+            wait *= 2;
+        }
+    }
+
+    char* slot = (char*)ring_ + TMRING_HEADER_SIZE
+                 + (head % ring_->slot_count)*ring_->slot_size;
+    tmring_record rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.step = step;
+    rec.nvert = nvert;
+    rec.ncolor = ncolor;
+    rec.npoly = npoly;
+    rec.nindex = nindex;
+    rec.ncell = ncell;
+    rec.ndata = ndata;
+    rec.bytes = bytes;
+    memcpy(slot, &rec, sizeof(rec));
+
+    char* p = slot + sizeof(rec);
+    p = put_(p, xyz, 3*(uint64_t)nvert);
+    p = put_(p, rgba, 4*(uint64_t)ncolor);
+    p = put_(p, sizes, npoly);
+    p = put_(p, indices, nindex);
+    put_(p, data, (uint64_t)ncell*ndata);
+
+    tmring_store_(&ring_->head, head+1);
+
+    return 0;
+}
+
+
+
+/**
+ * @brief Marks all steps published and unmaps the ring.
+ */
+void tmring_close( void )
+{
+    if (ring_ == NULL) {
+        return;
+    }
+    tmring_store32_(&ring_->producer, TMRING_DONE);
+    munmap(ring_, ring_size_);
+    ring_ = NULL;
+    ring_size_ = 0;
+}
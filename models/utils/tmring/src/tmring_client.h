@@ -0,0 +1,42 @@
+#ifndef TMRING_CLIENT_H
+#define TMRING_CLIENT_H
+
+/**
+ * @file tmring_client.h
+ * @brief Client library for publishing model steps to ToothMaker through
+ *        the shared-memory ring buffer (see common/tmring.h).
+ *
+ * Callable from C, C++ and, through the module in tmring.f90, Fortran:
+ *
+ *   if (tmring_open() == 0) { ... }             once at start-up
+ *   tmring_publish(step, nvert, xyz, ...);      after each step
+ *   tmring_close();                             at exit
+ *
+ * Indices are 0-based. A model not started by ToothMaker (no ring) gets -1
+ * from tmring_open() and tmring_publish() and should just write its files.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Attaches to the ring given by ToothMaker. Returns 0, or -1 if there is no
+   ring. */
+int tmring_open( void );
+
+/* Publishes a step; blocks while the ring is full. ncolor is 0 or nvert,
+   nindex the sum of sizes. Returns 0, or -1 if not attached, the step
+   doesn't fit in a slot or ToothMaker is gone. */
+int tmring_publish( int step, int nvert, const float* xyz,
+                    int ncolor, const float* rgba,
+                    int npoly, const int* sizes, int nindex, const int* indices,
+                    int ncell, int ndata, const float* data );
+
+/* Marks all steps published and detaches. */
+void tmring_close( void );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
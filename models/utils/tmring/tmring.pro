@@ -0,0 +1,27 @@
+TEMPLATE = lib
+CONFIG += staticlib
+CONFIG -= app_bundle
+QT -= core gui
+INCLUDEPATH += src/ ../../../common/
+
+# Remove arguments GCC doesnt recognize.
+QMAKE_CXXFLAGS_X86_64 -= -arch x86_64 -Xarch_x86_64
+QMAKE_CFLAGS_X86_64 -= -arch x86_64 -Xarch_x86_64
+QMAKE_LFLAGS_X86_64 -= -arch x86_64 -Xarch_x86_64
+
+QMAKE_CFLAGS_RELEASE -= -O2
+QMAKE_CFLAGS_RELEASE += -O3 -std=gnu99
+QMAKE_CFLAGS_DEBUG += -std=gnu99
+
+equals(OSX, "10.6") {
+    include(../../../gcc-macports.pri)
+} else {
+    mac: include(../../../clang-macports.pri)
+}
+
+# Fortran models: compile src/tmring.f90 along with the model sources and
+# link against this library.
+HEADERS += src/tmring_client.h src/tmprogress_client.h \
+           ../../../common/tmring.h ../../../common/tmprogress.h
+SOURCES += src/tmring_client.c src/tmprogress_client.c
+TARGET = tmring
@@ -8,7 +8,9 @@ equals(OSX, "10.6") {
 
 SUBDIRS = dad_to_polygons \
           no_empty_lines \
-          top_cusp_angle
+          top_cusp_angle \
+          tmring \
+          stream_dummy
           # main_cusp_baseline
 
 CONFIG += ordered